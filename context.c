@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <setjmp.h>
+#include "value.h"
+#include "talloc.h"
+#include "trace.h"
+#include "profiler.h"
+#include "context.h"
+
+/*
+* Saves the state an error handler restores and installs the handler.
+*/
+void checkpoint(Interpreter *interp, Checkpoint *saved, jmp_buf *onError) {
+    saved->onError = interp->onError;
+    saved->in = interp->in;
+    saved->input = interp->input;
+    saved->escapes = interp->escapes;
+    saved->liveDepth = interp->liveDepth;
+    saved->argumentDepth = interp->argumentDepth;
+    saved->traceDepth = traceDepth();
+    saved->profileProcedure = profileProcedure;
+    interp->onError = onError;
+}
+
+/*
+* Puts back the state saved by checkpoint. Trace spans left open by an error
+* are closed so that the trace stays well nested.
+*/
+void restore(Interpreter *interp, Checkpoint *saved) {
+    interp->onError = saved->onError;
+    interp->in = saved->in;
+    interp->input = saved->input;
+    interp->escapes = saved->escapes;
+    interp->liveDepth = saved->liveDepth;
+    interp->argumentDepth = saved->argumentDepth;
+    traceUnwind(saved->traceDepth);
+    profileProcedure = saved->profileProcedure;
+}
+
+/*
+* Abandons the current evaluation because of an error. Control returns to
+* the interpreter's error handler, or the process exits if there is none.
+*/
+void raiseError(Interpreter *interp, char *message) {
+    raiseObject(interp, NULL, message);
+}
+
+/*
+* Abandons the current evaluation, recording 'object' as what was raised.
+*/
+void raiseObject(Interpreter *interp, struct Value *object, char *message) {
+    interp->error = message;
+    interp->raised = object;
+    if (interp->onError) {
+        longjmp(*interp->onError, 1);
+    }
+    printf("%s", message);
+    texit(1);
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <setjmp.h>
+#include "value.h"
+#include "talloc.h"
+
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+/*
+* Everything one interpreter instance needs: its heap, top-level frame,
+* input source and error state. Each instance is passed explicitly through
+* tokenize, parse, eval and apply, and nothing in them is process-global,
+* so independent instances can run on different threads at the same time.
+* A given instance must only be used by one thread at a time.
+*/
+struct Interpreter {
+    Heap *heap;
+    struct Frame *global;
+
+    // Where tokenize reads source from. load points this at the file being
+    // loaded and restores it afterwards.
+    FILE *in;
+
+    // Where control goes when an error is raised: raiseError stores the
+    // message in 'error' and longjmps here. If NULL, raiseError prints the
+    // message and exits the process.
+    jmp_buf *onError;
+    char *error;
+
+    // The object given to (raise obj) for the most recent error, or the bare
+    // message as a string for evaluation errors; NULL for syntax errors.
+    struct Value *raised;
+
+    // The port read-char, read-line and read use when given none (see
+    // port.h), or NULL for standard input.
+    struct Port *input;
+
+    // The innermost call/ec or let/ec being evaluated (see escape.h), and
+    // the one an escape in progress is returning to; NULL if none.
+    struct Escape *escapes;
+    struct Escape *escaping;
+
+    // Rewrites applied to top-level forms (OPTIMIZE_ flags, optimizer.h).
+    int optimizations;
+
+    // Errors reported by interpret() since the instance was created.
+    int errorCount;
+
+    // Futures created by this instance and its workers (see future.h).
+    struct FutureSet *futures;
+
+    // Green threads of this instance (see green.h), or NULL until the
+    // first is spawned.
+    struct Scheduler *scheduler;
+
+    // Event loop of this instance (see eventloop.h), or NULL until first
+    // used.
+    struct EventLoop *events;
+
+    // Frames kept for reuse by calls and let forms that cannot capture
+    // them, or NULL until the first is kept.
+    struct FramePool *framePool;
+
+    // Frames of the calls and let forms currently being evaluated,
+    // innermost last; the roots, besides 'global', for heap-dump.
+    struct Frame **liveFrames;
+    int liveDepth;
+    int liveCapacity;
+
+    // Argument values of the calls being evaluated, innermost last, so
+    // that they take no space on the C stack (see pushArguments); NULL
+    // until first used.
+    struct Value **arguments;
+    int argumentDepth;
+};
+typedef struct Interpreter Interpreter;
+
+/*
+* The state an error handler puts back when it catches an error: the
+* enclosing handler, the input source, the current input port, the
+* innermost escape point, the live-frame and argument depths, and the
+* calling thread's open trace spans and profiled procedure.
+*/
+typedef struct {
+    jmp_buf *onError;
+    FILE *in;
+    struct Port *input;
+    struct Escape *escapes;
+    int liveDepth;
+    int argumentDepth;
+    int traceDepth;
+    char *profileProcedure;
+} Checkpoint;
+
+/*
+* Saves the current state in 'saved' and makes 'onError' the handler for
+* errors raised from now on. Call setjmp(*onError) right after.
+*/
+void checkpoint(Interpreter *interp, Checkpoint *saved, jmp_buf *onError);
+
+/*
+* Puts back the state saved by checkpoint, including the enclosing handler.
+* Call it both when the guarded code finishes and when it raises an error.
+*/
+void restore(Interpreter *interp, Checkpoint *saved);
+
+/*
+* Abandons the current evaluation because of an error. 'message' is the full
+* text to report, including its trailing newline.
+*/
+void raiseError(Interpreter *interp, char *message);
+
+/*
+* Like raiseError, but also records 'object' as what was raised, for
+* with-exception-handler. raiseObject(interp, interp->raised, interp->error)
+* passes a caught error on to the enclosing handler.
+*/
+void raiseObject(Interpreter *interp, struct Value *object, char *message);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "escape.h"
+
+struct Escape {
+    // the escape point this one was made inside of, or NULL
+    struct Escape *enclosing;
+};
+
+Value *callWithEscape(Interpreter *interp,
+                      Value *(*body)(Interpreter *, Value *, void *),
+                      void *data) {
+    // Allocated rather than on the stack, so that a k kept after its
+    // call/ec returns can never match a later escape point at the same
+    // address.
+    Escape *escape = talloc(sizeof(Escape));
+    escape->enclosing = interp->escapes;
+    Value *k = makeNull();
+    k->type = ESCAPE_TYPE;
+    k->escape = escape;
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (setjmp(onError)) {
+        restore(interp, &saved);
+        if (interp->escaping != escape) {
+            // an error, or an escape to an enclosing call/ec
+            raiseObject(interp, interp->raised, interp->error);
+        }
+        interp->escaping = NULL;
+        return interp->raised;
+    }
+    interp->escapes = escape;
+    Value *result = body(interp, k, data);
+    restore(interp, &saved);
+    return result;
+}
+
+void applyEscape(Interpreter *interp, Value *k, Value *args) {
+    if (args->type == CONS_TYPE && cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Too many arguments provided to an escape procedure");
+    }
+    Escape *target = k->escape;
+    Escape *escape = interp->escapes;
+    while (escape && escape != target) {
+        escape = escape->enclosing;
+    }
+    if (!escape) {
+        evaluationError(interp, "Escape procedure called outside its call/ec");
+    }
+    Value *value;
+    if (args->type == CONS_TYPE) {
+        value = car(args);
+    } else {
+        value = makeNull();
+        value->type = VOID_TYPE;
+    }
+    interp->escaping = target;
+    raiseObject(interp, value, "Evaluation Error: Uncaught escape\n");
+}
+
+static Value *applyToEscape(Interpreter *interp, Value *k, void *procedure) {
+    return apply(interp, procedure, cons(k, makeNull()));
+}
+
+Value *primitiveCallEc(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for call/ec");
+    }
+    Value *procedure = car(args);
+    if (procedure->type != CLOSURE_TYPE && procedure->type != PRIMITIVE_TYPE &&
+        procedure->type != ESCAPE_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for call/ec");
+    }
+    return callWithEscape(interp, applyToEscape, procedure);
+}
+
+size_t escapeSize(Value *k) {
+    return sizeof(Escape);
+}
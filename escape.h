@@ -0,0 +1,54 @@
+#include "value.h"
+#include "context.h"
+#include "heapdump.h"
+
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+/*
+* Escape continuations, for leaving a search or a validation as soon as its
+* answer is known. (call/ec proc) calls proc with an escape procedure k;
+* if k is called with a value while proc is still running, the call/ec
+* returns that value at once, abandoning whatever was in progress, and
+* otherwise it returns what proc returns. (let/ec k body ...) is the same
+* with the body in place of proc.
+*
+* An escape is a longjmp back to the call/ec, going through the error
+* handlers installed in between (see context.h) so they clean up as they
+* do for an error, without calling with-exception-handler handlers. So it
+* costs a setjmp to make and a jump per handler to take, and nothing for
+* the frames in between. k can only be called while its call/ec is
+* running, in the same thread; calling it afterwards is an error.
+*/
+
+/*
+* An escape point: a call/ec that is running.
+*/
+typedef struct Escape Escape;
+
+/*
+* Calls body(interp, k, data), k being a new escape procedure, and returns
+* its value, or the value k is called with if k is called first.
+*/
+Value *callWithEscape(Interpreter *interp,
+                      Value *(*body)(Interpreter *, Value *, void *),
+                      void *data);
+
+/*
+* Escapes to the call/ec that made the escape procedure 'k', which returns
+* the value in 'args', or void if there is none. Does not return.
+*/
+void applyEscape(Interpreter *interp, Value *k, Value *args);
+
+/*
+* (call/ec proc) calls proc with an escape procedure, as described above.
+*/
+Value *primitiveCallEc(Interpreter *interp, Value *args);
+
+/*
+* Returns the size of the escape point of the escape procedure 'k', for
+* heap-dump.
+*/
+size_t escapeSize(Value *k);
+
+#endif
@@ -0,0 +1,621 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <assert.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "eventloop.h"
+
+#define READ_BUFFER_SIZE 65536
+#define MAX_EVENTS 64 // events taken from the kernel per epoll_wait
+
+/*
+* What the loop knows about one descriptor.
+*/
+typedef struct {
+    int fd;
+    Value *onReadable;      // NULL if not watched for reading
+    bool listening;         // a listening socket: readable means acceptable
+    bool owned;             // created by the loop, closed with it
+    bool closing;           // close once the queued output is written
+    unsigned int registered; // epoll events currently asked for
+    char *pending;          // queued output, 'length' bytes from 'start'
+    size_t start;
+    size_t length;
+    size_t capacity;
+} Watch;
+
+/*
+* A pending timer. Timers are kept soonest first.
+*/
+typedef struct Timer {
+    double due;
+    Value *callback;
+    int id;
+    struct Timer *next;
+} Timer;
+
+struct EventLoop {
+    int epoll;
+    Watch **watches;    // indexed by descriptor
+    int watchCapacity;
+    int registered;     // watches with events registered
+    Timer *timers;
+    int nextTimer;
+    char buffer[READ_BUFFER_SIZE];
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+* Returns the instance's loop, creating it first if need be. Writing to a
+* closed pipe or socket should fail with EPIPE rather than kill the
+* process, so creating the loop also ignores SIGPIPE.
+*/
+static EventLoop *getLoop(Interpreter *interp) {
+    if (!interp->events) {
+        EventLoop *loop = malloc(sizeof(EventLoop));
+        assert(loop);
+        loop->epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (loop->epoll < 0) {
+            free(loop);
+            evaluationError(interp, "Could not create the event loop");
+        }
+        loop->watches = NULL;
+        loop->watchCapacity = 0;
+        loop->registered = 0;
+        loop->timers = NULL;
+        loop->nextTimer = 1;
+        signal(SIGPIPE, SIG_IGN);
+        interp->events = loop;
+    }
+    return interp->events;
+}
+
+/*
+* Returns the watch for 'fd', creating it if need be.
+*/
+static Watch *getWatch(EventLoop *loop, int fd) {
+    if (fd >= loop->watchCapacity) {
+        int capacity = loop->watchCapacity ? loop->watchCapacity : 16;
+        while (capacity <= fd) {
+            capacity *= 2;
+        }
+        loop->watches = realloc(loop->watches, capacity * sizeof(Watch *));
+        assert(loop->watches);
+        memset(loop->watches + loop->watchCapacity, 0,
+               (capacity - loop->watchCapacity) * sizeof(Watch *));
+        loop->watchCapacity = capacity;
+    }
+    if (!loop->watches[fd]) {
+        Watch *watch = calloc(1, sizeof(Watch));
+        assert(watch);
+        watch->fd = fd;
+        loop->watches[fd] = watch;
+    }
+    return loop->watches[fd];
+}
+
+static Watch *findWatch(EventLoop *loop, int fd) {
+    return fd < loop->watchCapacity ? loop->watches[fd] : NULL;
+}
+
+/*
+* Asks epoll for the events 'watch' now needs. Returns false if the
+* descriptor cannot be watched.
+*/
+static bool updateInterest(EventLoop *loop, Watch *watch) {
+    unsigned int wanted = (watch->onReadable ? EPOLLIN : 0) |
+                          (watch->length ? EPOLLOUT : 0);
+    if (wanted == watch->registered) {
+        return true;
+    }
+    struct epoll_event event;
+    event.events = wanted;
+    event.data.fd = watch->fd;
+    int op = !watch->registered ? EPOLL_CTL_ADD
+             : wanted ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+    if (epoll_ctl(loop->epoll, op, watch->fd, &event) < 0) {
+        return false;
+    }
+    if (!watch->registered) {
+        loop->registered++;
+    } else if (!wanted) {
+        loop->registered--;
+    }
+    watch->registered = wanted;
+    return true;
+}
+
+/*
+* Forgets 'watch' and closes its descriptor.
+*/
+static void removeWatch(EventLoop *loop, Watch *watch) {
+    if (watch->registered) {
+        epoll_ctl(loop->epoll, EPOLL_CTL_DEL, watch->fd, NULL);
+        loop->registered--;
+    }
+    close(watch->fd);
+    loop->watches[watch->fd] = NULL;
+    free(watch->pending);
+    free(watch);
+}
+
+void destroyEventLoop(EventLoop *loop) {
+    for (int fd = 0; fd < loop->watchCapacity; fd++) {
+        Watch *watch = loop->watches[fd];
+        if (watch) {
+            if (watch->owned) {
+                close(fd);
+            }
+            free(watch->pending);
+            free(watch);
+        }
+    }
+    while (loop->timers) {
+        Timer *next = loop->timers->next;
+        free(loop->timers);
+        loop->timers = next;
+    }
+    close(loop->epoll);
+    free(loop->watches);
+    free(loop);
+}
+
+/*
+* Writes as much of 'data' as the descriptor takes without blocking.
+* Returns the number of bytes written, or -1 on an error other than a full
+* descriptor.
+*/
+static ssize_t writeSome(int fd, char *data, size_t length) {
+    if (fd == STDOUT_FILENO) {
+        fflush(stdout); // keep order with what printf has buffered
+    }
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = write(fd, data + written, length - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        written += n;
+    }
+    return written;
+}
+
+/*
+* Appends to the watch's queued output, reusing the space already drained.
+*/
+static void queueOutput(Watch *watch, char *data, size_t length) {
+    if (watch->start + watch->length + length > watch->capacity) {
+        memmove(watch->pending, watch->pending + watch->start, watch->length);
+        watch->start = 0;
+        if (watch->length + length > watch->capacity) {
+            size_t capacity = watch->capacity ? watch->capacity : 4096;
+            while (capacity < watch->length + length) {
+                capacity *= 2;
+            }
+            watch->pending = realloc(watch->pending, capacity);
+            assert(watch->pending);
+            watch->capacity = capacity;
+        }
+    }
+    memcpy(watch->pending + watch->start + watch->length, data, length);
+    watch->length += length;
+}
+
+/*
+* Writes queued output now that the descriptor is writable. Output that
+* cannot be written at all (the reader has gone) is dropped.
+*/
+static void flushOutput(EventLoop *loop, Watch *watch) {
+    ssize_t n = writeSome(watch->fd, watch->pending + watch->start,
+                          watch->length);
+    if (n < 0) {
+        n = watch->length;
+    }
+    watch->start += n;
+    watch->length -= n;
+    if (!watch->length) {
+        watch->start = 0;
+    }
+    if (!watch->length && watch->closing) {
+        removeWatch(loop, watch);
+    } else {
+        updateInterest(loop, watch);
+    }
+}
+
+/*
+* Reads once from a readable descriptor into the shared buffer and passes
+* what was read to its procedure.
+*/
+static void readReady(Interpreter *interp, EventLoop *loop, Watch *watch) {
+    Value *callback = watch->onReadable;
+    Value *data = makeNull();
+    data->type = BOOL_TYPE;
+    if (watch->listening) {
+        data->b = true;
+        apply(interp, callback, cons(data, makeNull()));
+        return;
+    }
+    ssize_t n = read(watch->fd, loop->buffer, READ_BUFFER_SIZE - 1);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        // end of file, or an error that ends the stream just the same
+        watch->onReadable = NULL;
+        updateInterest(loop, watch);
+        data->b = false;
+    } else {
+        data->type = STR_TYPE;
+        data->s = talloc(n + 1);
+        memcpy(data->s, loop->buffer, n);
+        data->s[n] = '\0';
+    }
+    apply(interp, callback, cons(data, makeNull()));
+}
+
+/*
+* Calls every timer that is due, in order, taking each off the list first.
+*/
+static void fireTimers(Interpreter *interp, EventLoop *loop) {
+    double time = now();
+    while (loop->timers && loop->timers->due <= time) {
+        Timer *timer = loop->timers;
+        loop->timers = timer->next;
+        Value *callback = timer->callback;
+        free(timer);
+        apply(interp, callback, makeNull());
+    }
+}
+
+/*
+* Returns the descriptor argument 'value', raising 'message' if it is not
+* one.
+*/
+static int fdArgument(Interpreter *interp, Value *value, char *message) {
+    if (value->type != INT_TYPE || value->i < 0) {
+        evaluationError(interp, message);
+    }
+    return value->i;
+}
+
+static Value *fdValue(int fd) {
+    Value *value = makeNull();
+    value->type = INT_TYPE;
+    value->i = fd;
+    return value;
+}
+
+static void ioError(Interpreter *interp, char *what) {
+    char *message = talloc(strlen(what) + strlen(strerror(errno)) + 3);
+    sprintf(message, "%s: %s", what, strerror(errno));
+    evaluationError(interp, message);
+}
+
+/*
+* Records a descriptor the loop created, which it will close when it is
+* destroyed.
+*/
+static Value *ownedFd(EventLoop *loop, int fd) {
+    getWatch(loop, fd)->owned = true;
+    return fdValue(fd);
+}
+
+/*
+* Fills in the address of the socket at 'path'. Returns false if the path
+* is too long.
+*/
+static bool unixAddress(char *path, struct sockaddr_un *address) {
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        return false;
+    }
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+Value *primitiveMakePipe(Interpreter *interp, Value *args) {
+    if (args->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for make-pipe");
+    }
+    EventLoop *loop = getLoop(interp);
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        ioError(interp, "make-pipe failed");
+    }
+    return cons(ownedFd(loop, fds[0]),
+                cons(ownedFd(loop, fds[1]), makeNull()));
+}
+
+Value *primitiveUnixListen(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for unix-listen");
+    }
+    if (car(args)->type != STR_TYPE) {
+        evaluationError(interp,
+                        "Wrong argument type provided for unix-listen");
+    }
+    EventLoop *loop = getLoop(interp);
+    struct sockaddr_un address;
+    if (!unixAddress(car(args)->s, &address)) {
+        evaluationError(interp, "unix-listen failed: path too long");
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        ioError(interp, "unix-listen failed");
+    }
+    unlink(address.sun_path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(fd, 64) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        ioError(interp, "unix-listen failed");
+    }
+    return ownedFd(loop, fd);
+}
+
+Value *primitiveUnixAccept(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for unix-accept");
+    }
+    int listener = fdArgument(interp, car(args),
+                              "Wrong argument type provided for unix-accept");
+    EventLoop *loop = getLoop(interp);
+    int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            Value *none = makeNull();
+            none->type = BOOL_TYPE;
+            none->b = false;
+            return none;
+        }
+        ioError(interp, "unix-accept failed");
+    }
+    return ownedFd(loop, fd);
+}
+
+Value *primitiveUnixConnect(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for unix-connect");
+    }
+    if (car(args)->type != STR_TYPE) {
+        evaluationError(interp,
+                        "Wrong argument type provided for unix-connect");
+    }
+    EventLoop *loop = getLoop(interp);
+    struct sockaddr_un address;
+    if (!unixAddress(car(args)->s, &address)) {
+        evaluationError(interp, "unix-connect failed: path too long");
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        ioError(interp, "unix-connect failed");
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        ioError(interp, "unix-connect failed");
+    }
+    return ownedFd(loop, fd);
+}
+
+Value *primitiveOnReadable(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for on-readable");
+    }
+    int fd = fdArgument(interp, car(args),
+                        "Wrong argument type provided for on-readable");
+    Value *callback = car(cdr(args));
+    bool stop = callback->type == BOOL_TYPE && !callback->b;
+    if (!stop && callback->type != CLOSURE_TYPE &&
+        callback->type != PRIMITIVE_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for on-readable");
+    }
+    EventLoop *loop = getLoop(interp);
+    Watch *watch = getWatch(loop, fd);
+    if (watch->closing) {
+        evaluationError(interp, "on-readable: the descriptor is being closed");
+    }
+    int listening = 0;
+    socklen_t size = sizeof(listening);
+    watch->listening = !getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening,
+                                   &size) && listening;
+    watch->onReadable = stop ? NULL : callback;
+    if (!updateInterest(loop, watch)) {
+        watch->onReadable = NULL;
+        ioError(interp, "on-readable cannot watch the descriptor");
+    }
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+Value *primitiveFdWrite(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for fd-write");
+    }
+    int fd = fdArgument(interp, car(args),
+                        "Wrong argument type provided for fd-write");
+    if (car(cdr(args))->type != STR_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for fd-write");
+    }
+    char *data = car(cdr(args))->s;
+    size_t length = strlen(data);
+    EventLoop *loop = getLoop(interp);
+    Watch *watch = getWatch(loop, fd);
+    if (watch->closing) {
+        evaluationError(interp, "fd-write: the descriptor is being closed");
+    }
+    if (!watch->length) {
+        ssize_t n = writeSome(fd, data, length);
+        if (n < 0) {
+            ioError(interp, "fd-write failed");
+        }
+        data += n;
+        length -= n;
+    }
+    if (length) {
+        queueOutput(watch, data, length);
+        if (!updateInterest(loop, watch)) {
+            watch->length = 0;
+            ioError(interp, "fd-write cannot watch the descriptor");
+        }
+    }
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+Value *primitiveFdClose(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for fd-close");
+    }
+    int fd = fdArgument(interp, car(args),
+                        "Wrong argument type provided for fd-close");
+    EventLoop *loop = getLoop(interp);
+    Watch *watch = getWatch(loop, fd);
+    watch->onReadable = NULL;
+    if (watch->length) {
+        watch->closing = true;
+        updateInterest(loop, watch);
+    } else {
+        removeWatch(loop, watch);
+    }
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+Value *primitiveSetTimer(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for set-timer");
+    }
+    Value *seconds = car(args);
+    Value *callback = car(cdr(args));
+    if ((seconds->type != INT_TYPE && seconds->type != DOUBLE_TYPE) ||
+        (callback->type != CLOSURE_TYPE && callback->type != PRIMITIVE_TYPE)) {
+        evaluationError(interp, "Wrong argument type provided for set-timer");
+    }
+    EventLoop *loop = getLoop(interp);
+    Timer *timer = malloc(sizeof(Timer));
+    assert(timer);
+    timer->due = now() + (seconds->type == INT_TYPE ? seconds->i
+                                                    : seconds->d);
+    timer->callback = callback;
+    timer->id = loop->nextTimer++;
+    // after any timer due at the same time, so that those fire in order
+    Timer **link = &loop->timers;
+    while (*link && (*link)->due <= timer->due) {
+        link = &(*link)->next;
+    }
+    timer->next = *link;
+    *link = timer;
+    return fdValue(timer->id);
+}
+
+Value *primitiveCancelTimer(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for cancel-timer");
+    }
+    if (car(args)->type != INT_TYPE) {
+        evaluationError(interp,
+                        "Wrong argument type provided for cancel-timer");
+    }
+    EventLoop *loop = getLoop(interp);
+    Timer **link = &loop->timers;
+    while (*link && (*link)->id != car(args)->i) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        Timer *timer = *link;
+        *link = timer->next;
+        free(timer);
+    }
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+Value *primitiveRunLoop(Interpreter *interp, Value *args) {
+    if (args->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for run-loop");
+    }
+    EventLoop *loop = getLoop(interp);
+    struct epoll_event events[MAX_EVENTS];
+    while (true) {
+        fireTimers(interp, loop);
+        if (!loop->registered && !loop->timers) {
+            break;
+        }
+        int timeout = -1;
+        if (loop->timers) {
+            double delay = loop->timers->due - now();
+            timeout = delay > 0 ? (int)ceil(delay * 1000) : 0;
+        }
+        int n = epoll_wait(loop->epoll, events, MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ioError(interp, "run-loop failed");
+        }
+        for (int i = 0; i < n; i++) {
+            // an earlier callback may have closed or re-registered it
+            int fd = events[i].data.fd;
+            Watch *watch = findWatch(loop, fd);
+            if (watch && watch->length &&
+                (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                flushOutput(loop, watch);
+                watch = findWatch(loop, fd);
+            }
+            if (watch && watch->onReadable &&
+                (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+                readReady(interp, loop, watch);
+            }
+        }
+    }
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
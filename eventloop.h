@@ -0,0 +1,93 @@
+#include "value.h"
+#include "context.h"
+
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+/*
+* An epoll event loop per instance, so that one interpreter can serve many
+* pipes and sockets without a thread each. Procedures are registered on
+* file descriptors and timers, and (run-loop) waits for events and calls
+* them until nothing is left to wait for.
+*
+* Descriptors the loop creates (pipes and sockets) are non-blocking. Other
+* descriptors keep their flags: they are read only once per readiness
+* event, which never blocks, and written to in blocking mode. Reads land in
+* one buffer reused by every descriptor; output that a descriptor cannot
+* take yet is kept in a per-descriptor buffer, reused as it drains, and
+* written when epoll reports the descriptor writable.
+*
+* Data is passed as strings, so it should not contain NUL bytes.
+*/
+
+/*
+* The loop's descriptors, timers and buffers.
+*/
+typedef struct EventLoop EventLoop;
+
+/*
+* Frees the loop, closing the descriptors it created.
+*/
+void destroyEventLoop(EventLoop *loop);
+
+/*
+* (make-pipe) returns a list (read-fd write-fd) of a new non-blocking pipe.
+*/
+Value *primitiveMakePipe(Interpreter *interp, Value *args);
+
+/*
+* (unix-listen path) returns a non-blocking socket listening at path,
+* replacing any stale socket file.
+*/
+Value *primitiveUnixListen(Interpreter *interp, Value *args);
+
+/*
+* (unix-accept fd) returns the next connection waiting on a listening
+* socket, or #f if there is none yet.
+*/
+Value *primitiveUnixAccept(Interpreter *interp, Value *args);
+
+/*
+* (unix-connect path) returns a non-blocking socket connected to path.
+*/
+Value *primitiveUnixConnect(Interpreter *interp, Value *args);
+
+/*
+* (on-readable fd proc) calls (proc data) with each string read from fd, and
+* (proc #f) once at end of file, after which fd is no longer watched. For a
+* listening socket, proc is called with #t when a connection is waiting.
+* (on-readable fd #f) stops watching fd.
+*/
+Value *primitiveOnReadable(Interpreter *interp, Value *args);
+
+/*
+* (fd-write fd string) writes as much as fd takes now and queues the rest,
+* which run-loop writes as fd becomes writable.
+*/
+Value *primitiveFdWrite(Interpreter *interp, Value *args);
+
+/*
+* (fd-close fd) stops watching fd and closes it once its queued output has
+* been written.
+*/
+Value *primitiveFdClose(Interpreter *interp, Value *args);
+
+/*
+* (set-timer seconds thunk) calls (thunk) from run-loop once the delay has
+* passed. Returns a timer id for cancel-timer.
+*/
+Value *primitiveSetTimer(Interpreter *interp, Value *args);
+
+/*
+* (cancel-timer id) drops a timer that has not fired yet.
+*/
+Value *primitiveCancelTimer(Interpreter *interp, Value *args);
+
+/*
+* (run-loop) dispatches events until no descriptor is watched, no output is
+* queued and no timer is set. An error in a callback leaves the loop and is
+* raised by run-loop; the loop keeps its state and can be run again.
+*/
+Value *primitiveRunLoop(Interpreter *interp, Value *args);
+
+#endif
@@ -0,0 +1,486 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "text.h"
+#include "fasl.h"
+
+#define MAGIC "\0fasl"
+#define MAGIC_LENGTH 5
+#define VERSION 1
+#define INITIAL_CAPACITY 256 // must be a power of two
+
+typedef enum {
+    TAG_NULL,
+    TAG_FALSE,
+    TAG_TRUE,
+    TAG_INT,
+    TAG_DOUBLE,
+    TAG_STRING,
+    TAG_SYMBOL,
+    TAG_SYMBOL_REFERENCE,
+    TAG_PAIR,
+    TAG_REFERENCE,
+    TAG_DOT
+} Tag;
+
+/*
+* An open-addressed table numbering what has been written: pairs and
+* strings by address, or symbols by name.
+*/
+typedef struct {
+    const void **keys;
+    int *indices;
+    int capacity; // a power of two
+    int count;
+    bool byName;
+} Table;
+
+typedef struct {
+    Interpreter *interp;
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    Table shared;
+    Table symbols;
+} Writer;
+
+/*
+* Values in the order they were read, for references back to them.
+*/
+typedef struct {
+    Value **values;
+    int count;
+    int capacity;
+} Numbered;
+
+typedef struct {
+    Interpreter *interp;
+    unsigned char *next;
+    unsigned char *end;
+    Numbered shared;
+    Numbered symbols;
+} Reader;
+
+static unsigned long hashKey(Table *table, const void *key) {
+    if (!table->byName) {
+        return ((uintptr_t)key >> 4) * 0x9e3779b97f4a7c15UL;
+    }
+    // FNV-1a
+    unsigned long hash = 14695981039346656037UL;
+    for (const char *s = key; *s; s++) {
+        hash = (hash ^ (unsigned char)*s) * 1099511628211UL;
+    }
+    return hash;
+}
+
+static bool sameKey(Table *table, const void *a, const void *b) {
+    return table->byName ? !strcmp(a, b) : a == b;
+}
+
+/*
+* Returns the slot holding 'key', or the empty slot where it would go.
+*/
+static int findSlot(Table *table, const void *key) {
+    int mask = table->capacity - 1;
+    int slot = hashKey(table, key) & mask;
+    while (table->keys[slot] && !sameKey(table, table->keys[slot], key)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void initTable(Table *table, bool byName) {
+    table->capacity = INITIAL_CAPACITY;
+    table->count = 0;
+    table->byName = byName;
+    table->keys = calloc(table->capacity, sizeof(const void *));
+    table->indices = malloc(table->capacity * sizeof(int));
+    assert(table->keys && table->indices);
+}
+
+static void freeTable(Table *table) {
+    free(table->keys);
+    free(table->indices);
+}
+
+/*
+* Returns the number 'key' was given, or -1 after giving it the next one.
+*/
+static int number(Table *table, const void *key) {
+    int slot = findSlot(table, key);
+    if (table->keys[slot]) {
+        return table->indices[slot];
+    }
+    table->keys[slot] = key;
+    table->indices[slot] = table->count++;
+    if (2 * table->count > table->capacity) {
+        // keep it at most half full
+        Table old = *table;
+        table->capacity *= 2;
+        table->keys = calloc(table->capacity, sizeof(const void *));
+        table->indices = malloc(table->capacity * sizeof(int));
+        assert(table->keys && table->indices);
+        for (int i = 0; i < old.capacity; i++) {
+            if (old.keys[i]) {
+                int moved = findSlot(table, old.keys[i]);
+                table->keys[moved] = old.keys[i];
+                table->indices[moved] = old.indices[i];
+            }
+        }
+        freeTable(&old);
+    }
+    return -1;
+}
+
+static void writeBytes(Writer *writer, const void *bytes, size_t length) {
+    if (writer->length + length > writer->capacity) {
+        while (writer->length + length > writer->capacity) {
+            writer->capacity *= 2;
+        }
+        writer->data = realloc(writer->data, writer->capacity);
+        assert(writer->data);
+    }
+    memcpy(writer->data + writer->length, bytes, length);
+    writer->length += length;
+}
+
+static void writeByte(Writer *writer, unsigned char byte) {
+    writeBytes(writer, &byte, 1);
+}
+
+static void writeVarint(Writer *writer, unsigned long n) {
+    unsigned char bytes[10];
+    int length = 0;
+    do {
+        bytes[length] = n & 0x7f;
+        n >>= 7;
+        bytes[length++] |= n ? 0x80 : 0;
+    } while (n);
+    writeBytes(writer, bytes, length);
+}
+
+/*
+* Writes the characters of a string or symbol, preceded by their count.
+*/
+static void writeChars(Writer *writer, char *chars, int length) {
+    writeVarint(writer, length);
+    writeBytes(writer, chars, length);
+}
+
+/*
+* Writes 'value' unless it is a pair or string already written, in which
+* case writes a reference to it. Returns true if it was a pair written in
+* full, whose cdr the caller must write next.
+*/
+static bool writeHead(Writer *writer, Value *value) {
+    if (value->type == CONS_TYPE || value->type == STR_TYPE) {
+        int index = number(&writer->shared, value);
+        if (index >= 0) {
+            writeByte(writer, TAG_REFERENCE);
+            writeVarint(writer, index);
+            return false;
+        }
+    }
+    switch (value->type) {
+        case NULL_TYPE:
+            writeByte(writer, TAG_NULL);
+            return false;
+        case BOOL_TYPE:
+            writeByte(writer, value->b ? TAG_TRUE : TAG_FALSE);
+            return false;
+        case DOT_TYPE:
+            writeByte(writer, TAG_DOT);
+            return false;
+        case INT_TYPE: {
+            writeByte(writer, TAG_INT);
+            long i = value->i;
+            // zigzag, so small negative numbers are short too
+            writeVarint(writer, ((unsigned long)i << 1) ^ (unsigned long)(i >> 63));
+            return false;
+        }
+        case DOUBLE_TYPE:
+            writeByte(writer, TAG_DOUBLE);
+            writeBytes(writer, &value->d, sizeof(value->d));
+            return false;
+        case STR_TYPE:
+            writeByte(writer, TAG_STRING);
+            writeChars(writer, value->s, stringLength(value));
+            return false;
+        case SYMBOL_TYPE: {
+            int index = number(&writer->symbols, value->s);
+            if (index >= 0) {
+                writeByte(writer, TAG_SYMBOL_REFERENCE);
+                writeVarint(writer, index);
+            } else {
+                writeByte(writer, TAG_SYMBOL);
+                writeChars(writer, value->s, strlen(value->s));
+            }
+            return false;
+        }
+        case CONS_TYPE:
+            writeByte(writer, TAG_PAIR);
+            return true;
+        default:
+            evaluationError(writer->interp, "Value cannot be written by fasl-write");
+            return false;
+    }
+}
+
+static void writeDatum(Writer *writer, Value *value) {
+    // a list's elements are written recursively, its spine in a loop
+    while (writeHead(writer, value)) {
+        writeDatum(writer, car(value));
+        value = cdr(value);
+    }
+}
+
+Value *primitiveFaslWrite(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for fasl-write");
+    }
+    if (car(cdr(args))->type != STR_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for fasl-write");
+    }
+    Writer writer;
+    writer.interp = interp;
+    writer.length = 0;
+    writer.capacity = INITIAL_CAPACITY;
+    writer.data = malloc(writer.capacity);
+    assert(writer.data);
+    initTable(&writer.shared, false);
+    initTable(&writer.symbols, true);
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (setjmp(onError)) {
+        restore(interp, &saved);
+        free(writer.data);
+        freeTable(&writer.shared);
+        freeTable(&writer.symbols);
+        raiseObject(interp, interp->raised, interp->error);
+    }
+    writeBytes(&writer, MAGIC, MAGIC_LENGTH);
+    writeByte(&writer, VERSION);
+    writeDatum(&writer, car(args));
+    restore(interp, &saved);
+    FILE *file = fopen(car(cdr(args))->s, "wb");
+    bool written = file && fwrite(writer.data, 1, writer.length, file) == writer.length;
+    written = file && !fclose(file) && written;
+    free(writer.data);
+    freeTable(&writer.shared);
+    freeTable(&writer.symbols);
+    if (!written) {
+        evaluationError(interp, "The file could not be written");
+    }
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+static void malformed(Reader *reader) {
+    evaluationError(reader->interp, "The file is not valid fasl data");
+}
+
+static void remember(Numbered *numbered, Value *value) {
+    if (numbered->count == numbered->capacity) {
+        numbered->capacity = numbered->capacity ? 2 * numbered->capacity
+                                                : INITIAL_CAPACITY;
+        numbered->values = realloc(numbered->values,
+                                   numbered->capacity * sizeof(Value *));
+        assert(numbered->values);
+    }
+    numbered->values[numbered->count++] = value;
+}
+
+static unsigned char readByte(Reader *reader) {
+    if (reader->next == reader->end) {
+        malformed(reader);
+    }
+    return *reader->next++;
+}
+
+static unsigned long readVarint(Reader *reader) {
+    unsigned long n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned char byte = readByte(reader);
+        n |= (unsigned long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return n;
+        }
+    }
+    malformed(reader);
+    return 0;
+}
+
+/*
+* Returns a reference to a value numbered in 'numbered'.
+*/
+static Value *readReference(Reader *reader, Numbered *numbered) {
+    unsigned long index = readVarint(reader);
+    if (index >= (unsigned long)numbered->count) {
+        malformed(reader);
+    }
+    return numbered->values[index];
+}
+
+/*
+* Returns the counted characters at the reader's position, copied to the
+* heap and NUL-terminated.
+*/
+static Value *readChars(Reader *reader, valueType type) {
+    unsigned long length = readVarint(reader);
+    if (length > (unsigned long)(reader->end - reader->next) || length > INT32_MAX) {
+        malformed(reader);
+    }
+    Value *value = makeString((char *)reader->next, length);
+    value->type = type;
+    reader->next += length;
+    return value;
+}
+
+static Value *readDatum(Reader *reader);
+
+/*
+* Reads a datum, except that for a pair it reads only the car, returning
+* the new pair for the caller to fill in the cdr of.
+*/
+static Value *readHead(Reader *reader, bool *isPair) {
+    Value *value;
+    *isPair = false;
+    switch (readByte(reader)) {
+        case TAG_NULL:
+            return makeNull();
+        case TAG_FALSE:
+        case TAG_TRUE:
+            value = makeNull();
+            value->type = BOOL_TYPE;
+            value->b = reader->next[-1] == TAG_TRUE;
+            return value;
+        case TAG_DOT:
+            value = makeNull();
+            value->type = DOT_TYPE;
+            return value;
+        case TAG_INT: {
+            unsigned long zigzag = readVarint(reader);
+            value = makeNull();
+            value->type = INT_TYPE;
+            value->i = (long)(zigzag >> 1) ^ -(long)(zigzag & 1);
+            return value;
+        }
+        case TAG_DOUBLE:
+            if (reader->end - reader->next < (long)sizeof(double)) {
+                malformed(reader);
+            }
+            value = makeNull();
+            value->type = DOUBLE_TYPE;
+            memcpy(&value->d, reader->next, sizeof(double));
+            reader->next += sizeof(double);
+            return value;
+        case TAG_STRING:
+            value = readChars(reader, STR_TYPE);
+            remember(&reader->shared, value);
+            return value;
+        case TAG_SYMBOL:
+            // every use of the symbol shares one value, as the cell a
+            // symbol caches is its global binding's, the same for all
+            value = readChars(reader, SYMBOL_TYPE);
+            value->cell = NULL;
+            remember(&reader->symbols, value);
+            return value;
+        case TAG_SYMBOL_REFERENCE:
+            return readReference(reader, &reader->symbols);
+        case TAG_REFERENCE:
+            return readReference(reader, &reader->shared);
+        case TAG_PAIR:
+            value = cons(NULL, NULL);
+            // numbered before its contents, as the writer numbered it
+            remember(&reader->shared, value);
+            value->c.car = readDatum(reader);
+            *isPair = true;
+            return value;
+        default:
+            malformed(reader);
+            return NULL;
+    }
+}
+
+static Value *readDatum(Reader *reader) {
+    bool isPair;
+    Value *first = readHead(reader, &isPair);
+    Value *last = first;
+    // a list's elements are read recursively, its spine in a loop
+    while (isPair) {
+        Value *next = readHead(reader, &isPair);
+        last->c.cdr = next;
+        last = next;
+    }
+    return first;
+}
+
+Value *primitiveFaslRead(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for fasl-read");
+    }
+    if (car(args)->type != STR_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for fasl-read");
+    }
+    int fd = open(car(args)->s, O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        evaluationError(interp, "The file could not be opened");
+    }
+    size_t size = status.st_size;
+    void *map = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (map == MAP_FAILED) {
+        evaluationError(interp, "The file could not be opened");
+    }
+    Reader reader;
+    reader.interp = interp;
+    reader.next = map;
+    reader.end = reader.next + size;
+    reader.shared = (Numbered){NULL, 0, 0};
+    reader.symbols = (Numbered){NULL, 0, 0};
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (setjmp(onError)) {
+        restore(interp, &saved);
+        if (map) {
+            munmap(map, size);
+        }
+        free(reader.shared.values);
+        free(reader.symbols.values);
+        raiseObject(interp, interp->raised, interp->error);
+    }
+    if (size < MAGIC_LENGTH + 1 || memcmp(map, MAGIC, MAGIC_LENGTH) ||
+        reader.next[MAGIC_LENGTH] != VERSION) {
+        malformed(&reader);
+    }
+    reader.next += MAGIC_LENGTH + 1;
+    Value *datum = readDatum(&reader);
+    if (reader.next != reader.end) {
+        malformed(&reader);
+    }
+    restore(interp, &saved);
+    munmap(map, size);
+    free(reader.shared.values);
+    free(reader.symbols.values);
+    return datum;
+}
@@ -0,0 +1,47 @@
+#include "value.h"
+#include "context.h"
+
+#ifndef FASL_H
+#define FASL_H
+
+/*
+* Fast-load (fasl) files: a compact binary form of Scheme data, for passing
+* large structures between jobs without printing them and tokenizing and
+* parsing the text again. Reading one maps the file into memory and builds
+* the value in a single pass over it, copying only the characters of
+* strings and symbols; doubles are stored as their 8 bytes, so they come
+* back exactly.
+*
+* A file is the magic bytes "\0fasl", a version byte, and one datum, each
+* datum a tag byte followed by its contents:
+*
+*   ()  #f  #t             the tag alone
+*   the dot of a quoted    the tag alone
+*   dotted list
+*   integer                zigzag-encoded LEB128 varint
+*   double                 8 bytes in the writer's byte order
+*   string                 varint length, then the characters
+*   symbol, first use      varint length, then the characters
+*   symbol, later uses     varint index among the symbols so far
+*   pair                   its car, then its cdr
+*   reference              varint index among the pairs and strings so far
+*
+* Pairs and strings are numbered in the order they are written, and one
+* already written is written again as a reference, so structure shared in
+* the value is shared in what is read back. Lists are written and read
+* along their cdrs without recursion, so they can be of any length.
+*/
+
+/*
+* (fasl-write obj path) writes obj to the file at path. obj may contain
+* numbers, booleans, strings, symbols and lists; anything else is an
+* error.
+*/
+Value *primitiveFaslWrite(Interpreter *interp, Value *args);
+
+/*
+* (fasl-read path) returns the datum in the fasl file at path.
+*/
+Value *primitiveFaslRead(Interpreter *interp, Value *args);
+
+#endif
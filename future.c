@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <assert.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "pool.h"
+#include "future.h"
+
+typedef enum {
+    FUTURE_QUEUED,
+    FUTURE_RUNNING,
+    FUTURE_DONE
+} futureState;
+
+/*
+* Futures are malloc'ed and owned by their set rather than a heap, since
+* their task can still be queued after the heap holding the future's Value
+* is gone.
+*/
+struct Future {
+    Value *thunk;
+    Interpreter *worker;
+    int state;   // a futureState, changed atomically
+    int merged;  // set by the touch that merges the worker's heap
+    Value *result;
+    bool failed;
+    struct Future *next; // in the set
+    // Futures created while evaluating this one, linked by 'sibling'.
+    // Guarded by the set's lock.
+    struct Future *children;
+    struct Future *sibling;
+};
+typedef struct Future Future;
+
+struct FutureSet {
+    pthread_mutex_t lock;
+    Future *futures;
+    int queued; // tasks spawned and not yet run
+};
+
+// The future the calling thread is evaluating, innermost, or NULL.
+static __thread Future *running;
+
+static long spawned;
+static long ranInline;
+static long helped;
+static long slept;
+
+FutureSet *makeFutureSet() {
+    FutureSet *set = malloc(sizeof(FutureSet));
+    assert(set);
+    pthread_mutex_init(&set->lock, NULL);
+    set->futures = NULL;
+    set->queued = 0;
+    return set;
+}
+
+void destroyFutureSet(FutureSet *set) {
+    while (true) {
+        unsigned long seen = poolEpoch();
+        if (__atomic_load_n(&set->queued, __ATOMIC_ACQUIRE) == 0) {
+            break;
+        }
+        // as in poolRun, nothing but this set's futures is run here: any
+        // other task could touch a future suspended lower on the stack
+        if (!poolHelpGroup(set)) {
+            poolSleep(seen);
+        }
+    }
+    Future *future = set->futures;
+    while (future) {
+        Future *next = future->next;
+        if (!future->merged) {
+            tdestroy(future->worker->heap);
+        }
+        releaseWorker(future->worker);
+        free(future);
+        future = next;
+    }
+    pthread_mutex_destroy(&set->lock);
+    free(set);
+}
+
+/*
+* Evaluates the thunk on the future's heap and marks the future done.
+*/
+static void evaluate(Future *future) {
+    Future *outer = running;
+    running = future;
+    Interpreter *interp = future->worker;
+    Heap *previous = tswitch(interp->heap);
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (setjmp(onError)) {
+        restore(interp, &saved);
+        future->failed = true;
+    } else {
+        future->result = apply(interp, future->thunk, makeNull());
+        restore(interp, &saved);
+    }
+    tswitch(previous);
+    running = outer;
+    __atomic_store_n(&future->state, FUTURE_DONE, __ATOMIC_RELEASE);
+    poolNotify();
+}
+
+/*
+* Pool task for a future: runs it unless a touch already has.
+*/
+static void runFuture(void *arg) {
+    Future *future = arg;
+    int expected = FUTURE_QUEUED;
+    if (__atomic_compare_exchange_n(&future->state, &expected,
+                                    FUTURE_RUNNING, false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE)) {
+        evaluate(future);
+    }
+    FutureSet *set = future->worker->futures;
+    if (__atomic_sub_fetch(&set->queued, 1, __ATOMIC_ACQ_REL) == 0) {
+        poolNotify();
+    }
+}
+
+Value *primitiveFuture(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for future");
+    }
+    Value *thunk = car(args);
+    if (thunk->type != CLOSURE_TYPE && thunk->type != PRIMITIVE_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for future");
+    }
+    Future *future = malloc(sizeof(Future));
+    assert(future);
+    future->thunk = thunk;
+    future->worker = makeWorker(interp);
+    future->state = FUTURE_QUEUED;
+    future->merged = 0;
+    future->result = NULL;
+    future->failed = false;
+    future->children = NULL;
+    future->sibling = NULL;
+    FutureSet *set = interp->futures;
+    pthread_mutex_lock(&set->lock);
+    future->next = set->futures;
+    set->futures = future;
+    if (running) {
+        future->sibling = running->children;
+        running->children = future;
+    }
+    pthread_mutex_unlock(&set->lock);
+    __atomic_add_fetch(&set->queued, 1, __ATOMIC_ACQ_REL);
+    __atomic_add_fetch(&spawned, 1, __ATOMIC_RELAXED);
+    poolSpawn(runFuture, future, set);
+
+    Value *value = makeNull();
+    value->type = FUTURE_TYPE;
+    value->fu = future;
+    return value;
+}
+
+/*
+* Returns a future created, directly or not, by 'future' that is still
+* queued, or NULL if there is none. The set's lock must be held.
+*/
+static Future *queuedDescendant(Future *future) {
+    for (Future *child = future->children; child; child = child->sibling) {
+        if (__atomic_load_n(&child->state, __ATOMIC_ACQUIRE) == FUTURE_QUEUED) {
+            return child;
+        }
+        Future *found = queuedDescendant(child);
+        if (found) {
+            return found;
+        }
+    }
+    return NULL;
+}
+
+/*
+* Runs a queued future created by 'future', which another thread is
+* evaluating, so as to help it finish. Returns false if there was none.
+* Nothing else is run: a task that touches a future suspended lower on the
+* calling thread's stack could never finish.
+*/
+static bool helpFuture(Future *future) {
+    FutureSet *set = future->worker->futures;
+    while (true) {
+        pthread_mutex_lock(&set->lock);
+        Future *task = queuedDescendant(future);
+        pthread_mutex_unlock(&set->lock);
+        if (!task) {
+            return false;
+        }
+        int expected = FUTURE_QUEUED;
+        if (__atomic_compare_exchange_n(&task->state, &expected,
+                                        FUTURE_RUNNING, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            evaluate(task);
+            return true;
+        }
+    }
+}
+
+Value *primitiveTouch(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for touch");
+    }
+    if (car(args)->type != FUTURE_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for touch");
+    }
+    Future *future = car(args)->fu;
+    int expected = FUTURE_QUEUED;
+    if (__atomic_compare_exchange_n(&future->state, &expected,
+                                    FUTURE_RUNNING, false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE)) {
+        __atomic_add_fetch(&ranInline, 1, __ATOMIC_RELAXED);
+        evaluate(future);
+    }
+    while (true) {
+        unsigned long seen = poolEpoch();
+        if (__atomic_load_n(&future->state, __ATOMIC_ACQUIRE) == FUTURE_DONE) {
+            break;
+        }
+        if (helpFuture(future)) {
+            __atomic_add_fetch(&helped, 1, __ATOMIC_RELAXED);
+        } else {
+            __atomic_add_fetch(&slept, 1, __ATOMIC_RELAXED);
+            poolSleep(seen);
+        }
+    }
+    int unmerged = 0;
+    if (__atomic_compare_exchange_n(&future->merged, &unmerged, 1, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        tmerge(interp->heap, future->worker->heap);
+    }
+    if (future->failed) {
+        raiseObject(interp, future->worker->raised, future->worker->error);
+    }
+    return future->result;
+}
+
+Value *primitiveFutureStats(Interpreter *interp, Value *args) {
+    if (args->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for future-stats");
+    }
+    Value *stats = makeNull();
+    stats = cons(makeCounter("slept",
+                             __atomic_load_n(&slept, __ATOMIC_RELAXED)),
+                 stats);
+    stats = cons(makeCounter("helped",
+                             __atomic_load_n(&helped, __ATOMIC_RELAXED)),
+                 stats);
+    stats = cons(makeCounter("stolen", poolSteals()), stats);
+    stats = cons(makeCounter("inline",
+                             __atomic_load_n(&ranInline, __ATOMIC_RELAXED)),
+                 stats);
+    stats = cons(makeCounter("spawned",
+                             __atomic_load_n(&spawned, __ATOMIC_RELAXED)),
+                 stats);
+    return stats;
+}
+
+size_t futureReferences(Value *future, HeapVisitor visit, void *data) {
+    Future *f = future->fu;
+    visit(data, f->thunk, false);
+    if (__atomic_load_n(&f->state, __ATOMIC_ACQUIRE) == FUTURE_DONE) {
+        visit(data, f->result, false);
+    }
+    return sizeof(Future);
+}
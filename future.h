@@ -0,0 +1,62 @@
+#include "value.h"
+#include "context.h"
+#include "heapdump.h"
+
+#ifndef FUTURE_H
+#define FUTURE_H
+
+/*
+* Futures: (future thunk) queues (thunk) on the calling thread's
+* work-stealing deque in the thread pool and returns at once; (touch f)
+* returns its value. The thunk runs under a worker instance (see makeWorker)
+* with its own heap, so it must not define or set! anything outside itself.
+*
+* A touch on a future nobody has started runs it right away on the touching
+* thread. On one that another thread is running, touch runs the queued
+* futures that one created, and theirs, until it finishes (leapfrogging).
+* When none of those is queued, touch blocks, sleeping until a future
+* finishes, rather than running other queued work: another future could
+* touch one suspended lower on the touching thread's stack, and neither
+* could ever finish. The first touch after a future finishes merges its
+* heap into the toucher's, and an error raised by the thunk is raised
+* again by every touch.
+*/
+
+/*
+* Every future an instance (with its workers) has created.
+*/
+typedef struct FutureSet FutureSet;
+
+FutureSet *makeFutureSet();
+
+/*
+* Waits until no future of the set is queued or running, then frees the
+* futures along with the heaps of those never touched.
+*/
+void destroyFutureSet(FutureSet *set);
+
+/*
+* (future thunk)
+*/
+Value *primitiveFuture(Interpreter *interp, Value *args);
+
+/*
+* (touch f) returns the value of the future f.
+*/
+Value *primitiveTouch(Interpreter *interp, Value *args);
+
+/*
+* (future-stats) returns process-wide scheduler counters as an association
+* list: futures spawned, futures run by the touching thread because no
+* worker had started them, tasks stolen between threads, futures run by a
+* touch while waiting, and times a touch had to sleep.
+*/
+Value *primitiveFutureStats(Interpreter *interp, Value *args);
+
+/*
+* Visits the thunk of the future 'future', and its result once there is
+* one, for heap-dump (see heapdump.h). Returns the size of the future.
+*/
+size_t futureReferences(Value *future, HeapVisitor visit, void *data);
+
+#endif
@@ -0,0 +1,537 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <assert.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "trace.h"
+#include "profiler.h"
+#include "green.h"
+
+#define TASK_STACK_SIZE (8 * 1024 * 1024) // as deep as the usual main stack;
+                                         // pages are only used once touched
+#define SPARE_STACKS 64 // stacks of finished tasks kept for reuse
+
+typedef enum {
+    TASK_READY,    // running, or in the run queue
+    TASK_WAITING,  // on a channel's or a task's wait list
+    TASK_SLEEPING,
+    TASK_DONE
+} taskState;
+
+struct Task {
+    ucontext_t context;
+    void *stack;            // NULL for the top-level program
+    Value *thunk;
+    Value *result;
+    bool failed;
+    char *error;
+    Value *raised;
+    taskState state;
+    bool deadlocked;        // woken because no task could make progress
+    double wakeAt;          // while sleeping
+    struct Task *next;      // in the run queue, the sleep list or a wait list
+    struct Task **waitList; // the wait list it is on, while waiting
+    struct Task *joiners;   // tasks waiting in join for this one
+    struct Task *allNext;   // in the scheduler's list of every task
+
+    // the instance's and the thread's per-task state, while switched out
+    jmp_buf *onError;
+    FILE *in;
+    struct Port *input;
+    struct Escape *escapes;
+    struct Frame **liveFrames;
+    int liveDepth;
+    int liveCapacity;
+    struct Value **arguments;
+    int argumentDepth;
+    TraceState trace;
+    char *profileProcedure;
+};
+typedef struct Task Task;
+
+struct Scheduler {
+    Interpreter *interp;
+    Task *top;        // the top-level program
+    Task *current;
+    Task *readyHead;  // run queue, oldest first
+    Task *readyTail;
+    Task *sleeping;
+    Task *all;
+    Task *finished;   // finished task whose stack can go once we are off it
+    void *spareStacks[SPARE_STACKS];
+    int spareCount;
+};
+
+struct Channel {
+    int capacity;
+    int count;
+    int start;
+    Value **values; // circular, 'count' values from 'start'
+    Task *senders;  // waiting while full
+    Task *receivers;  // waiting while empty
+};
+typedef struct Channel Channel;
+
+// The scheduler whose task is being started on this thread (see taskMain).
+static __thread Scheduler *starting;
+
+/*
+* Returns the current time in seconds.
+*/
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static Scheduler *getScheduler(Interpreter *interp) {
+    if (!interp->scheduler) {
+        Scheduler *scheduler = calloc(1, sizeof(Scheduler));
+        Task *top = calloc(1, sizeof(Task));
+        assert(scheduler && top);
+        top->state = TASK_READY;
+        scheduler->interp = interp;
+        scheduler->top = top;
+        scheduler->current = top;
+        scheduler->all = top;
+        interp->scheduler = scheduler;
+    }
+    return interp->scheduler;
+}
+
+void destroyScheduler(Scheduler *scheduler) {
+    Task *task = scheduler->all;
+    while (task) {
+        Task *next = task->allNext;
+        if (task->stack) {
+            munmap(task->stack, TASK_STACK_SIZE);
+        }
+        if (task != scheduler->current) {
+            free(task->liveFrames);
+            free(task->arguments);
+        }
+        free(task);
+        task = next;
+    }
+    for (int i = 0; i < scheduler->spareCount; i++) {
+        munmap(scheduler->spareStacks[i], TASK_STACK_SIZE);
+    }
+    free(scheduler);
+}
+
+/*
+* Maps a stack with a guard page at its low end, or reuses a spare one.
+*/
+static void *allocateStack(Scheduler *scheduler) {
+    if (scheduler->spareCount) {
+        return scheduler->spareStacks[--scheduler->spareCount];
+    }
+    void *stack = mmap(NULL, TASK_STACK_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                       -1, 0);
+    if (stack == MAP_FAILED) {
+        return NULL;
+    }
+    mprotect(stack, sysconf(_SC_PAGESIZE), PROT_NONE);
+    return stack;
+}
+
+/*
+* Releases the stack of the task that finished last, once we are no longer
+* running on it.
+*/
+static void recycleFinished(Scheduler *scheduler) {
+    Task *task = scheduler->finished;
+    if (!task || task == scheduler->current) {
+        return;
+    }
+    if (scheduler->spareCount < SPARE_STACKS) {
+        scheduler->spareStacks[scheduler->spareCount++] = task->stack;
+    } else {
+        munmap(task->stack, TASK_STACK_SIZE);
+    }
+    task->stack = NULL;
+    scheduler->finished = NULL;
+}
+
+static void makeReady(Scheduler *scheduler, Task *task) {
+    task->state = TASK_READY;
+    task->next = NULL;
+    if (scheduler->readyTail) {
+        scheduler->readyTail->next = task;
+    } else {
+        scheduler->readyHead = task;
+    }
+    scheduler->readyTail = task;
+}
+
+static Task *takeReady(Scheduler *scheduler) {
+    Task *task = scheduler->readyHead;
+    if (task) {
+        scheduler->readyHead = task->next;
+        if (!scheduler->readyHead) {
+            scheduler->readyTail = NULL;
+        }
+    }
+    return task;
+}
+
+/*
+* Appends 'task' to a wait list.
+*/
+static void addWaiting(Task **list, Task *task) {
+    task->next = NULL;
+    task->waitList = list;
+    while (*list) {
+        list = &(*list)->next;
+    }
+    *list = task;
+}
+
+/*
+* Removes and returns the first task on a wait list, or NULL.
+*/
+static Task *takeWaiting(Task **list) {
+    Task *task = *list;
+    if (task) {
+        *list = task->next;
+        task->waitList = NULL;
+    }
+    return task;
+}
+
+static void removeWaiting(Task *task) {
+    Task **list = task->waitList;
+    while (*list != task) {
+        list = &(*list)->next;
+    }
+    *list = task->next;
+    task->waitList = NULL;
+}
+
+/*
+* Moves every sleeping task whose time has come to the run queue. Returns
+* the earliest wake-up time of those still sleeping, or 0 if there are none.
+*/
+static double wakeSleepers(Scheduler *scheduler) {
+    double time = now();
+    double earliest = 0;
+    Task **link = &scheduler->sleeping;
+    while (*link) {
+        Task *task = *link;
+        if (task->wakeAt <= time) {
+            *link = task->next;
+            makeReady(scheduler, task);
+        } else {
+            if (!earliest || task->wakeAt < earliest) {
+                earliest = task->wakeAt;
+            }
+            link = &task->next;
+        }
+    }
+    return earliest;
+}
+
+/*
+* Saves the per-task state of the current task, installs next's, and
+* switches stacks.
+*/
+static void switchTo(Scheduler *scheduler, Task *next) {
+    Interpreter *interp = scheduler->interp;
+    Task *previous = scheduler->current;
+    previous->onError = interp->onError;
+    previous->in = interp->in;
+    previous->input = interp->input;
+    previous->escapes = interp->escapes;
+    previous->liveFrames = interp->liveFrames;
+    previous->liveDepth = interp->liveDepth;
+    previous->liveCapacity = interp->liveCapacity;
+    previous->arguments = interp->arguments;
+    previous->argumentDepth = interp->argumentDepth;
+    previous->trace = traceSwitch(next->trace);
+    previous->profileProcedure = profileProcedure;
+    interp->onError = next->onError;
+    interp->in = next->in;
+    interp->input = next->input;
+    interp->escapes = next->escapes;
+    interp->liveFrames = next->liveFrames;
+    interp->liveDepth = next->liveDepth;
+    interp->liveCapacity = next->liveCapacity;
+    interp->arguments = next->arguments;
+    interp->argumentDepth = next->argumentDepth;
+    profileProcedure = next->profileProcedure;
+    scheduler->current = next;
+    starting = scheduler;
+    swapcontext(&previous->context, &next->context);
+    recycleFinished(scheduler);
+}
+
+/*
+* Runs the next ready task. The current task must already be queued, on a
+* wait list, sleeping or done. If no task can run and none is sleeping,
+* the top-level program is taken off its wait list and resumed with its
+* 'deadlocked' flag set.
+*/
+static void reschedule(Scheduler *scheduler) {
+    Task *next;
+    while (true) {
+        double earliest = wakeSleepers(scheduler);
+        next = takeReady(scheduler);
+        if (next) {
+            break;
+        }
+        if (earliest) {
+            double delay = earliest - now();
+            if (delay > 0) {
+                struct timespec ts;
+                ts.tv_sec = (time_t)delay;
+                ts.tv_nsec = (long)((delay - ts.tv_sec) * 1e9);
+                nanosleep(&ts, NULL);
+            }
+            continue;
+        }
+        next = scheduler->top;
+        assert(next->state == TASK_WAITING);
+        removeWaiting(next);
+        next->state = TASK_READY;
+        next->deadlocked = true;
+        break;
+    }
+    if (next != scheduler->current) {
+        switchTo(scheduler, next);
+    }
+}
+
+/*
+* Puts the current task on a wait list until another task takes it off.
+*/
+static void waitOn(Interpreter *interp, Scheduler *scheduler, Task **list) {
+    Task *task = scheduler->current;
+    task->state = TASK_WAITING;
+    addWaiting(list, task);
+    reschedule(scheduler);
+    if (task->deadlocked) {
+        task->deadlocked = false;
+        evaluationError(interp, "Deadlock: every task is waiting on a channel "
+                        "or join");
+    }
+}
+
+/*
+* Entry point of every spawned task, on its own stack.
+*/
+static void taskMain() {
+    Scheduler *scheduler = starting;
+    Task *task = scheduler->current;
+    Interpreter *interp = scheduler->interp;
+    recycleFinished(scheduler);
+    jmp_buf onError;
+    interp->onError = &onError;
+    if (setjmp(onError)) {
+        task->failed = true;
+        task->error = interp->error;
+        task->raised = interp->raised;
+        if (!task->joiners) {
+            printf("%s", interp->error);
+            interp->errorCount++;
+        }
+    } else {
+        task->result = apply(interp, task->thunk, makeNull());
+    }
+    interp->onError = NULL;
+    free(interp->arguments);
+    interp->arguments = NULL;
+    task->state = TASK_DONE;
+    Task *joiner;
+    while ((joiner = takeWaiting(&task->joiners))) {
+        makeReady(scheduler, joiner);
+    }
+    scheduler->finished = task;
+    reschedule(scheduler);
+}
+
+Value *primitiveSpawn(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for spawn");
+    }
+    Value *thunk = car(args);
+    if (thunk->type != CLOSURE_TYPE && thunk->type != PRIMITIVE_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for spawn");
+    }
+    Scheduler *scheduler = getScheduler(interp);
+    void *stack = allocateStack(scheduler);
+    if (!stack) {
+        evaluationError(interp, "Could not allocate a stack for spawn");
+    }
+    Task *task = calloc(1, sizeof(Task));
+    assert(task);
+    task->stack = stack;
+    task->thunk = thunk;
+    task->in = interp->in;
+    task->input = interp->input;
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = stack;
+    task->context.uc_stack.ss_size = TASK_STACK_SIZE;
+    task->context.uc_link = NULL;
+    makecontext(&task->context, taskMain, 0);
+    task->allNext = scheduler->all;
+    scheduler->all = task;
+    makeReady(scheduler, task);
+
+    Value *value = makeNull();
+    value->type = TASK_TYPE;
+    value->task = task;
+    return value;
+}
+
+Value *primitiveYield(Interpreter *interp, Value *args) {
+    if (args->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for yield");
+    }
+    Scheduler *scheduler = getScheduler(interp);
+    makeReady(scheduler, scheduler->current);
+    reschedule(scheduler);
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+Value *primitiveSleep(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for sleep");
+    }
+    Value *seconds = car(args);
+    if (seconds->type != INT_TYPE && seconds->type != DOUBLE_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for sleep");
+    }
+    Scheduler *scheduler = getScheduler(interp);
+    Task *task = scheduler->current;
+    task->wakeAt = now() + (seconds->type == INT_TYPE ? seconds->i
+                                                      : seconds->d);
+    task->state = TASK_SLEEPING;
+    task->next = scheduler->sleeping;
+    scheduler->sleeping = task;
+    reschedule(scheduler);
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+Value *primitiveJoin(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for join");
+    }
+    if (car(args)->type != TASK_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for join");
+    }
+    Task *task = car(args)->task;
+    Scheduler *scheduler = getScheduler(interp);
+    while (task->state != TASK_DONE) {
+        waitOn(interp, scheduler, &task->joiners);
+    }
+    if (task->failed) {
+        raiseObject(interp, task->raised, task->error);
+    }
+    return task->result;
+}
+
+Value *primitiveMakeChannel(Interpreter *interp, Value *args) {
+    int capacity = 1;
+    if (args->type == CONS_TYPE && cdr(args)->type == NULL_TYPE) {
+        if (car(args)->type != INT_TYPE || car(args)->i < 1) {
+            evaluationError(interp,
+                            "Wrong argument type provided for make-channel");
+        }
+        capacity = car(args)->i;
+    } else if (args->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for make-channel");
+    }
+    Channel *channel = talloc(sizeof(Channel));
+    channel->capacity = capacity;
+    channel->count = 0;
+    channel->start = 0;
+    channel->values = talloc(capacity * sizeof(Value *));
+    channel->senders = NULL;
+    channel->receivers = NULL;
+    Value *value = makeNull();
+    value->type = CHANNEL_TYPE;
+    value->channel = channel;
+    return value;
+}
+
+Value *primitiveChannelSend(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for channel-send");
+    }
+    if (car(args)->type != CHANNEL_TYPE) {
+        evaluationError(interp,
+                        "Wrong argument type provided for channel-send");
+    }
+    Channel *channel = car(args)->channel;
+    Scheduler *scheduler = getScheduler(interp);
+    while (channel->count == channel->capacity) {
+        waitOn(interp, scheduler, &channel->senders);
+    }
+    int slot = (channel->start + channel->count) % channel->capacity;
+    channel->values[slot] = car(cdr(args));
+    channel->count++;
+    Task *receiver = takeWaiting(&channel->receivers);
+    if (receiver) {
+        makeReady(scheduler, receiver);
+    }
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+Value *primitiveChannelReceive(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for "
+                        "channel-receive");
+    }
+    if (car(args)->type != CHANNEL_TYPE) {
+        evaluationError(interp,
+                        "Wrong argument type provided for channel-receive");
+    }
+    Channel *channel = car(args)->channel;
+    Scheduler *scheduler = getScheduler(interp);
+    while (channel->count == 0) {
+        waitOn(interp, scheduler, &channel->receivers);
+    }
+    Value *value = channel->values[channel->start];
+    channel->start = (channel->start + 1) % channel->capacity;
+    channel->count--;
+    Task *sender = takeWaiting(&channel->senders);
+    if (sender) {
+        makeReady(scheduler, sender);
+    }
+    return value;
+}
+
+size_t taskReferences(Value *task, HeapVisitor visit, void *data) {
+    Task *t = task->task;
+    visit(data, t->thunk, false);
+    visit(data, t->result, false);
+    visit(data, t->raised, false);
+    return sizeof(Task);
+}
+
+size_t channelReferences(Value *channel, HeapVisitor visit, void *data) {
+    Channel *c = channel->channel;
+    for (int i = 0; i < c->count; i++) {
+        visit(data, c->values[(c->start + i) % c->capacity], false);
+    }
+    return sizeof(Channel) + c->capacity * sizeof(Value *);
+}
@@ -0,0 +1,79 @@
+#include "value.h"
+#include "context.h"
+#include "heapdump.h"
+
+#ifndef GREEN_H
+#define GREEN_H
+
+/*
+* Green threads: tasks scheduled cooperatively on the OS thread running the
+* instance, each on its own C stack (mmap'ed, with a guard page), so eval
+* and apply recurse on a task's stack as they do on the main one. Tasks
+* share the instance's heap and global frame, and switch only in yield,
+* sleep, join and the channel primitives. The top-level program is a task
+* too: spawned tasks run while it waits in one of those, and are abandoned
+* when it ends.
+*
+* If every task is waiting on a channel or join and none is sleeping, the
+* top-level program's wait raises a deadlock error.
+*/
+
+/*
+* Every task of one instance, with the run queue.
+*/
+typedef struct Scheduler Scheduler;
+
+/*
+* Frees the scheduler, its tasks and their stacks. Must be called from the
+* top-level program, never from a spawned task.
+*/
+void destroyScheduler(Scheduler *scheduler);
+
+/*
+* (spawn thunk) creates a task that will call (thunk) and returns it.
+*/
+Value *primitiveSpawn(Interpreter *interp, Value *args);
+
+/*
+* (yield) lets every other runnable task run before continuing.
+*/
+Value *primitiveYield(Interpreter *interp, Value *args);
+
+/*
+* (sleep seconds) suspends the calling task for at least that long.
+*/
+Value *primitiveSleep(Interpreter *interp, Value *args);
+
+/*
+* (join task) waits for the task to finish and returns its value, raising
+* again any error that ended it. A failed task's error is also printed
+* when it fails, if no task is waiting to join it then.
+*/
+Value *primitiveJoin(Interpreter *interp, Value *args);
+
+/*
+* (make-channel) or (make-channel capacity) returns a channel holding up to
+* capacity values (1 by default).
+*/
+Value *primitiveMakeChannel(Interpreter *interp, Value *args);
+
+/*
+* (channel-send channel value) adds value to the channel, first waiting
+* while it is full.
+*/
+Value *primitiveChannelSend(Interpreter *interp, Value *args);
+
+/*
+* (channel-receive channel) removes and returns the oldest value in the
+* channel, first waiting while it is empty.
+*/
+Value *primitiveChannelReceive(Interpreter *interp, Value *args);
+
+/*
+* Visit what the task 'task' and the channel 'channel' refer to, for
+* heap-dump (see heapdump.h), and return the size of their structures.
+*/
+size_t taskReferences(Value *task, HeapVisitor visit, void *data);
+size_t channelReferences(Value *channel, HeapVisitor visit, void *data);
+
+#endif
@@ -0,0 +1,298 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "value.h"
+#include "interpreter.h"
+#include "heapdump.h"
+#include "future.h"
+#include "green.h"
+#include "memo.h"
+#include "text.h"
+#include "port.h"
+#include "macro.h"
+#include "promise.h"
+#include "escape.h"
+
+#define LABEL_LENGTH 60 // longest string or symbol written as a label
+
+/*
+* An object still to be written: either a Value or a Frame.
+*/
+typedef struct {
+    void *object;
+    bool isFrame;
+} Pending;
+
+/*
+* Set of objects already written, kept as an open-addressed table of
+* pointers, the stack of objects still to visit, and the references of the
+* object being written. All are malloc'ed so that dumping does not change
+* the heap being dumped.
+*/
+typedef struct {
+    void **seen;
+    size_t capacity;
+    size_t count;
+    Pending *stack;
+    size_t depth;
+    size_t stackCapacity;
+    Pending *refs;
+    size_t refCount;
+    size_t refCapacity;
+    FILE *file;
+} Dump;
+
+static size_t hashPointer(void *p) {
+    uintptr_t h = (uintptr_t)p;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+/*
+* Adds 'p' to the seen set. Returns false if it was already there.
+*/
+static bool markSeen(Dump *dump, void *p) {
+    if ((dump->count + 1) * 2 > dump->capacity) {
+        void **old = dump->seen;
+        size_t oldCapacity = dump->capacity;
+        dump->capacity *= 2;
+        dump->seen = calloc(dump->capacity, sizeof(void *));
+        assert(dump->seen);
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (old[i]) {
+                size_t h = hashPointer(old[i]);
+                while (dump->seen[h & (dump->capacity - 1)]) {
+                    h++;
+                }
+                dump->seen[h & (dump->capacity - 1)] = old[i];
+            }
+        }
+        free(old);
+    }
+    size_t h = hashPointer(p);
+    while (dump->seen[h & (dump->capacity - 1)]) {
+        if (dump->seen[h & (dump->capacity - 1)] == p) {
+            return false;
+        }
+        h++;
+    }
+    dump->seen[h & (dump->capacity - 1)] = p;
+    dump->count++;
+    return true;
+}
+
+/*
+* Queues an object to be written, unless it is NULL or already written.
+*/
+static void visit(Dump *dump, void *object, bool isFrame) {
+    if (!object || !markSeen(dump, object)) {
+        return;
+    }
+    if (dump->depth == dump->stackCapacity) {
+        dump->stackCapacity *= 2;
+        dump->stack = realloc(dump->stack,
+                              dump->stackCapacity * sizeof(Pending));
+        assert(dump->stack);
+    }
+    dump->stack[dump->depth].object = object;
+    dump->stack[dump->depth].isFrame = isFrame;
+    dump->depth++;
+}
+
+/*
+* Writes a label, escaping characters that would break the line format.
+*/
+static void writeLabel(FILE *file, char *s) {
+    fputc(';', file);
+    for (int i = 0; s && s[i] && i < LABEL_LENGTH; i++) {
+        if (s[i] == '\n') {
+            fputs("\\n", file);
+        } else {
+            fputc(s[i], file);
+        }
+    }
+    fputc('\n', file);
+}
+
+static char *typeName(valueType type) {
+    switch (type) {
+        case PTR_TYPE: return "ptr";
+        case INT_TYPE: return "int";
+        case DOUBLE_TYPE: return "double";
+        case STR_TYPE: return "string";
+        case CONS_TYPE: return "cons";
+        case NULL_TYPE: return "null";
+        case BOOL_TYPE: return "bool";
+        case SYMBOL_TYPE: return "symbol";
+        case VOID_TYPE: return "void";
+        case CLOSURE_TYPE: return "closure";
+        case PRIMITIVE_TYPE: return "primitive";
+        case DOT_TYPE: return "dot";
+        case FUTURE_TYPE: return "future";
+        case PLACE_TYPE: return "place";
+        case TASK_TYPE: return "task";
+        case CHANNEL_TYPE: return "channel";
+        case GUARD_TYPE: return "guard";
+        case BUILDER_TYPE: return "string-builder";
+        case PORT_TYPE: return "input-port";
+        case EOF_TYPE: return "eof";
+        case MACRO_TYPE: return "syntax";
+        case PROMISE_TYPE: return "promise";
+        case ESCAPE_TYPE: return "escape";
+        default: return "other";
+    }
+}
+
+/*
+* Adds 'object' to the references of the object being written; a
+* HeapVisitor.
+*/
+static void addReference(void *data, void *object, bool isFrame) {
+    Dump *dump = data;
+    if (!object) {
+        return;
+    }
+    if (dump->refCount == dump->refCapacity) {
+        dump->refCapacity *= 2;
+        dump->refs = realloc(dump->refs, dump->refCapacity * sizeof(Pending));
+        assert(dump->refs);
+    }
+    dump->refs[dump->refCount].object = object;
+    dump->refs[dump->refCount].isFrame = isFrame;
+    dump->refCount++;
+}
+
+/*
+* Writes the rest of an object's line, its size, the references added
+* since the last call and 'label', and queues those references.
+*/
+static void writeReferences(Dump *dump, size_t size, char *label) {
+    fprintf(dump->file, "%zu %zu", size, dump->refCount);
+    for (size_t i = 0; i < dump->refCount; i++) {
+        fprintf(dump->file, " %p", dump->refs[i].object);
+    }
+    writeLabel(dump->file, label);
+    for (size_t i = 0; i < dump->refCount; i++) {
+        visit(dump, dump->refs[i].object, dump->refs[i].isFrame);
+    }
+    dump->refCount = 0;
+}
+
+/*
+* Writes one Value and queues everything it refers to.
+*/
+static void dumpValue(Dump *dump, Value *val) {
+    fprintf(dump->file, "O %p %s ", (void *)val, typeName(val->type));
+    size_t size = sizeof(Value);
+    char *label = NULL;
+    switch (val->type) {
+        case CONS_TYPE:
+            addReference(dump, (val->c).car, false);
+            addReference(dump, (val->c).cdr, false);
+            break;
+        case CLOSURE_TYPE:
+            addReference(dump, (val->k).parameters, false);
+            addReference(dump, (val->k).function, false);
+            addReference(dump, (val->k).frame, true);
+            if ((val->k).memo) {
+                size += memoReferences((val->k).memo, addReference, dump);
+            }
+            label = (val->k).name;
+            break;
+        case STR_TYPE:
+        case SYMBOL_TYPE:
+            size += strlen(val->s) + 1;
+            label = val->s;
+            break;
+        case PRIMITIVE_TYPE:
+            label = (val->pr).name;
+            break;
+        case FUTURE_TYPE:
+            size += futureReferences(val, addReference, dump);
+            break;
+        case TASK_TYPE:
+            size += taskReferences(val, addReference, dump);
+            break;
+        case CHANNEL_TYPE:
+            size += channelReferences(val, addReference, dump);
+            break;
+        case BUILDER_TYPE:
+            size += builderSize(val);
+            break;
+        case PORT_TYPE:
+            size += portSize(val);
+            break;
+        case MACRO_TYPE:
+            size += macroReferences(val, addReference, dump);
+            break;
+        case PROMISE_TYPE:
+            size += promiseReferences(val, addReference, dump);
+            break;
+        case ESCAPE_TYPE:
+            size += escapeSize(val);
+            break;
+        default:
+            break;
+    }
+    writeReferences(dump, size, label);
+}
+
+/*
+* Writes one Frame and queues its bindings and parent.
+*/
+static void writeFrame(Dump *dump, Frame *frame) {
+    fprintf(dump->file, "O %p frame %zu %i %p", (void *)frame, sizeof(Frame),
+            frame->parent ? 2 : 1, (void *)frame->bindings);
+    if (frame->parent) {
+        fprintf(dump->file, " %p", (void *)frame->parent);
+    }
+    writeLabel(dump->file, frame->parent ? NULL : "global");
+    visit(dump, frame->bindings, false);
+    visit(dump, frame->parent, true);
+}
+
+bool heapDump(char *path, Frame *global, Frame **live, int liveCount) {
+    Dump dump;
+    dump.file = fopen(path, "w");
+    if (!dump.file) {
+        return false;
+    }
+    dump.capacity = 1024;
+    dump.count = 0;
+    dump.seen = calloc(dump.capacity, sizeof(void *));
+    dump.stackCapacity = 256;
+    dump.depth = 0;
+    dump.stack = malloc(dump.stackCapacity * sizeof(Pending));
+    dump.refCapacity = 16;
+    dump.refCount = 0;
+    dump.refs = malloc(dump.refCapacity * sizeof(Pending));
+    assert(dump.seen && dump.stack && dump.refs);
+
+    fprintf(dump.file, "# scheme heap dump v1\n");
+    fprintf(dump.file, "R %p global\n", (void *)global);
+    for (int i = 0; i < liveCount; i++) {
+        fprintf(dump.file, "R %p frame %i\n", (void *)live[i], i);
+    }
+    visit(&dump, global, true);
+    for (int i = 0; i < liveCount; i++) {
+        visit(&dump, live[i], true);
+    }
+    // Depth-first with an explicit stack, so long lists cannot overflow
+    // the C stack.
+    while (dump.depth > 0) {
+        Pending next = dump.stack[--dump.depth];
+        if (next.isFrame) {
+            writeFrame(&dump, next.object);
+        } else {
+            dumpValue(&dump, next.object);
+        }
+    }
+    free(dump.seen);
+    free(dump.stack);
+    free(dump.refs);
+    return fclose(dump.file) == 0;
+}
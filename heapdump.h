@@ -0,0 +1,29 @@
+#include <stdbool.h>
+#include "value.h"
+#include "interpreter.h"
+
+#ifndef HEAPDUMP_H
+#define HEAPDUMP_H
+
+/*
+* Writes every object reachable from the global frame and the live call
+* frames to the file at 'path', one line per object:
+*
+*     R <id> <root name>
+*     O <id> <type> <size> <number of refs> <ref>... ;<label>
+*
+* Ids are object addresses. Sizes are in bytes and include string contents
+* and the structures a Value owns, such as a promise's box or a channel's
+* buffer. Returns false if the file could not be written. See heapstat.c
+* for an analyzer of the output.
+*/
+bool heapDump(char *path, Frame *global, Frame **live, int liveCount);
+
+/*
+* Called with each Value or Frame ('isFrame') that a Value refers to
+* through a structure private to another file. The functions that call it,
+* such as promiseReferences, return the size of those structures.
+*/
+typedef void (*HeapVisitor)(void *data, void *object, bool isFrame);
+
+#endif
@@ -0,0 +1,379 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <assert.h>
+
+/*
+* Offline analyzer for files written by (heap-dump "file").
+*
+* Usage: heapstat DUMPFILE [N]
+*
+* Builds the object graph, computes the dominator tree from a virtual root
+* that points at every root in the dump, and prints
+*   - totals per object type,
+*   - the N closures and frames retaining the most memory, and
+*   - the N objects retaining the most memory overall,
+* each with the chain of dominators leading back to a root. An object's
+* retained size is the memory that would become unreachable if that object
+* were dropped.
+*/
+
+#define LINE_LENGTH 4096
+
+typedef struct {
+    uintptr_t address;
+    char type[16];
+    char *label;
+    long size;
+    int *refs;
+    int refCount;
+    int idom;      // index of the immediate dominator, -1 if unreachable
+    int order;     // reverse postorder number, -1 if unreachable
+    long retained;
+} Node;
+
+static Node *nodes;
+static int nodeCount;
+static int nodeCapacity;
+static uintptr_t **refAddresses; // refs as read, resolved after loading
+
+static int *table; // address -> node index + 1, open addressing
+static int tableCapacity;
+
+static size_t hashAddress(uintptr_t a) {
+    a ^= a >> 33;
+    a *= 0xff51afd7ed558ccdULL;
+    a ^= a >> 33;
+    return (size_t)a;
+}
+
+/*
+* Returns the node for 'address', or -1 if the dump has none.
+*/
+static int findNode(uintptr_t address) {
+    size_t h = hashAddress(address);
+    while (table[h & (tableCapacity - 1)]) {
+        int i = table[h & (tableCapacity - 1)] - 1;
+        if (nodes[i].address == address) {
+            return i;
+        }
+        h++;
+    }
+    return -1;
+}
+
+static void indexNodes() {
+    tableCapacity = 1024;
+    while (tableCapacity < 2 * nodeCount) {
+        tableCapacity *= 2;
+    }
+    table = calloc(tableCapacity, sizeof(int));
+    assert(table);
+    for (int i = 0; i < nodeCount; i++) {
+        size_t h = hashAddress(nodes[i].address);
+        while (table[h & (tableCapacity - 1)]) {
+            h++;
+        }
+        table[h & (tableCapacity - 1)] = i + 1;
+    }
+}
+
+static int addNode() {
+    if (nodeCount == nodeCapacity) {
+        nodeCapacity = nodeCapacity ? 2 * nodeCapacity : 1024;
+        nodes = realloc(nodes, nodeCapacity * sizeof(Node));
+        refAddresses = realloc(refAddresses,
+                               nodeCapacity * sizeof(uintptr_t *));
+        assert(nodes && refAddresses);
+    }
+    Node *node = &nodes[nodeCount];
+    memset(node, 0, sizeof(Node));
+    node->label = "";
+    refAddresses[nodeCount] = NULL;
+    return nodeCount++;
+}
+
+/*
+* Reads the dump. Node 0 is the virtual root; its refs are the dump's roots.
+*/
+static void load(FILE *file) {
+    char line[LINE_LENGTH];
+    uintptr_t *roots = NULL;
+    int rootCount = 0;
+    addNode();
+    strcpy(nodes[0].type, "root");
+    nodes[0].label = "(all roots)";
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == 'R') {
+            uintptr_t address;
+            if (sscanf(line, "R %" SCNxPTR, &address) == 1) {
+                roots = realloc(roots, (rootCount + 1) * sizeof(uintptr_t));
+                roots[rootCount++] = address;
+            }
+        } else if (line[0] == 'O') {
+            char *label = strchr(line, ';');
+            if (label) {
+                *label = '\0';
+                label++;
+            }
+            int i = addNode();
+            Node *node = &nodes[i];
+            int offset;
+            if (sscanf(line, "O %" SCNxPTR " %15s %li %i%n", &node->address,
+                       node->type, &node->size, &node->refCount,
+                       &offset) != 4) {
+                node->refCount = 0;
+                continue;
+            }
+            refAddresses[i] = malloc((node->refCount + 1) * sizeof(uintptr_t));
+            char *rest = line + offset;
+            for (int r = 0; r < node->refCount; r++) {
+                int used;
+                sscanf(rest, " %" SCNxPTR "%n", &refAddresses[i][r], &used);
+                rest += used;
+            }
+            node->label = strdup(label ? label : "");
+        }
+    }
+    nodes[0].refCount = rootCount;
+    refAddresses[0] = roots;
+    indexNodes();
+    for (int i = 0; i < nodeCount; i++) {
+        nodes[i].refs = malloc((nodes[i].refCount + 1) * sizeof(int));
+        int kept = 0;
+        for (int r = 0; r < nodes[i].refCount; r++) {
+            int target = findNode(refAddresses[i][r]);
+            if (target >= 0) {
+                nodes[i].refs[kept++] = target;
+            }
+        }
+        nodes[i].refCount = kept;
+        free(refAddresses[i]);
+    }
+}
+
+/*
+* Numbers reachable nodes in reverse postorder, iteratively. Returns the
+* nodes in that order.
+*/
+static int *reversePostorder(int *reachable) {
+    int *post = malloc(nodeCount * sizeof(int));
+    int *stack = malloc(nodeCount * sizeof(int));
+    int *nextRef = calloc(nodeCount, sizeof(int));
+    char *visited = calloc(nodeCount, 1);
+    int postCount = 0;
+    int depth = 0;
+    stack[depth++] = 0;
+    visited[0] = 1;
+    while (depth > 0) {
+        int v = stack[depth - 1];
+        if (nextRef[v] < nodes[v].refCount) {
+            int w = nodes[v].refs[nextRef[v]++];
+            if (!visited[w]) {
+                visited[w] = 1;
+                stack[depth++] = w;
+            }
+        } else {
+            post[postCount++] = v;
+            depth--;
+        }
+    }
+    int *order = malloc(postCount * sizeof(int));
+    for (int i = 0; i < postCount; i++) {
+        order[i] = post[postCount - 1 - i];
+        nodes[order[i]].order = i;
+    }
+    *reachable = postCount;
+    free(post);
+    free(stack);
+    free(nextRef);
+    free(visited);
+    return order;
+}
+
+static int intersect(int a, int b) {
+    while (a != b) {
+        while (nodes[a].order > nodes[b].order) {
+            a = nodes[a].idom;
+        }
+        while (nodes[b].order > nodes[a].order) {
+            b = nodes[b].idom;
+        }
+    }
+    return a;
+}
+
+/*
+* Computes immediate dominators with the iterative algorithm of Cooper,
+* Harvey and Kennedy, then accumulates retained sizes bottom-up.
+*/
+static void dominators() {
+    for (int i = 0; i < nodeCount; i++) {
+        nodes[i].idom = -1;
+        nodes[i].order = -1;
+    }
+    int reachable;
+    int *order = reversePostorder(&reachable);
+
+    // predecessor lists, restricted to reachable nodes
+    int *predCount = calloc(nodeCount, sizeof(int));
+    for (int i = 0; i < reachable; i++) {
+        Node *v = &nodes[order[i]];
+        for (int r = 0; r < v->refCount; r++) {
+            predCount[v->refs[r]]++;
+        }
+    }
+    int **preds = malloc(nodeCount * sizeof(int *));
+    for (int i = 0; i < nodeCount; i++) {
+        preds[i] = malloc((predCount[i] + 1) * sizeof(int));
+        predCount[i] = 0;
+    }
+    for (int i = 0; i < reachable; i++) {
+        int v = order[i];
+        for (int r = 0; r < nodes[v].refCount; r++) {
+            int w = nodes[v].refs[r];
+            preds[w][predCount[w]++] = v;
+        }
+    }
+
+    nodes[0].idom = 0;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 1; i < reachable; i++) {
+            int v = order[i];
+            int newIdom = -1;
+            for (int p = 0; p < predCount[v]; p++) {
+                int u = preds[v][p];
+                if (nodes[u].idom < 0) {
+                    continue;
+                }
+                newIdom = newIdom < 0 ? u : intersect(u, newIdom);
+            }
+            if (newIdom != nodes[v].idom) {
+                nodes[v].idom = newIdom;
+                changed = 1;
+            }
+        }
+    }
+
+    for (int i = 0; i < reachable; i++) {
+        nodes[order[i]].retained = nodes[order[i]].size;
+    }
+    for (int i = reachable - 1; i > 0; i--) {
+        int v = order[i];
+        nodes[nodes[v].idom].retained += nodes[v].retained;
+    }
+    for (int i = 0; i < nodeCount; i++) {
+        free(preds[i]);
+    }
+    free(preds);
+    free(predCount);
+    free(order);
+}
+
+static int compareRetained(const void *a, const void *b) {
+    long x = nodes[*(const int *)a].retained;
+    long y = nodes[*(const int *)b].retained;
+    return (y > x) - (y < x);
+}
+
+/*
+* Prints one node and the dominators between it and the roots.
+*/
+static void printNode(int i) {
+    Node *node = &nodes[i];
+    printf("%12li %10li  %-9s %#lx %s\n", node->retained, node->size,
+           node->type, (unsigned long)node->address, node->label);
+    int d = node->idom;
+    int hops = 0;
+    printf("%24s", "");
+    while (d > 0 && hops < 8) {
+        printf("<- %s%s%s ", nodes[d].type, nodes[d].label[0] ? " " : "",
+               nodes[d].label);
+        d = nodes[d].idom;
+        hops++;
+    }
+    printf("%s\n", d > 0 ? "<- ..." : "<- root");
+}
+
+/*
+* Prints the n reachable nodes with the largest retained size, among those
+* whose type is one of 'types' (or all types if 'types' is NULL).
+*/
+static void printTop(int n, char **types, char *title) {
+    int *candidates = malloc(nodeCount * sizeof(int));
+    int count = 0;
+    for (int i = 1; i < nodeCount; i++) {
+        if (nodes[i].idom < 0) {
+            continue;
+        }
+        int wanted = !types;
+        for (int t = 0; types && types[t]; t++) {
+            wanted |= !strcmp(nodes[i].type, types[t]);
+        }
+        if (wanted) {
+            candidates[count++] = i;
+        }
+    }
+    qsort(candidates, count, sizeof(int), compareRetained);
+    printf("\n%s\n%12s %10s  %-9s %s\n", title, "retained", "self", "type",
+           "address/label");
+    for (int i = 0; i < count && i < n; i++) {
+        printNode(candidates[i]);
+    }
+    free(candidates);
+}
+
+/*
+* Prints object counts and bytes per type.
+*/
+static void printTypes() {
+    char names[32][16];
+    long counts[32] = {0};
+    long bytes[32] = {0};
+    int typeCount = 0;
+    for (int i = 1; i < nodeCount; i++) {
+        int t = 0;
+        while (t < typeCount && strcmp(names[t], nodes[i].type)) {
+            t++;
+        }
+        if (t == typeCount) {
+            if (typeCount == 32) {
+                continue;
+            }
+            strcpy(names[typeCount++], nodes[i].type);
+        }
+        counts[t]++;
+        bytes[t] += nodes[i].size;
+    }
+    printf("%-10s %12s %14s\n", "type", "objects", "bytes");
+    for (int t = 0; t < typeCount; t++) {
+        printf("%-10s %12li %14li\n", names[t], counts[t], bytes[t]);
+    }
+    printf("%-10s %12i %14li\n", "total", nodeCount - 1, nodes[0].retained);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s DUMPFILE [N]\n", argv[0]);
+        return 1;
+    }
+    FILE *file = fopen(argv[1], "r");
+    if (!file) {
+        printf("Error: could not open %s\n", argv[1]);
+        return 1;
+    }
+    int n = argc > 2 ? atoi(argv[2]) : 10;
+    load(file);
+    fclose(file);
+    dominators();
+    printTypes();
+    char *holders[] = {"closure", "frame", NULL};
+    printTop(n, holders, "Closures and frames retaining the most memory:");
+    printTop(n, NULL, "Objects retaining the most memory:");
+    return 0;
+}
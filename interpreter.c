@@ -1,96 +1,81 @@
 #include <stdlib.h>
+#include <stdint.h>
 #include "value.h"
 #include "talloc.h"
 #include "linkedlist.h"
 #include "tokenizer.h"
 #include "parser.h"
 #include "interpreter.h"
+#include "trace.h"
+#include "profiler.h"
+#include "heapdump.h"
+#include "parallel.h"
+#include "future.h"
+#include "place.h"
+#include "green.h"
+#include "eventloop.h"
+#include "memo.h"
+#include "optimizer.h"
+#include "text.h"
+#include "output.h"
+#include "port.h"
+#include "fasl.h"
+#include "macro.h"
+#include "promise.h"
+#include "escape.h"
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <setjmp.h>
 
 #define UNDEFINED_SYMBOL "23" // Not a symbol in Scheme - so if we run into
                               // this as a symbol, we know to throw an error
 
 /*
-* Prints out a supplied error message and terminates the program.
+* Reports the supplied error message and abandons the current evaluation.
+* An exception handler receives the message as a string.
 */
-void evaluationError(char *msg) {
-    printf("Evaluation Error: %s\n", msg);
-    texit(1);
+void evaluationError(Interpreter *interp, char *msg) {
+    char *text = talloc(strlen(msg) + 20);
+    strcpy(text, "Evaluation Error: ");
+    strcat(text, msg);
+    strcat(text, "\n");
+    Value *object = makeNull();
+    object->type = STR_TYPE;
+    object->s = talloc(strlen(msg) + 1);
+    strcpy(object->s, msg);
+    raiseObject(interp, object, text);
 }
 
 /*
 * Prints a single value
 */
 void printValue(Value *val) {
-    switch (val->type) {
-        case BOOL_TYPE:
-            printf("%s", val->b ? "#t" : "#f");
-            break;
-        case STR_TYPE:
-            printf("\"");
-            printf("%s", val->s);
-            printf("\"");
-            break;
-        case SYMBOL_TYPE:
-            printf("%s", val->s);
-            break;
-        case INT_TYPE:
-            printf("%i", val->i);
-            break;
-        case DOUBLE_TYPE:
-            printf("%f", val->d);
-            break;
-        case CONS_TYPE:
-            if (cdr(val)->type == NULL_TYPE) { // one thing in list
-                printf("(");
-                printValue(car(val));
-                printf(")");
-            } else if (cdr(val)->type != CONS_TYPE) {
-                printf("(");
-                printValue(car(val));
-                printf(" . ");
-                printValue(cdr(val));
-                printf(")");
-            }
-            else {
-                printf("(");
-                while (val->type == CONS_TYPE) {
-                    if (cdr(val)->type != CONS_TYPE &&
-                        cdr(val)->type != NULL_TYPE) {
-                        printValue(car(val));
-                        val = cdr(val);
-                        printf(" . ");
-                    } else {
-                        printValue(car(val));
-                        val = cdr(val);
-                        if (val->type != NULL_TYPE) {
-                            printf(" ");
-                        }
-                    }
-                }
-                if (val->type != NULL_TYPE) {
-                    printValue(val);
-                }
-                printf(")");
-            }
-            break;
-        case CLOSURE_TYPE:
-            printf("#<procedure>");
-            break;
-        case NULL_TYPE:
-            printf("()");
-            break;
-        case DOT_TYPE:
-            printf(".");
-            break;
-        default:
-          break;
+    writeValue(stdout, val);
+}
+
+/*
+* Prints the value of a top-level form on a line of its own, or nothing for
+* a void value.
+*/
+static void printResult(Value *val) {
+    Output *out = outputTo(stdout);
+    outputValue(out, val);
+    if (val->type != VOID_TYPE) {
+        outputChar(out, '\n');
     }
+    flushOutput(out);
 }
 
+/*
+* Prints a single value to the given stream
+*/
+void writeValue(FILE *out, Value *val) {
+    Output *output = outputTo(out);
+    outputValue(output, val);
+    flushOutput(output);
+}
 
 /********************************************************************
 *********************************************************************
@@ -108,30 +93,382 @@ void printValue(Value *val) {
 * there is exactly one parameter after "." and bindings this parameter to
 * the list of the remaining args.
 */
-Value *addVariadicBinding(Value *parameters, Value *args, Value *bindings) {
+Value *addVariadicBinding(Interpreter *interp, Value *parameters, Value *args,
+                          Value *bindings) {
     Value *curBind = cons(args, makeNull());
     assert(car(parameters)->type == DOT_TYPE);
     parameters = cdr(parameters);  // delete '.'
     if (parameters->type == NULL_TYPE || cdr(parameters)->type != NULL_TYPE) {
-        evaluationError("Wrong number of args after . in parameters list");
+        evaluationError(interp, "Wrong number of args after . in parameters list");
     }
     curBind = cons(car(parameters), curBind);
     bindings = cons(curBind, bindings);
     return bindings;
 }
 
+/*
+* Records that 'frame' is in use by the expression being evaluated. Callers
+* restore interp->liveDepth to its old value once the frame is no longer in
+* use.
+*/
+void pushLiveFrame(Interpreter *interp, Frame *frame) {
+    if (interp->liveDepth == interp->liveCapacity) {
+        interp->liveCapacity = interp->liveCapacity ?
+                               2 * interp->liveCapacity : 64;
+        interp->liveFrames = realloc(interp->liveFrames,
+                                     interp->liveCapacity * sizeof(Frame *));
+        assert(interp->liveFrames);
+    }
+    interp->liveFrames[interp->liveDepth++] = frame;
+}
+
+#define ARGUMENT_STACK_SIZE 16384
+
+/*
+* Returns room for 'count' argument values. It is on the instance's
+* argument stack, which does not move, so the values stay put while more
+* calls are evaluated, or on the heap once the stack is full. Callers
+* restore interp->argumentDepth to its old value once done with them.
+*/
+static Value **pushArguments(Interpreter *interp, int count) {
+    if (!interp->arguments) {
+        interp->arguments = malloc(ARGUMENT_STACK_SIZE * sizeof(Value *));
+        assert(interp->arguments);
+    }
+    if (interp->argumentDepth + count > ARGUMENT_STACK_SIZE) {
+        return talloc(count * sizeof(Value *));
+    }
+    Value **values = interp->arguments + interp->argumentDepth;
+    interp->argumentDepth += count;
+    return values;
+}
+
+#define FRAME_POOL_SLOTS 256
+
+/*
+* Frames that calls and let forms have finished with, kept for the next
+* call or let laid out the same way: the same parameter list, or the same
+* let form. Frames are chained through 'parent' while they are spare. A
+* frame abandoned by an error is simply never returned.
+*/
+typedef struct {
+    Value *shape;  // parameter list or let form the frames are laid out for
+    bool analyzed; // for a let form: whether 'captured' has been worked out
+    bool captured; // for a let form: whether its body may capture its frame
+    bool loops;    // for a named let: whether it runs as a loop
+    Frame *spare;
+} FramePoolSlot;
+
+struct FramePool {
+    FramePoolSlot slots[FRAME_POOL_SLOTS];
+};
+
+/*
+* Returns the pool slot for frames laid out for 'shape', emptying it if it
+* held frames for another shape.
+*/
+static FramePoolSlot *framePoolSlot(Interpreter *interp, Value *shape) {
+    if (!interp->framePool) {
+        interp->framePool = calloc(1, sizeof(struct FramePool));
+        assert(interp->framePool);
+    }
+    FramePoolSlot *slot = &interp->framePool->slots[
+        ((uintptr_t)shape >> 4) % FRAME_POOL_SLOTS];
+    if (slot->shape != shape) {
+        slot->shape = shape;
+        slot->analyzed = false;
+        slot->spare = NULL;
+    }
+    return slot;
+}
+
+/*
+* Returns a spare frame laid out for 'shape' with its bindings reset to the
+* ones it was entered with, or NULL if there is none.
+*/
+static Frame *takeFrame(Interpreter *interp, Value *shape) {
+    FramePoolSlot *slot = framePoolSlot(interp, shape);
+    Frame *frame = slot->spare;
+    if (frame) {
+        slot->spare = frame->parent;
+        frame->bindings = frame->entered;
+    }
+    return frame;
+}
+
+/*
+* Keeps 'frame', which nothing refers to any more, for reuse.
+*/
+static void returnFrame(Interpreter *interp, Value *shape, Frame *frame) {
+    FramePoolSlot *slot = framePoolSlot(interp, shape);
+    frame->parent = slot->spare;
+    slot->spare = frame;
+}
+
+/*
+* Returns true if the symbol 'name' appears anywhere in 'tree'.
+*/
+static bool mentionsSymbol(Value *tree, char *name) {
+    while (tree->type == CONS_TYPE) {
+        if (mentionsSymbol(car(tree), name)) {
+            return true;
+        }
+        tree = cdr(tree);
+    }
+    return tree->type == SYMBOL_TYPE && !strcmp(tree->s, name);
+}
+
+/*
+* Returns the number of elements of 'list', or -1 if it is not a list.
+*/
+static int listLength(Value *list) {
+    int length = 0;
+    for (; list->type == CONS_TYPE; list = cdr(list)) {
+        length++;
+    }
+    return list->type == NULL_TYPE ? length : -1;
+}
+
+/*
+* Returns true if 'bindings' is a list of (symbol expr) pairs, none of
+* which binds 'name'.
+*/
+static bool bindsOnlyOthers(Value *bindings, char *name) {
+    if (listLength(bindings) < 0) {
+        return false;
+    }
+    for (; bindings->type == CONS_TYPE; bindings = cdr(bindings)) {
+        Value *binding = car(bindings);
+        if (listLength(binding) != 2 || car(binding)->type != SYMBOL_TYPE ||
+            !strcmp(car(binding)->s, name)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool onlyTailCalls(Value *expr, char *name, int count);
+
+/*
+* onlyTailCalls for a body, whose last expression is in tail position.
+*/
+static bool onlyTailCallsInBody(Value *body, char *name, int count) {
+    for (; body->type == CONS_TYPE; body = cdr(body)) {
+        if (cdr(body)->type == CONS_TYPE ? mentionsSymbol(car(body), name)
+                                         : !onlyTailCalls(car(body), name, count)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+* Returns true if 'name' appears in 'expr' only as the operator of calls
+* with 'count' arguments in tail position, whose arguments do not mention
+* it. Tail positions are followed through if, cond, begin and let, as
+* evalLoopTail follows them.
+*/
+static bool onlyTailCalls(Value *expr, char *name, int count) {
+    if (expr->type != CONS_TYPE || car(expr)->type != SYMBOL_TYPE) {
+        return !mentionsSymbol(expr, name);
+    }
+    char *form = car(expr)->s;
+    Value *args = cdr(expr);
+    int length = listLength(args);
+    if (!strcmp(form, name)) {
+        return length == count && !mentionsSymbol(args, name);
+    } else if (!strcmp(form, "if") && (length == 2 || length == 3)) {
+        return !mentionsSymbol(car(args), name) &&
+               onlyTailCalls(car(cdr(args)), name, count) &&
+               (length == 2 || onlyTailCalls(car(cdr(cdr(args))), name, count));
+    } else if (!strcmp(form, "cond") && length >= 0) {
+        for (; args->type == CONS_TYPE; args = cdr(args)) {
+            Value *clause = car(args);
+            if (listLength(clause) != 2) {
+                return !mentionsSymbol(expr, name);
+            }
+            if (mentionsSymbol(car(clause), name) ||
+                !onlyTailCalls(car(cdr(clause)), name, count)) {
+                return false;
+            }
+        }
+        return true;
+    } else if (!strcmp(form, "begin") && length >= 0) {
+        return onlyTailCallsInBody(args, name, count);
+    } else if (!strcmp(form, "let") && length >= 2 &&
+               bindsOnlyOthers(car(args), name)) {
+        return !mentionsSymbol(car(args), name) &&
+               onlyTailCallsInBody(cdr(args), name, count);
+    }
+    return !mentionsSymbol(expr, name);
+}
+
+/*
+* Returns true if the named let (let name bindings body ...), given as
+* 'args' without the let, can run as a loop: its name is used only to call
+* it again from tail position, so no procedure need be made for it.
+*/
+static bool loopsNatively(Value *args) {
+    if (listLength(args) < 3 || car(args)->type != SYMBOL_TYPE) {
+        return false;
+    }
+    char *name = car(args)->s;
+    Value *bindings = car(cdr(args));
+    return bindsOnlyOthers(bindings, name) &&
+           onlyTailCallsInBody(cdr(cdr(args)), name, listLength(bindings));
+}
+
+/*
+* Returns true if evaluating 'expr' could make a closure that captures the
+* frame it is evaluated in, or otherwise keep the frame after it returns.
+* Conservative: any mention of lambda, load, let/ec or a form making a
+* promise counts, as does a named let that does not run as a loop, which makes a
+* procedure for its name.
+*/
+static bool capturesFrame(Value *expr) {
+    if (expr->type == CONS_TYPE && car(expr)->type == SYMBOL_TYPE &&
+        !strcmp(car(expr)->s, "let") && cdr(expr)->type == CONS_TYPE &&
+        car(cdr(expr))->type == SYMBOL_TYPE && !loopsNatively(cdr(expr))) {
+        return true;
+    }
+    while (expr->type == CONS_TYPE) {
+        if (capturesFrame(car(expr))) {
+            return true;
+        }
+        expr = cdr(expr);
+    }
+    return expr->type == SYMBOL_TYPE &&
+           (!strcmp(expr->s, "lambda") || !strcmp(expr->s, "load") ||
+            !strcmp(expr->s, "delay") || !strcmp(expr->s, "delay-force") ||
+            !strcmp(expr->s, "stream-cons") || !strcmp(expr->s, "let/ec"));
+}
+
+/*
+* Evaluates the body of a closure in newFrame, recording the call for --trace
+* and charging allocations made during the call to the closure for
+* --profile-alloc.
+*/
+Value *evalInstrumented(Interpreter *interp, Value *function, Frame *newFrame) {
+    char *name = (function->k).name ? (function->k).name : "lambda";
+    char *caller = profileProcedure;
+    profileProcedure = name;
+    if (tracing) {
+        traceEnter(name, TRACE_CLOSURE);
+    }
+    Value *result = eval(interp, (function->k).function, newFrame);
+    if (tracing) {
+        traceExit(name, TRACE_CLOSURE);
+    }
+    profileProcedure = caller;
+    return result;
+}
+
+/*
+* Checks the argc values in argv against the parameters of the closure
+* 'function' and returns a frame for the call binding them, kept from an
+* earlier call with the same parameter list if there is one, and entered
+* as a live frame. Kept apart from applyInReusedFrame so that none of this
+* takes up C stack for the rest of the call.
+*/
+static Frame *enterReusedFrame(Interpreter *interp, Value *function,
+                               int argc, Value **argv) {
+    Value *parameters = (function->k).parameters;
+    Value *parameter = parameters;
+    int i = 0;
+    for (; parameter->type == CONS_TYPE && i < argc; i++) {
+        parameter = cdr(parameter);
+    }
+    if (i < argc) {
+        evaluationError(interp, "Too many parameters in function call.");
+    } else if (parameter->type != NULL_TYPE) {
+        evaluationError(interp, argc == 0 ?
+                        "Not enough parameters in function call." :
+                        "Not enough parameters in fx call.");
+    }
+    Frame *newFrame = takeFrame(interp, parameters);
+    if (newFrame) {
+        Value *binding = newFrame->entered;
+        for (i = 0; i < argc; i++) {
+            cdr(car(binding))->c.car = argv[i];
+            binding = cdr(binding);
+        }
+    } else {
+        newFrame = talloc(sizeof(Frame));
+        Value *bindings = makeNull();
+        parameter = parameters;
+        for (i = 0; i < argc; i++) {
+            bindings = cons(cons(car(parameter), cons(argv[i], makeNull())),
+                            bindings);
+            parameter = cdr(parameter);
+        }
+        newFrame->entered = reverse(bindings);
+        newFrame->bindings = newFrame->entered;
+    }
+    newFrame->parent = (function->k).frame;
+    pushLiveFrame(interp, newFrame);
+    return newFrame;
+}
+
+/*
+* Applies a closure marked reusesFrames by evalLambda, whose parameters are
+* a list of distinct symbols, to the argc values in argv, in a frame kept
+* from an earlier call with the same parameter list if there is one. The
+* frame's bindings follow the order of the parameters, so they serve as
+* slots the arguments are stored straight into.
+*/
+static Value *applyInReusedFrame(Interpreter *interp, Value *function,
+                                 int argc, Value **argv) {
+    Frame *newFrame = enterReusedFrame(interp, function, argc, argv);
+    Value *result;
+    if (tracing || profiling) {
+        result = evalInstrumented(interp, function, newFrame);
+    } else {
+        result = eval(interp, (function->k).function, newFrame);
+    }
+    interp->liveDepth--;
+    returnFrame(interp, (function->k).parameters, newFrame);
+    return result;
+}
+
 /*
 * Applies the given function to the given arguments.
 */
-Value *apply(Value *function, Value *args) {
-    Frame *newFrame = talloc(sizeof(Frame));
+Value *apply(Interpreter *interp, Value *function, Value *args) {
+    if (function->type == ESCAPE_TYPE) {
+        applyEscape(interp, function, args);
+    }
     if (!(function->type == CLOSURE_TYPE ||
           function->type == PRIMITIVE_TYPE)) {
-        evaluationError("function should be closure or primitive type");
+        evaluationError(interp, "function should be closure or primitive type");
     }
     if (function->type == PRIMITIVE_TYPE) {
-        return (function->pf)(args);
+        if (tracing) {
+            traceEnter((function->pr).name, TRACE_PRIMITIVE);
+            Value *result = ((function->pr).pf)(interp, args);
+            traceExit((function->pr).name, TRACE_PRIMITIVE);
+            return result;
+        }
+        return ((function->pr).pf)(interp, args);
+    }
+    if ((function->k).memo) {
+        return applyMemoized(interp, function, args);
+    }
+    if ((function->k).reusesFrames) {
+        int argc = 0;
+        for (Value *arg = args; arg->type == CONS_TYPE; arg = cdr(arg)) {
+            argc++;
+        }
+        int depth = interp->argumentDepth;
+        Value **argv = pushArguments(interp, argc);
+        for (int i = 0; i < argc; i++) {
+            argv[i] = car(args);
+            args = cdr(args);
+        }
+        Value *result = applyInReusedFrame(interp, function, argc, argv);
+        interp->argumentDepth = depth;
+        return result;
     }
+    Frame *newFrame = talloc(sizeof(Frame));
     newFrame->parent = (function->k).frame;
     Value *bindings = makeNull();
     Value *newValue; // e.g., newValue = v1
@@ -145,19 +482,19 @@ Value *apply(Value *function, Value *args) {
     } else { // n-adic, must bind multiple things
         // args is null and parameters aren't
         if (args->type == NULL_TYPE && parameters->type != NULL_TYPE) {
-            evaluationError("Not enough parameters in function call.");
+            evaluationError(interp, "Not enough parameters in function call.");
         } else if (parameters->type == NULL_TYPE && args->type != NULL_TYPE) {
-            evaluationError("Too many parameters in function call.");
+            evaluationError(interp, "Too many parameters in function call.");
         } else if (parameters->type == NULL_TYPE && args->type == NULL_TYPE) {
 
         } else {
             while (args->type != NULL_TYPE) {
                 if (parameters->type == NULL_TYPE) {
-                    evaluationError("Too many parameters in function call.");
+                    evaluationError(interp, "Too many parameters in function call.");
                 }
                 // variadic case: handle "." as a parameter
                 else if (car(parameters)->type == DOT_TYPE) {
-                    bindings = addVariadicBinding(parameters, args, bindings);
+                    bindings = addVariadicBinding(interp, parameters, args, bindings);
                     parameters = makeNull();
                     args = makeNull();
                 } else {
@@ -172,32 +509,60 @@ Value *apply(Value *function, Value *args) {
             }
             if (parameters->type != NULL_TYPE) {
                 if (car(parameters)->type == DOT_TYPE) {
-                    bindings = addVariadicBinding(parameters, args, bindings);
+                    bindings = addVariadicBinding(interp, parameters, args, bindings);
                     parameters = makeNull();
                     args = makeNull();
                 } else {
-                    evaluationError("Not enough parameters in fx call.");
+                    evaluationError(interp, "Not enough parameters in fx call.");
                 }
             }
         }
     }
     newFrame->bindings = bindings;
-    return eval((function->k).function, newFrame);
+    pushLiveFrame(interp, newFrame);
+    Value *result;
+    if (tracing || profiling) {
+        result = evalInstrumented(interp, function, newFrame);
+    } else {
+        result = eval(interp, (function->k).function, newFrame);
+    }
+    interp->liveDepth--;
+    return result;
 }
 
 /*
-* Binds the string 'name' to the function in the given frame
+* Binds the string 'name' to a primitive that, besides 'function', has entry
+* points taking one argument, two arguments or an argument vector. Any of
+* them may be NULL; calls no entry point fits go through 'function'.
 */
-void bind(char *name, Value *(*function)(Value *), Frame *frame) {
+static void bindFastPrimitive(char *name,
+                              Value *(*function)(Interpreter *, Value *),
+                              Value *(*function1)(Interpreter *, Value *),
+                              Value *(*function2)(Interpreter *, Value *,
+                                                  Value *),
+                              Value *(*functionN)(Interpreter *, int,
+                                                  Value **),
+                              Frame *frame) {
     Value *value = makeNull();
     value->type = PRIMITIVE_TYPE;
-    value->pf = function;
-    Value *newBinding = cons(value, makeNull());
+    (value->pr).pf = function;
+    (value->pr).name = name;
+    (value->pr).pf1 = function1;
+    (value->pr).pf2 = function2;
+    (value->pr).pfn = functionN;
     Value *nameVal = makeNull();
     nameVal->type = SYMBOL_TYPE;
     nameVal->s = name;
-    newBinding = cons(nameVal, newBinding);
-    frame->bindings = cons(newBinding, frame->bindings);
+    // rebinds the cell if name is already bound, as schemeDefine may do
+    defineSymbol(nameVal, value, frame);
+}
+
+/*
+* Binds the string 'name' to the function in the given frame
+*/
+void bindPrimitive(char *name, Value *(*function)(Interpreter *, Value *),
+                   Frame *frame) {
+    bindFastPrimitive(name, function, NULL, NULL, NULL, frame);
 }
 
 
@@ -215,156 +580,184 @@ void bind(char *name, Value *(*function)(Value *), Frame *frame) {
 
 
 /*
-* Given a list of values, returns their sum if all values are numbers.
-* Otherwise, throws an evaluation error.
+* A running result of +, - or *: an int until a double is involved.
 */
-Value *primitiveAdd(Value *args) {
-    if (! (args->type == CONS_TYPE || args->type == NULL_TYPE)) {
-        evaluationError("Wrong argument type provided for +");
+typedef struct {
+    bool isDouble;
+    int i;
+    double d;
+} Number;
+
+static void operandTypeError(Interpreter *interp, char op) {
+    char message[] = "Wrong argument type provided for +";
+    message[strlen(message) - 1] = op;
+    evaluationError(interp, message);
+}
+
+/*
+* Starts 'result' at 'operand', the first operand of op.
+*/
+static void firstOperand(Interpreter *interp, Number *result, char op,
+                         Value *operand) {
+    result->isDouble = operand->type == DOUBLE_TYPE;
+    result->i = 0;
+    result->d = 0.0;
+    if (operand->type == INT_TYPE) {
+        result->i = operand->i;
+    } else if (operand->type == DOUBLE_TYPE) {
+        result->d = operand->d;
+    } else {
+        operandTypeError(interp, op);
     }
-    int sum = 0;
-    double dSum = 0.0;
-    bool isDouble = false;
-    while (args->type == CONS_TYPE) {
-        Value *cur = car(args);
-        if (! (cur->type == INT_TYPE || cur->type == DOUBLE_TYPE)) {
-            evaluationError("Wrong argument type provided for +");
-        }
-        if (isDouble) { // current sum is a double
-            if (cur->type == INT_TYPE) {
-                dSum += cur->i;
-            } else {
-                dSum += cur->d;
-            }
-        } else if (cur->type == INT_TYPE) { // keep current sum as an int
-            sum += cur->i;
-        } else { // current sum is an int but needs to change to a double
-            dSum = sum;
-            dSum += cur->d;
-            isDouble = true;
+}
+
+/*
+* Combines 'operand' into 'result' with op, which is '+', '-' or '*'.
+* Raises an error naming op if operand is not a number.
+*/
+static void accumulate(Interpreter *interp, Number *result, char op,
+                       Value *operand) {
+    if (operand->type == INT_TYPE && !result->isDouble) {
+        // keep the result as an int
+        if (op == '+') {
+            result->i += operand->i;
+        } else if (op == '-') {
+            result->i -= operand->i;
+        } else {
+            result->i *= operand->i;
         }
-        args = cdr(args);
+        return;
+    }
+    double d;
+    if (operand->type == INT_TYPE) {
+        d = operand->i;
+    } else if (operand->type == DOUBLE_TYPE) {
+        d = operand->d;
+    } else {
+        operandTypeError(interp, op);
+    }
+    if (!result->isDouble) { // the result needs to change to a double
+        result->d = result->i;
+        result->isDouble = true;
+    }
+    if (op == '+') {
+        result->d += d;
+    } else if (op == '-') {
+        result->d -= d;
+    } else {
+        result->d *= d;
     }
+}
+
+static Value *numberValue(Number *number) {
     Value *newVal = makeNull();
-    if (isDouble) {
+    if (number->isDouble) {
         newVal->type = DOUBLE_TYPE;
-        newVal->d = dSum;
+        newVal->d = number->d;
         return newVal;
     }
     newVal->type = INT_TYPE;
-    newVal->i = sum;
+    newVal->i = number->i;
     return newVal;
 }
 
+/*
+* Given a list of values, returns their sum if all values are numbers.
+* Otherwise, throws an evaluation error.
+*/
+Value *primitiveAdd(Interpreter *interp, Value *args) {
+    if (! (args->type == CONS_TYPE || args->type == NULL_TYPE)) {
+        evaluationError(interp, "Wrong argument type provided for +");
+    }
+    Number sum = {false, 0, 0.0};
+    for (; args->type == CONS_TYPE; args = cdr(args)) {
+        accumulate(interp, &sum, '+', car(args));
+    }
+    return numberValue(&sum);
+}
+
+static Value *add2(Interpreter *interp, Value *a, Value *b) {
+    Number sum = {false, 0, 0.0};
+    accumulate(interp, &sum, '+', a);
+    accumulate(interp, &sum, '+', b);
+    return numberValue(&sum);
+}
+
+static Value *addN(Interpreter *interp, int argc, Value **argv) {
+    Number sum = {false, 0, 0.0};
+    for (int i = 0; i < argc; i++) {
+        accumulate(interp, &sum, '+', argv[i]);
+    }
+    return numberValue(&sum);
+}
+
 /*
 * Given a list of values, returns their product if all values are numbers.
 * Otherwise, throws an evaluation error.
 */
-Value *primitiveMultiply(Value *args) {
+Value *primitiveMultiply(Interpreter *interp, Value *args) {
     if (! (args->type == CONS_TYPE || args->type == NULL_TYPE)) {
-        evaluationError("Wrong argument type provided for *");
+        evaluationError(interp, "Wrong argument type provided for *");
     }
-    int iProd = 1;
-    double dProd = 1.0;
-    bool isDouble = false;
-    while (args->type == CONS_TYPE) {
-        Value *cur = car(args);
-        if (! (cur->type == INT_TYPE || cur->type == DOUBLE_TYPE)) {
-            evaluationError("Wrong argument type provided for *");
-        }
-        if (isDouble) { // current product is a double
-            if (cur->type == INT_TYPE) {
-                dProd *= cur->i;
-            } else {
-                dProd *= cur->d;
-            }
-        } else if (cur->type == INT_TYPE) { // keep current product as int
-            iProd *= cur->i;
-        } else { // current product is int but needs to change to double
-            dProd = iProd;
-            dProd *= cur->d;
-            isDouble = true;
-        }
-        args = cdr(args);
+    Number product = {false, 1, 1.0};
+    for (; args->type == CONS_TYPE; args = cdr(args)) {
+        accumulate(interp, &product, '*', car(args));
     }
-    Value *newVal = makeNull();
-    if (isDouble) {
-        newVal->type = DOUBLE_TYPE;
-        newVal->d = dProd;
-        return newVal;
+    return numberValue(&product);
+}
+
+static Value *multiply2(Interpreter *interp, Value *a, Value *b) {
+    Number product = {false, 1, 1.0};
+    accumulate(interp, &product, '*', a);
+    accumulate(interp, &product, '*', b);
+    return numberValue(&product);
+}
+
+static Value *multiplyN(Interpreter *interp, int argc, Value **argv) {
+    Number product = {false, 1, 1.0};
+    for (int i = 0; i < argc; i++) {
+        accumulate(interp, &product, '*', argv[i]);
     }
-    newVal->type = INT_TYPE;
-    newVal->i = iProd;
-    return newVal;
+    return numberValue(&product);
 }
 
 /*
 * Given a list of numbers, subtracts every following number from
 * the first number
 */
-Value *primitiveSubtract(Value *args) {
-    // make sure there are at least two arguments
+Value *primitiveSubtract(Interpreter *interp, Value *args) {
+    // make sure there is at least one argument
     if (args->type != CONS_TYPE) {
-        evaluationError("Wrong number of arguments provided for -");
-    }
-    int iResult;
-    double dResult;
-    bool isDouble = false;
-    if (car(args)->type == INT_TYPE) {
-        iResult = car(args)->i;
-    } else if (car(args)->type == DOUBLE_TYPE) {
-        dResult = car(args)->d;
-        isDouble = true;
-    } else {
-        evaluationError("Wrong argument type provided for -");
+        evaluationError(interp, "Wrong number of arguments provided for -");
     }
+    Number difference;
+    firstOperand(interp, &difference, '-', car(args));
     args = cdr(args);
     if (args->type == NULL_TYPE) { // single arg
-        if (isDouble) {
-            dResult = dResult * -1;
-        } else {
-            iResult = iResult * -1;
-        }
-    }
-    while (args->type == CONS_TYPE) {
-        Value *cur = car(args);
-        if (! (cur->type == INT_TYPE || cur->type == DOUBLE_TYPE)) {
-            evaluationError("Wrong argument type provided for -");
-        }
-        if (isDouble) { // current result is a double
-            if (cur->type == INT_TYPE) {
-                dResult -= cur->i;
-            } else {
-                dResult -= cur->d;
-            }
-        } else if (cur->type == INT_TYPE) { // current result is an int
-                iResult -= cur->i;
-        } else { // current result is an int and needs to change to a double
-            dResult = iResult;
-            dResult -= cur->d;
-            isDouble = true;
-        }
-        args = cdr(args);
+        difference.i = -difference.i;
+        difference.d = -difference.d;
     }
-    Value *newVal = makeNull();
-    if (isDouble) {
-        newVal->type = DOUBLE_TYPE;
-        newVal->d = dResult;
-        return newVal;
+    for (; args->type == CONS_TYPE; args = cdr(args)) {
+        accumulate(interp, &difference, '-', car(args));
     }
-    newVal->type = INT_TYPE;
-    newVal->i = iResult;
-    return newVal;
+    return numberValue(&difference);
+}
+
+static Value *subtract2(Interpreter *interp, Value *a, Value *b) {
+    Number difference;
+    firstOperand(interp, &difference, '-', a);
+    accumulate(interp, &difference, '-', b);
+    return numberValue(&difference);
 }
 
 /*
 * Given a list of numbers, divides the first number by each
 * successive number.
 */
-Value *primitiveDivide(Value *args) {
+Value *primitiveDivide(Interpreter *interp, Value *args) {
     // make sure there is at least one argument
     if (args->type != CONS_TYPE) {
-        evaluationError("Wrong number of arguments provided for /");
+        evaluationError(interp, "Wrong number of arguments provided for /");
     }
     int iResult;
     double dResult;
@@ -375,7 +768,7 @@ Value *primitiveDivide(Value *args) {
         dResult = car(args)->d;
         isDouble = true;
     } else {
-        evaluationError("Wrong argument type provided for /");
+        evaluationError(interp, "Wrong argument type provided for /");
     }
     args = cdr(args);
     if (args->type == NULL_TYPE) { // single argument
@@ -384,7 +777,7 @@ Value *primitiveDivide(Value *args) {
             isDouble = true;
         }
         if (dResult == 0) {
-            evaluationError("Can't divide by zero.");
+            evaluationError(interp, "Can't divide by zero.");
         }
         dResult = 1.0 / dResult;
     }
@@ -393,10 +786,10 @@ Value *primitiveDivide(Value *args) {
         // check division by zero
         if ((cur->type == INT_TYPE && cur->i == 0) ||
             (cur->type == DOUBLE_TYPE && cur->d == 0)) {
-            evaluationError("Cannot divide by zero");
+            evaluationError(interp, "Cannot divide by zero");
         }
         if (! (cur->type == INT_TYPE || cur->type == DOUBLE_TYPE)) {
-            evaluationError("Wrong argument type provided for /");
+            evaluationError(interp, "Wrong argument type provided for /");
         }
         if (isDouble) { // current result is a double
             if (cur->type == INT_TYPE) {
@@ -448,13 +841,13 @@ double getNumber(Value *n) {
 * Given numbers n1, n2, ..., nk, returns true if
 * n1 ≤ n2  ≤ ... ≤ nk, otherwise returns false.
 */
-Value *primitiveLeq(Value *args) {
+Value *primitiveLeq(Interpreter *interp, Value *args) {
     // make sure there are at least two arguments
     if (args->type == NULL_TYPE || cdr(args)->type == NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for <=");
+        evaluationError(interp, "Wrong number of arguments provided for <=");
     }
     if (car(args)->type != INT_TYPE && car(args)->type != DOUBLE_TYPE) {
-        evaluationError("Wrong argument type provided for <=");
+        evaluationError(interp, "Wrong argument type provided for <=");
     }
     Value *result = makeNull();
     result->type = BOOL_TYPE;
@@ -462,7 +855,7 @@ Value *primitiveLeq(Value *args) {
     args = cdr(args);
     while (args->type != NULL_TYPE) {
         if (car(args)->type != INT_TYPE && car(args)->type != DOUBLE_TYPE) {
-            evaluationError("Wrong argument type provided for <=");
+            evaluationError(interp, "Wrong argument type provided for <=");
         }
         if (current > (double)getNumber(car(args))) {
             result->b = false;
@@ -475,6 +868,17 @@ Value *primitiveLeq(Value *args) {
     return result;
 }
 
+static Value *leq2(Interpreter *interp, Value *a, Value *b) {
+    if ((a->type != INT_TYPE && a->type != DOUBLE_TYPE) ||
+        (b->type != INT_TYPE && b->type != DOUBLE_TYPE)) {
+        evaluationError(interp, "Wrong argument type provided for <=");
+    }
+    Value *result = makeNull();
+    result->type = BOOL_TYPE;
+    result->b = getNumber(a) <= getNumber(b);
+    return result;
+}
+
 /*
 * Reverses a scheme list
 */
@@ -492,13 +896,13 @@ Value *reverseList(Value *list) {
 * Given at leat two numbers, returns true iff all numbers are equal.
 * Bound to "="
 */
-Value *primitiveEqSign(Value *args) {
+Value *primitiveEqSign(Interpreter *interp, Value *args) {
     // make sure there are at least two arguments
     if (args->type == NULL_TYPE || cdr(args)->type == NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for =");
+        evaluationError(interp, "Wrong number of arguments provided for =");
     }
-    Value *val1 = primitiveLeq(args);
-    Value *val2 = primitiveLeq(reverseList(args));
+    Value *val1 = primitiveLeq(interp, args);
+    Value *val2 = primitiveLeq(interp, reverseList(args));
     Value *returnVal = makeNull();
     returnVal->type = BOOL_TYPE;
     // true iff n1 ≤ n2  ≤ ... ≤ nk AND nk ≤ ... ≤ n2 ≤ n1
@@ -512,14 +916,7 @@ Value *primitiveEqSign(Value *args) {
 * the same type, being "the same" means different things for different types.
 * See comments inside for specifics.
 */
-Value *primitiveEq(Value *args) {
-    // make sure there are exactly two arguments
-    if (args->type == NULL_TYPE || cdr(args)->type == NULL_TYPE
-        || (cdr(cdr(args)))->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for eq?");
-    }
-    Value *v1 = car(args);
-    Value *v2 = car(cdr(args));
+static Value *eq2(Interpreter *interp, Value *v1, Value *v2) {
     Value *returnVal = makeNull();
     returnVal->type = BOOL_TYPE;
     if (v1->type != v2->type) {
@@ -527,22 +924,23 @@ Value *primitiveEq(Value *args) {
     } else {
         switch (v1->type) {
             case INT_TYPE:
-            case DOUBLE_TYPE:{
+            case DOUBLE_TYPE:
                 // true if they are the same according to "="
-                Value *argList = makeNull();
-                argList = cons(v2, argList);
-                argList = cons(v1, argList);
-                returnVal = primitiveEqSign(argList);
-                break;}
+                returnVal->b = getNumber(v1) == getNumber(v2);
+                break;
             case NULL_TYPE:
+            case EOF_TYPE:
                 // both are the empty list, return true
                 returnVal->b = true;
                 break;
             case SYMBOL_TYPE:
                 // true if they are symbols with the same name
+                returnVal->b = !strcmp(v1->s, v2->s);
+                break;
             case STR_TYPE:
                 // true if they are the same sequence of chars
-                returnVal->b = !strcmp(v1->s, v2->s);
+                returnVal->b = stringLength(v1) == stringLength(v2) &&
+                               !memcmp(v1->s, v2->s, stringLength(v1));
                 break;
             case BOOL_TYPE:
                 // true if they are both true or both false
@@ -551,45 +949,67 @@ Value *primitiveEq(Value *args) {
             case PRIMITIVE_TYPE:
             case CLOSURE_TYPE:
             case CONS_TYPE:
+            case FUTURE_TYPE:
+            case PLACE_TYPE:
+            case TASK_TYPE:
+            case CHANNEL_TYPE:
+            case BUILDER_TYPE:
+            case PORT_TYPE:
+            case MACRO_TYPE:
+            case PROMISE_TYPE:
+            case ESCAPE_TYPE:
                 // true if they have the same pointer
-                returnVal->b = ((int)v1 == (int)v2);
+                returnVal->b = (v1 == v2);
                 break;
             default:
-                evaluationError("Wrong argument type provided for eq?");
+                evaluationError(interp, "Wrong argument type provided for eq?");
                 break;
         }
     }
     return returnVal;
 }
 
+Value *primitiveEq(Interpreter *interp, Value *args) {
+    // make sure there are exactly two arguments
+    if (args->type == NULL_TYPE || cdr(args)->type == NULL_TYPE
+        || (cdr(cdr(args)))->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for eq?");
+    }
+    return eq2(interp, car(args), car(cdr(args)));
+}
+
+static Value *isNull1(Interpreter *interp, Value *arg) {
+    Value *returnVal = makeNull();
+    returnVal->type = BOOL_TYPE;
+    returnVal->b = (arg->type == NULL_TYPE);
+    return returnVal;
+}
+
 /*
 * Given a single argument, returns true iff it is null
 */
-Value *primitiveIsNull(Value *args) {
+Value *primitiveIsNull(Interpreter *interp, Value *args) {
     // make sure there is exactly one argument
     if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for null?");
+        evaluationError(interp, "Wrong number of arguments provided for null?");
     }
-    Value *returnVal = makeNull();
-    returnVal->type = BOOL_TYPE;
-    returnVal->b = (car(args)->type == NULL_TYPE);
-    return returnVal;
+    return isNull1(interp, car(args));
 }
 
 /*
 * Given a number, returns true iff it is the int 0 or the double 0.0
 */
-Value *primitiveZero(Value *args) {
+Value *primitiveZero(Interpreter *interp, Value *args) {
     // make sure there is exactly one argument
     if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for zero?");
+        evaluationError(interp, "Wrong number of arguments provided for zero?");
     }
     Value *returnVal = makeNull();
     returnVal->type = BOOL_TYPE;
     if (car(args)->type == INT_TYPE) {
         returnVal->b = car(args)->i == 0;
     } else if (car(args)->type != DOUBLE_TYPE) {
-        evaluationError("Wrong argument type provided for zero?");
+        evaluationError(interp, "Wrong argument type provided for zero?");
     } else {
         // otherwise it's a double
         returnVal->b = car(args)->d == 0;
@@ -597,82 +1017,99 @@ Value *primitiveZero(Value *args) {
     return returnVal;
 }
 
+static Value *car1(Interpreter *interp, Value *arg) {
+    if (arg->type != CONS_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for car");
+    }
+    return car(arg);
+}
+
 /*
 * Given a Scheme list, returns the car (the first element)
 */
-Value *primitiveCar(Value *args) {
+Value *primitiveCar(Interpreter *interp, Value *args) {
     // make sure there is exactly one argument
     if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for car");
-    } else if (car(args)->type != CONS_TYPE) {
-        evaluationError("Wrong argument type provided for car");
+        evaluationError(interp, "Wrong number of arguments provided for car");
     }
-    return car(car(args));
+    return car1(interp, car(args));
 }
 
-/*
-* Given a Scheme list, returns the cdr (the list without the first element)
-*/
-Value *primitiveCdr(Value *args) {
-    // make sure there is exactly one argument
-    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for cdr");
-    } else if (car(args)->type != CONS_TYPE) {
-        evaluationError("Wrong argument type provided for cdr");
+static Value *cdr1(Interpreter *interp, Value *currArg) {
+    if (currArg->type != CONS_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for cdr");
     }
-    Value *currArg = car(args);
     if (cdr(currArg)->type == CONS_TYPE &&
         car(cdr(currArg))->type == DOT_TYPE) {
         // need to remove . in list
         Value *newArgs = cdr(cdr(currArg));
         if (newArgs->type != CONS_TYPE || cdr(newArgs)->type != NULL_TYPE) {
-            evaluationError("Wrong number of arguments after . in list");
+            evaluationError(interp, "Wrong number of arguments after . in list");
         }
         return car(newArgs);
     }
-    return cdr(car(args));
+    return cdr(currArg);
+}
+
+/*
+* Given a Scheme list, returns the cdr (the list without the first element)
+*/
+Value *primitiveCdr(Interpreter *interp, Value *args) {
+    // make sure there is exactly one argument
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for cdr");
+    }
+    return cdr1(interp, car(args));
 }
 
 /*
 * Given a1, a2, returns the dotted pair (a1 . a2)
 */
-Value *primitiveCons(Value *args) {
+Value *primitiveCons(Interpreter *interp, Value *args) {
     // make sure there are exactly two arguments
     if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
        cdr(cdr(args))->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for cons");
+        evaluationError(interp, "Wrong number of arguments provided for cons");
     }
     return cons(car(args), car(cdr(args)));
 }
 
+static Value *cons2(Interpreter *interp, Value *a, Value *b) {
+    return cons(a, b);
+}
+
 /*
 * Scheme function to throw an error, printing any given message
 */
-Value *primitiveError(Value *args) {
+Value *primitiveError(Interpreter *interp, Value *args) {
     if (args->type == NULL_TYPE) {
-        evaluationError("Error thrown by (error)");
+        evaluationError(interp, "Error thrown by (error)");
     } else if (args->type == CONS_TYPE && car(args)->type == STR_TYPE
                 && cdr(args)->type == NULL_TYPE) {
-        evaluationError(car(args)->s);
+        evaluationError(interp, car(args)->s);
     } else {
-        evaluationError("Invalid syntax in error");
+        evaluationError(interp, "Invalid syntax in error");
     }
     Value *returnVal = makeNull();
     returnVal->type = VOID_TYPE;
     return returnVal;
 }
 
+static Value *pair1(Interpreter *interp, Value *arg) {
+    Value *result = makeNull();
+    result->type = BOOL_TYPE;
+    result->b = (arg->type == CONS_TYPE);
+    return result;
+}
+
 /*
 * Check if given argument is a pair, return true if so.
 */
-Value *primitivePair(Value *args) {
+Value *primitivePair(Interpreter *interp, Value *args) {
     if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for pair? ");
+        evaluationError(interp, "Wrong number of arguments provided for pair? ");
     }
-    Value *result = makeNull();
-    result->type = BOOL_TYPE;
-    result->b = (car(args)->type == CONS_TYPE);
-    return result;
+    return pair1(interp, car(args));
 }
 
 /*
@@ -680,11 +1117,11 @@ Value *primitivePair(Value *args) {
 * Check if that argument is a list, if so, return true via a Value*, else
 * return false.
 */
-Value *primitiveList(Value *args) {
+Value *primitiveList(Interpreter *interp, Value *args) {
     Value *result = makeNull();
     result->type = BOOL_TYPE;
     if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
-        evaluationError("Provided the wrong number of arguments for list? ");
+        evaluationError(interp, "Provided the wrong number of arguments for list? ");
     }
     args = car(args);
     while (args->type == CONS_TYPE) {
@@ -704,10 +1141,10 @@ Value *primitiveList(Value *args) {
 * C version of apply with the car as the procedure and the remaining items
 * as args.
 */
-Value *primitiveApply(Value *args) {
+Value *primitiveApply(Interpreter *interp, Value *args) {
     Value *result;
     if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE) {
-        evaluationError("Wrong number of arguments for primitive apply.");
+        evaluationError(interp, "Wrong number of arguments for primitive apply.");
     }
     Value *proc = car(args);
     args = cdr(args);
@@ -716,7 +1153,7 @@ Value *primitiveApply(Value *args) {
         newArgs = cons(car(args), newArgs);
         args = cdr(args);
     }
-    Value *primitiveFirst = primitiveList(cons(car(newArgs), makeNull()));
+    Value *primitiveFirst = primitiveList(interp, cons(car(newArgs), makeNull()));
     if (primitiveFirst->b) {
         assert(newArgs->type == CONS_TYPE);
         Value *newList = car(newArgs);
@@ -725,24 +1162,47 @@ Value *primitiveApply(Value *args) {
             newList = cons(car(newArgs), newList);
             newArgs = cdr(newArgs);
         }
-        result = apply(proc, newList);
+        result = apply(interp, proc, newList);
     } else {
-        evaluationError("Last argument for primitive apply is not a list");
+        evaluationError(interp, "Last argument for primitive apply is not a list");
     }
     return result;
 }
 
+static Value *number1(Interpreter *interp, Value *arg) {
+    Value *returnVal = makeNull();
+    returnVal->type = BOOL_TYPE;
+    returnVal->b = (arg->type == INT_TYPE || arg->type == DOUBLE_TYPE);
+    return returnVal;
+}
+
 /*
 * Returns true if the given Value is a number
 */
-Value *primitiveNumber(Value *args) {
+Value *primitiveNumber(Interpreter *interp, Value *args) {
     if (args->type == NULL_TYPE || cdr(args)->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for number?");
+        evaluationError(interp, "Wrong number of arguments provided for number?");
+    }
+    return number1(interp, car(args));
+}
+
+/*
+* Given a file name, writes every object reachable from the global frame and
+* the live call frames to that file (see heapdump.h for the format).
+*/
+Value *primitiveHeapDump(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for heap-dump");
+    }
+    if (car(args)->type != STR_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for heap-dump");
+    }
+    if (!heapDump(car(args)->s, interp->global, interp->liveFrames,
+                  interp->liveDepth)) {
+        evaluationError(interp, "The heap dump file could not be written");
     }
     Value *returnVal = makeNull();
-    returnVal->type = BOOL_TYPE;
-    returnVal->b = (car(args)->type == INT_TYPE ||
-                    car(args)->type == DOUBLE_TYPE);
+    returnVal->type = VOID_TYPE;
     return returnVal;
 }
 
@@ -758,6 +1218,73 @@ Value *primitiveNumber(Value *args) {
 **********************************************************************
 *********************************************************************/
 
+/*
+* (raise obj) abandons the current evaluation, passing obj to the innermost
+* exception handler. Uncaught, it is reported like an evaluation error.
+*/
+Value *primitiveRaise(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for raise");
+    }
+    char *text;
+    size_t size;
+    FILE *out = open_memstream(&text, &size);
+    fprintf(out, "Evaluation Error: Uncaught exception: ");
+    writeValue(out, car(args));
+    fprintf(out, "\n");
+    fclose(out);
+    char *message = talloc(size + 1);
+    strcpy(message, text);
+    free(text);
+    raiseObject(interp, car(args), message);
+    return makeNull();
+}
+
+/*
+* (with-exception-handler handler thunk) calls thunk with no arguments and
+* returns its value. If an error is raised while it runs, the evaluation is
+* abandoned back to this point and the result is (handler obj) instead, obj
+* being the raised object or, for other errors, the message as a string.
+* Unlike R7RS, the handler therefore runs after unwinding, as in guard.
+*/
+Value *primitiveWithExceptionHandler(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for "
+                        "with-exception-handler");
+    }
+    Value *handler = car(args);
+    Value *thunk = car(cdr(args));
+    if ((handler->type != CLOSURE_TYPE && handler->type != PRIMITIVE_TYPE) ||
+        (thunk->type != CLOSURE_TYPE && thunk->type != PRIMITIVE_TYPE)) {
+        evaluationError(interp, "Wrong argument type provided for "
+                        "with-exception-handler");
+    }
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (setjmp(onError)) {
+        restore(interp, &saved);
+        if (interp->escaping) {
+            // not an error: pass it on to its call/ec (see escape.h)
+            raiseObject(interp, interp->raised, interp->error);
+        }
+        Value *object = interp->raised;
+        if (!object) {
+            // a syntax error from load: pass the message without its newline
+            object = makeNull();
+            object->type = STR_TYPE;
+            object->s = talloc(strlen(interp->error) + 1);
+            strcpy(object->s, interp->error);
+            object->s[strcspn(object->s, "\n")] = '\0';
+        }
+        return apply(interp, handler, cons(object, makeNull()));
+    }
+    Value *result = apply(interp, thunk, makeNull());
+    restore(interp, &saved);
+    return result;
+}
+
 /*
 * Makes and returns a frame with NULL parent
 */
@@ -770,63 +1297,296 @@ Frame *makeFrame() {
 }
 
 /*
-* Given a list of S-expressions (i.e., the output of parser), calls eval on
-* each S-expression in the top-level environment. Prints the result of each
-* eval.
+* Returns a short name for a top-level form, for use in traces: the name
+* being defined for (define name ...), otherwise the operator of the form.
+*/
+char *formName(Value *form) {
+    if (form->type != CONS_TYPE) {
+        return "toplevel";
+    }
+    Value *first = car(form);
+    if (first->type != SYMBOL_TYPE) {
+        return "toplevel";
+    }
+    if (!strcmp(first->s, "define") && cdr(form)->type == CONS_TYPE &&
+        car(cdr(form))->type == SYMBOL_TYPE) {
+        return car(cdr(form))->s;
+    }
+    return first->s;
+}
+
+/*
+* Creates an interpreter instance with its own heap, which becomes the
+* calling thread's current heap, and a global frame holding the primitive
+* procedures. Source is read from stdin until interp->in is changed.
 */
-void interpret(Value *tree, Frame *frame) {
+Interpreter *makeInterpreter() {
+    Interpreter *interp = malloc(sizeof(Interpreter));
+    assert(interp);
+    interp->heap = makeHeap();
+    tswitch(interp->heap);
+    interp->in = stdin;
+    interp->input = NULL;
+    interp->escapes = NULL;
+    interp->escaping = NULL;
+    interp->onError = NULL;
+    interp->error = NULL;
+    interp->raised = NULL;
+    interp->errorCount = 0;
+    interp->optimizations = OPTIMIZE_ALL;
+    interp->futures = makeFutureSet();
+    interp->scheduler = NULL;
+    interp->events = NULL;
+    interp->framePool = NULL;
+    interp->liveFrames = NULL;
+    interp->liveDepth = 0;
+    interp->liveCapacity = 0;
+    interp->arguments = NULL;
+    interp->argumentDepth = 0;
+    Frame *frame = makeFrame();
+    interp->global = frame;
+
     // Add bindings for primitive functions
-    bind("+", primitiveAdd, frame);
-    bind("null?", primitiveIsNull, frame);
-    bind("car", primitiveCar, frame);
-    bind("cdr", primitiveCdr, frame);
-    bind("cons", primitiveCons, frame);
-    bind("*", primitiveMultiply, frame);
-    bind("-", primitiveSubtract, frame);
-    bind("<=", primitiveLeq, frame);
-    bind("/", primitiveDivide, frame);
-    bind("eq?", primitiveEq, frame);
-    bind("apply", primitiveApply, frame);
-    bind("error", primitiveError, frame);
-    bind("pair?", primitivePair, frame);
-    bind("number?", primitiveNumber, frame);
+    bindFastPrimitive("+", primitiveAdd, NULL, add2, addN, frame);
+    bindFastPrimitive("null?", primitiveIsNull, isNull1, NULL, NULL, frame);
+    bindFastPrimitive("car", primitiveCar, car1, NULL, NULL, frame);
+    bindFastPrimitive("cdr", primitiveCdr, cdr1, NULL, NULL, frame);
+    bindFastPrimitive("cons", primitiveCons, NULL, cons2, NULL, frame);
+    bindFastPrimitive("*", primitiveMultiply, NULL, multiply2, multiplyN,
+                      frame);
+    bindFastPrimitive("-", primitiveSubtract, NULL, subtract2, NULL, frame);
+    bindFastPrimitive("<=", primitiveLeq, NULL, leq2, NULL, frame);
+    bindPrimitive("/", primitiveDivide, frame);
+    bindFastPrimitive("eq?", primitiveEq, NULL, eq2, NULL, frame);
+    bindPrimitive("apply", primitiveApply, frame);
+    bindPrimitive("error", primitiveError, frame);
+    bindFastPrimitive("pair?", primitivePair, pair1, NULL, NULL, frame);
+    bindFastPrimitive("number?", primitiveNumber, number1, NULL, NULL, frame);
+    bindPrimitive("heap-dump", primitiveHeapDump, frame);
+    bindPrimitive("raise", primitiveRaise, frame);
+    bindPrimitive("with-exception-handler", primitiveWithExceptionHandler,
+                  frame);
+    bindPrimitive("parallel-map", primitiveParallelMap, frame);
+    bindPrimitive("parallel-for-each", primitiveParallelForEach, frame);
+    bindPrimitive("parallel-reduce", primitiveParallelReduce, frame);
+    bindPrimitive("future", primitiveFuture, frame);
+    bindPrimitive("touch", primitiveTouch, frame);
+    bindPrimitive("future-stats", primitiveFutureStats, frame);
+    bindPrimitive("dynamic-place", primitiveDynamicPlace, frame);
+    bindPrimitive("place-channel-put", primitivePlaceChannelPut, frame);
+    bindPrimitive("place-channel-get", primitivePlaceChannelGet, frame);
+    bindPrimitive("place-wait", primitivePlaceWait, frame);
+    bindPrimitive("spawn", primitiveSpawn, frame);
+    bindPrimitive("yield", primitiveYield, frame);
+    bindPrimitive("sleep", primitiveSleep, frame);
+    bindPrimitive("join", primitiveJoin, frame);
+    bindPrimitive("make-channel", primitiveMakeChannel, frame);
+    bindPrimitive("channel-send", primitiveChannelSend, frame);
+    bindPrimitive("channel-receive", primitiveChannelReceive, frame);
+    bindPrimitive("make-pipe", primitiveMakePipe, frame);
+    bindPrimitive("unix-listen", primitiveUnixListen, frame);
+    bindPrimitive("unix-accept", primitiveUnixAccept, frame);
+    bindPrimitive("unix-connect", primitiveUnixConnect, frame);
+    bindPrimitive("on-readable", primitiveOnReadable, frame);
+    bindPrimitive("fd-write", primitiveFdWrite, frame);
+    bindPrimitive("fd-close", primitiveFdClose, frame);
+    bindPrimitive("set-timer", primitiveSetTimer, frame);
+    bindPrimitive("cancel-timer", primitiveCancelTimer, frame);
+    bindPrimitive("run-loop", primitiveRunLoop, frame);
+    bindPrimitive("memoize", primitiveMemoize, frame);
+    bindPrimitive("memo-stats", primitiveMemoStats, frame);
+    bindPrimitive("memo-clear!", primitiveMemoClear, frame);
+    bindPrimitive("string-length", primitiveStringLength, frame);
+    bindPrimitive("substring", primitiveSubstring, frame);
+    bindPrimitive("string-append", primitiveStringAppend, frame);
+    bindPrimitive("string-search", primitiveStringSearch, frame);
+    bindPrimitive("string-index", primitiveStringIndex, frame);
+    bindPrimitive("string-builder", primitiveStringBuilder, frame);
+    bindPrimitive("string-builder-append!", primitiveStringBuilderAppend,
+                  frame);
+    bindPrimitive("string-builder->string", primitiveStringBuilderToString,
+                  frame);
+    bindPrimitive("open-input-file", primitiveOpenInputFile, frame);
+    bindPrimitive("open-input-string", primitiveOpenInputString, frame);
+    bindPrimitive("close-input-port", primitiveCloseInputPort, frame);
+    bindPrimitive("read-char", primitiveReadChar, frame);
+    bindPrimitive("peek-char", primitivePeekChar, frame);
+    bindPrimitive("read-line", primitiveReadLine, frame);
+    bindPrimitive("read", primitiveRead, frame);
+    bindPrimitive("eof-object?", primitiveIsEofObject, frame);
+    bindPrimitive("with-input-from-file", primitiveWithInputFromFile, frame);
+    bindPrimitive("fasl-write", primitiveFaslWrite, frame);
+    bindPrimitive("fasl-read", primitiveFaslRead, frame);
+    bindPrimitive("force", primitiveForce, frame);
+    bindPrimitive("make-promise", primitiveMakePromise, frame);
+    bindPrimitive("promise?", primitiveIsPromise, frame);
+    bindPrimitive("stream-car", primitiveStreamCar, frame);
+    bindPrimitive("stream-cdr", primitiveStreamCdr, frame);
+    bindPrimitive("stream-take", primitiveStreamTake, frame);
+    bindPrimitive("call/ec", primitiveCallEc, frame);
+    bindPrimitive("call-with-escape-continuation", primitiveCallEc, frame);
+    return interp;
+}
 
-    Value *cur;
+/*
+* Creates an instance sharing the parent's global frame, with its own heap.
+*/
+Interpreter *makeWorker(Interpreter *parent) {
+    Interpreter *worker = malloc(sizeof(Interpreter));
+    assert(worker);
+    *worker = *parent;
+    worker->heap = makeHeap();
+    worker->onError = NULL;
+    worker->escapes = NULL;
+    worker->escaping = NULL;
+    worker->error = NULL;
+    worker->raised = NULL;
+    worker->errorCount = 0;
+    worker->liveFrames = NULL;
+    worker->liveDepth = 0;
+    worker->liveCapacity = 0;
+    worker->arguments = NULL;
+    worker->argumentDepth = 0;
+    worker->scheduler = NULL;
+    worker->events = NULL;
+    worker->framePool = NULL;
+    return worker;
+}
+
+/*
+* Frees a worker, leaving its heap to the caller.
+*/
+void releaseWorker(Interpreter *worker) {
+    if (worker->scheduler) {
+        destroyScheduler(worker->scheduler);
+    }
+    if (worker->events) {
+        destroyEventLoop(worker->events);
+    }
+    free(worker->framePool);
+    free(worker->liveFrames);
+    free(worker->arguments);
+    free(worker);
+}
+
+/*
+* Frees everything the interpreter allocated, including its heap.
+*/
+void destroyInterpreter(Interpreter *interp) {
+    destroyFutureSet(interp->futures);
+    if (interp->scheduler) {
+        destroyScheduler(interp->scheduler);
+    }
+    if (interp->events) {
+        destroyEventLoop(interp->events);
+    }
+    tdestroy(interp->heap);
+    free(interp->framePool);
+    free(interp->liveFrames);
+    free(interp->arguments);
+    free(interp);
+}
+
+/*
+* Evaluates one top-level form and prints its value. If it raises an error,
+* the message is printed and counted, and whatever the form had in progress
+* is abandoned.
+*/
+void interpretForm(Interpreter *interp, Value *form) {
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (setjmp(onError)) {
+        restore(interp, &saved);
+        printf("%s", interp->error);
+        interp->errorCount++;
+        return;
+    }
+    char *name = NULL;
+    if (tracing) {
+        name = formName(form);
+        traceEnter(name, TRACE_TOPLEVEL);
+    }
+    Value *val = eval(interp, optimize(interp, form), interp->global);
+    if (tracing) {
+        traceExit(name, TRACE_TOPLEVEL);
+    }
+    printResult(val);
+    restore(interp, &saved);
+}
+
+/*
+* Given a list of S-expressions (i.e., the output of parser), calls eval on
+* each S-expression in the top-level environment. Prints the result of each
+* eval, or the error it raised.
+*/
+void interpret(Interpreter *interp, Value *tree) {
     while (tree->type == CONS_TYPE) {
-        cur = car(tree);
-        Value *val = eval(cur, frame);
-        printValue(val);
-        if (val->type != VOID_TYPE) {
-            printf("\n");
+        interpretForm(interp, car(tree));
+        tree = cdr(tree);
+    }
+}
+
+/*
+* Returns the cell of 'name' in 'frame' alone: the pair whose car is its
+* value, which stays the same when the binding is redefined or set!.
+* Returns NULL if the frame does not bind it.
+*/
+Value *findCell(Frame *frame, char *name) {
+    // pairs with the release in defineSymbol: futures and parallel workers
+    // may look up globals while another thread defines new ones
+    Value *bindings = __atomic_load_n(&frame->bindings, __ATOMIC_ACQUIRE);
+    while (bindings->type == CONS_TYPE) {
+        Value *cur = car(bindings);
+        assert(cur->type == CONS_TYPE);
+        Value *curSymbol = car(cur);
+        assert(curSymbol->type == SYMBOL_TYPE);
+        if (!strcmp(curSymbol->s, name)) {
+            return cdr(cur);
+        }
+        bindings = cdr(bindings);
+    }
+    return NULL;
+}
+
+/*
+* Returns the cell 'symbol' refers to from 'frame', or NULL if it is
+* unbound. Local frames are searched every time, since they are small and
+* an internal define may add to them. A global binding is searched for
+* only until it is found: the symbol, which is the reference site in the
+* code, then keeps its cell, and define and set! update cells in place.
+*/
+static Value *lookUpCell(Value *symbol, Frame *frame) {
+    while (frame->parent) {
+        Value *cell = findCell(frame, symbol->s);
+        if (cell) {
+            return cell;
+        }
+        frame = frame->parent;
+    }
+    Value *cell = __atomic_load_n(&symbol->cell, __ATOMIC_ACQUIRE);
+    if (!cell) {
+        cell = findCell(frame, symbol->s);
+        if (cell) {
+            __atomic_store_n(&symbol->cell, cell, __ATOMIC_RELEASE);
         }
-        tree = cdr(tree);
     }
+    return cell;
 }
 
 /*
 * Given a value of symbol type and a frame, looks up the binding of that
 * value in the given environment
 */
-Value *lookUpSymbol(Value *symbol, Frame *frame) {
-    Value *cur;
-    Value *bindings = frame->bindings;
-    while (bindings->type == CONS_TYPE) {
-        cur = car(bindings);
-        assert(cur->type == CONS_TYPE);
-        Value *curSymbol = car(cur);
-        assert(curSymbol->type == SYMBOL_TYPE);
-        if (!strcmp(curSymbol->s, symbol->s)) {
-            return car(cdr(cur));
-        }
-        bindings = cdr(bindings);
-    }
-    if (!frame->parent) {
-        char *msg = talloc(sizeof(symbol->s)*sizeof(char)+28);
+Value *lookUpSymbol(Interpreter *interp, Value *symbol, Frame *frame) {
+    Value *cell = lookUpCell(symbol, frame);
+    if (!cell) {
+        char *msg = talloc(strlen(symbol->s) + 28);
         strcpy(msg, "Failed to find the symbol: ");
         strcat(msg, symbol->s);
-        evaluationError(msg);
+        evaluationError(interp, msg);
     }
-    return lookUpSymbol(symbol, frame->parent);
+    return __atomic_load_n(&cell->c.car, __ATOMIC_ACQUIRE);
 }
 
 /*********************************************************************
@@ -843,17 +1603,27 @@ Value *lookUpSymbol(Value *symbol, Frame *frame) {
 **********************************************************************
 *********************************************************************/
 
+/*
+* Records 'symbol' as the name of 'val' if val is a closure that has not been
+* named yet, so that traces and profiles can refer to it.
+*/
+void nameClosure(Value *val, Value *symbol) {
+    if (val->type == CLOSURE_TYPE && !(val->k).name) {
+        (val->k).name = symbol->s;
+    }
+}
+
 /*
 * Given a proposed new binding within a let, let*, or letrec statement, checks
 * validity by throwing an error if the syntax is incorrect.
 */
-void assertValidSyntax(Value *newBinding) {
+void assertValidSyntax(Interpreter *interp, Value *newBinding) {
     if (newBinding->type != CONS_TYPE || cdr(newBinding)->type != CONS_TYPE) {
-        evaluationError("Missing block in let assignment.");
+        evaluationError(interp, "Missing block in let assignment.");
     } else if (cdr(cdr(newBinding))->type != NULL_TYPE) {
-        evaluationError("Too many blocks provided in let assignment.");
+        evaluationError(interp, "Too many blocks provided in let assignment.");
     } else if (car(newBinding)->type != SYMBOL_TYPE) {
-        evaluationError("Let can only bind to a symbol.");
+        evaluationError(interp, "Let can only bind to a symbol.");
     }
 }
 
@@ -863,12 +1633,13 @@ void assertValidSyntax(Value *newBinding) {
 * by throwing an error if the variable is already bound within the new frame.
 * (in let and letrec, a variable can only appear once in the bindings).
 */
-void assertValidLetSyntax(Value *newBinding, Value *frameBindings) {
+void assertValidLetSyntax(Interpreter *interp, Value *newBinding,
+                          Value *frameBindings) {
     Value *cur;
     while (frameBindings->type == CONS_TYPE) {
         cur = car(frameBindings);
         if (!strcmp(car(newBinding)->s, car(cur)->s)) {
-            evaluationError("Duplicate identifier in let assignment.");
+            evaluationError(interp, "Duplicate identifier in let assignment.");
         }
         frameBindings = cdr(frameBindings);
     }
@@ -878,14 +1649,14 @@ void assertValidLetSyntax(Value *newBinding, Value *frameBindings) {
 * Returns the first false value, if none are false returns the last value.
 * If there are no values given, returns #t
 */
-Value *evalAnd(Value *args, Frame *frame) {
+Value *evalAnd(Interpreter *interp, Value *args, Frame *frame) {
     Value *result = makeNull();
     if (args->type == NULL_TYPE) {
         result->type = BOOL_TYPE;
         result->b = true;
     }
     while (args->type == CONS_TYPE) {
-        result = eval(car(args), frame);
+        result = eval(interp, car(args), frame);
         if (result->type == BOOL_TYPE && !result->b) {
             return result;
         }
@@ -898,14 +1669,14 @@ Value *evalAnd(Value *args, Frame *frame) {
 * Returns the first true (not "#f") value, if none are true returns the last
 * value. If there are no values given, returns #f
 */
-Value *evalOr(Value *args, Frame *frame) {
+Value *evalOr(Interpreter *interp, Value *args, Frame *frame) {
     Value *result = makeNull();
     if (args->type == NULL_TYPE) {
         result->type = BOOL_TYPE;
         result->b = false;
     }
     while (args->type == CONS_TYPE) {
-        result = eval(car(args), frame);
+        result = eval(interp, car(args), frame);
         if ((result->type != BOOL_TYPE || result->b)) {
             return result;
         }
@@ -916,34 +1687,33 @@ Value *evalOr(Value *args, Frame *frame) {
 
 /*
 * Given a list of either 2 or 3 arguments, applies the "if" operator:
-* evaluates the first argument, and if not false, returns the evaluated
-* value of the second argument. Otherwise, returns the evaluated value
-* of the third argument, if one exists.
+* evaluates the first argument, and if not false, returns the second
+* argument. Otherwise, returns the third argument, if one exists, or NULL.
+* eval then evaluates the branch returned in place of the if, so that
+* recursion through if uses no C stack of its own.
 */
-Value *evalIf(Value *args, Frame *frame) {
+static Value *ifBranch(Interpreter *interp, Value *args, Frame *frame) {
     if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE) {
-        evaluationError("Not enough blocks in an if statement");
+        evaluationError(interp, "Not enough blocks in an if statement");
     }
     if (cdr(cdr(args))->type != NULL_TYPE &&
         cdr(cdr(cdr(args)))->type != NULL_TYPE) {
-        evaluationError("Too many blocks in an if statement");
+        evaluationError(interp, "Too many blocks in an if statement");
     }
-    Value *result = eval(car(args), frame);
+    Value *result = eval(interp, car(args), frame);
     if (!(result->type == BOOL_TYPE) || !(result->b==false)) {
-        return eval(car(cdr(args)), frame);
+        return car(cdr(args));
     } else if (cdr(cdr(args))->type != NULL_TYPE) {
-        return eval(car(cdr(cdr(args))), frame);
+        return car(cdr(cdr(args)));
     }
-    Value *voidVal = makeNull();
-    voidVal->type = VOID_TYPE;
-    return voidVal;
+    return NULL;
 }
 
 /*
 * Helper function for evalCond: throws an error if the clause list in cond
 * is not of the correct form.
 */
-void assertValidClauseList(Value *args) {
+void assertValidClauseList(Interpreter *interp, Value *args) {
     Value *clauseList = args;
     while (clauseList->type != NULL_TYPE) {
         Value *curClause = car(clauseList);
@@ -951,13 +1721,13 @@ void assertValidClauseList(Value *args) {
         // check that it is a list of two items
         if (curClause->type != CONS_TYPE || cdr(curClause)->type != CONS_TYPE
             || cdr(cdr(curClause))->type != NULL_TYPE) {
-            evaluationError("Wrong number of items in a cond clause");
+            evaluationError(interp, "Wrong number of items in a cond clause");
         }
         // check that if it is an "else" clause, it is the last one
         if (car(curClause)->type == SYMBOL_TYPE &&
             !strcmp(car(curClause)->s, "else") &&
             clauseList->type != NULL_TYPE) {
-            evaluationError("'else' can only appear as the last clause "
+            evaluationError(interp, "'else' can only appear as the last clause "
                             "in cond statement");
         }
     }
@@ -970,8 +1740,8 @@ void assertValidClauseList(Value *args) {
 * and returns the expr corresponding to that test. If all tests are false and
 * there is no else, returns a void type Value.
 */
-Value *evalCond(Value *args, Frame *frame) {
-    assertValidClauseList(args);
+Value *evalCond(Interpreter *interp, Value *args, Frame *frame) {
+    assertValidClauseList(interp, args);
     Value *returnVal = makeNull();
     returnVal->type = VOID_TYPE;
     Value *result;
@@ -983,10 +1753,10 @@ Value *evalCond(Value *args, Frame *frame) {
             !strcmp(car(curClause)->s, "else")) {
             result = makeNull();
         } else {
-            result = eval(car(curClause), frame);
+            result = eval(interp, car(curClause), frame);
         }
         if (result->type != BOOL_TYPE || result->b == true) {
-            returnVal = eval(car(cdr(curClause)), frame);
+            returnVal = eval(interp, car(cdr(curClause)), frame);
             done = true;
         }
     }
@@ -996,48 +1766,351 @@ Value *evalCond(Value *args, Frame *frame) {
 /*
 * Creates a binding of (x1, e1) within a let or let* statement
 */
-Value *createBinding(Frame *frame, Value *bindings, Value *toBind) {
+Value *createBinding(Interpreter *interp, Frame *frame, Value *bindings,
+                     Value *toBind) {
     assert(toBind->type == CONS_TYPE);
     assert(cdr(toBind)->type == CONS_TYPE);
-    Value *result = eval(car(cdr(toBind)), frame);
+    Value *result = eval(interp, car(cdr(toBind)), frame);
     Value *eCurrBind = cons(result, makeNull());
     eCurrBind = cons(car(toBind), eCurrBind);
     return cons(eCurrBind, bindings);
 }
 
 /*
-* Evaluates (let ((x1 e1) ... (xn en)) body1 ... bodym)
-* Creates a new frame F with given parent frame, evaluates each ei in the
-* parent frame to get vi and binds this to xi in F.
-* Then evaluates body1,...,bodym in frame F and returns the value of bodym
+* Makes the frame of (let ((x1 e1) ... (xn en)) body1 ... bodym), given as
+* 'args' without the let: a new frame F with the given parent frame, in
+* which each xi is bound to the value of ei in the parent frame. Unless
+* the body may capture F, F is taken from and goes back to the frame pool,
+* with *reuse set. Callers pass F to leaveLet when done with it.
 */
-Value *evalLet(Value *args, Frame *frame) {
+static Frame *enterLet(Interpreter *interp, Value *args, Frame *frame,
+                       bool *reuse) {
     if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE) {
-        evaluationError("Not enough blocks after 'let'");
+        evaluationError(interp, "Not enough blocks after 'let'");
     }
-    Frame *newFrame = talloc(sizeof(Frame));
-    newFrame->parent = frame;
-    Value *bindings = makeNull();
+    // Unless the body may capture it, the frame is kept for the next time
+    // this let is evaluated, with its bindings in the order of the xi.
+    FramePoolSlot *slot = framePoolSlot(interp, args);
+    if (!slot->analyzed) {
+        slot->captured = capturesFrame(cdr(args));
+        slot->analyzed = true;
+    }
+    *reuse = !slot->captured;
     Value *toBind = car(args); // e.g., toBind = ((x1 v1) (x2 v2))
-    Value *currBind; // e.g., currBind = (x1 v1)
-    while (toBind->type != NULL_TYPE) {
-        if (toBind->type != CONS_TYPE) {
-            evaluationError("Invalid synax in 'let'");
+    Frame *newFrame = *reuse ? takeFrame(interp, args) : NULL;
+    if (newFrame) {
+        // the same bindings were checked when the frame was made
+        for (Value *binding = newFrame->entered; toBind->type == CONS_TYPE;
+             binding = cdr(binding)) {
+            cdr(car(binding))->c.car = eval(interp, car(cdr(car(toBind))),
+                                            frame);
+            toBind = cdr(toBind);
         }
-        currBind = car(toBind);
-        assertValidSyntax(currBind);
-        assertValidLetSyntax(currBind, bindings);
-        bindings = createBinding(frame, bindings, currBind);
-        toBind = cdr(toBind);
+    } else {
+        newFrame = talloc(sizeof(Frame));
+        Value *bindings = makeNull();
+        Value *currBind; // e.g., currBind = (x1 v1)
+        while (toBind->type != NULL_TYPE) {
+            if (toBind->type != CONS_TYPE) {
+                evaluationError(interp, "Invalid synax in 'let'");
+            }
+            currBind = car(toBind);
+            assertValidSyntax(interp, currBind);
+            assertValidLetSyntax(interp, currBind, bindings);
+            bindings = createBinding(interp, frame, bindings, currBind);
+            toBind = cdr(toBind);
+        }
+        newFrame->entered = *reuse ? reverse(bindings) : bindings;
+        newFrame->bindings = newFrame->entered;
     }
-    newFrame->bindings = bindings;
+    newFrame->parent = frame;
+    pushLiveFrame(interp, newFrame);
+    return newFrame;
+}
+
+static void leaveLet(Interpreter *interp, Value *args, Frame *newFrame,
+                     bool reuse) {
+    interp->liveDepth--;
+    if (reuse) {
+        returnFrame(interp, args, newFrame);
+    }
+}
+
+/*
+* A named let or do running as a loop: the values its variables take in
+* the next iteration, as they are worked out.
+*/
+typedef struct {
+    char *name; // of the named let
+    int count;
+    Value **values;
+} Loop;
+
+/*
+* Evaluates 'expr', in tail position in the body of a named let running as
+* a loop. Returns its value, or NULL if it calls the loop again, with the
+* arguments of the call left in loop->values. Calls in tail position
+* through if, cond, begin and let are found, as onlyTailCalls expects.
+*/
+static Value *evalLoopTail(Interpreter *interp, Value *expr, Frame *frame,
+                           Loop *loop) {
+    if (expr->type != CONS_TYPE || car(expr)->type != SYMBOL_TYPE) {
+        return eval(interp, expr, frame);
+    }
+    char *form = car(expr)->s;
+    Value *args = cdr(expr);
+    int length = listLength(args);
+    if (!strcmp(form, loop->name)) {
+        // every argument is evaluated before any variable changes
+        for (int i = 0; i < loop->count; i++) {
+            loop->values[i] = eval(interp, car(args), frame);
+            args = cdr(args);
+        }
+        return NULL;
+    } else if (!strcmp(form, "if") && (length == 2 || length == 3)) {
+        Value *test = eval(interp, car(args), frame);
+        if (test->type != BOOL_TYPE || test->b) {
+            return evalLoopTail(interp, car(cdr(args)), frame, loop);
+        } else if (length == 3) {
+            return evalLoopTail(interp, car(cdr(cdr(args))), frame, loop);
+        }
+        Value *voidVal = makeNull();
+        voidVal->type = VOID_TYPE;
+        return voidVal;
+    } else if (!strcmp(form, "cond") && length >= 0) {
+        assertValidClauseList(interp, args);
+        for (; args->type == CONS_TYPE; args = cdr(args)) {
+            Value *clause = car(args);
+            if ((car(clause)->type == SYMBOL_TYPE &&
+                 !strcmp(car(clause)->s, "else"))) {
+                return evalLoopTail(interp, car(cdr(clause)), frame, loop);
+            }
+            Value *test = eval(interp, car(clause), frame);
+            if (test->type != BOOL_TYPE || test->b) {
+                return evalLoopTail(interp, car(cdr(clause)), frame, loop);
+            }
+        }
+        Value *voidVal = makeNull();
+        voidVal->type = VOID_TYPE;
+        return voidVal;
+    } else if (!strcmp(form, "begin") && length >= 1) {
+        for (; cdr(args)->type == CONS_TYPE; args = cdr(args)) {
+            eval(interp, car(args), frame);
+        }
+        return evalLoopTail(interp, car(args), frame, loop);
+    } else if (!strcmp(form, "let") && length >= 2 &&
+               car(args)->type != SYMBOL_TYPE) {
+        bool reuse;
+        Frame *newFrame = enterLet(interp, args, frame, &reuse);
+        Value *body = cdr(args);
+        for (; cdr(body)->type == CONS_TYPE; body = cdr(body)) {
+            eval(interp, car(body), newFrame);
+        }
+        Value *result = evalLoopTail(interp, car(body), newFrame, loop);
+        leaveLet(interp, args, newFrame, reuse);
+        return result;
+    }
+    return eval(interp, expr, frame);
+}
+
+/*
+* Evaluates the bindings ((x1 e1 ...) ... (xn en ...)) of a named let or
+* do, given as 'bindings', in 'frame' into values[0] ... values[n-1].
+* Raises an error naming 'form' unless each is a list of a symbol and one
+* to 'most' expressions, and the xi are distinct.
+*/
+static void evalLoopInits(Interpreter *interp, Value *bindings, Frame *frame,
+                          Value **values, int most, char *form) {
+    char message[100];
+    snprintf(message, sizeof(message), "Invalid syntax in '%s'", form);
+    for (int i = 0; bindings->type == CONS_TYPE; bindings = cdr(bindings)) {
+        Value *binding = car(bindings);
+        int length = listLength(binding);
+        if (length < 2 || length > most + 1 ||
+            car(binding)->type != SYMBOL_TYPE) {
+            evaluationError(interp, message);
+        }
+        for (Value *later = cdr(bindings); later->type == CONS_TYPE;
+             later = cdr(later)) {
+            if (car(later)->type == CONS_TYPE &&
+                car(car(later))->type == SYMBOL_TYPE &&
+                !strcmp(car(car(later))->s, car(binding)->s)) {
+                evaluationError(interp, "Duplicate identifier in let assignment.");
+            }
+        }
+        values[i++] = eval(interp, car(cdr(binding)), frame);
+    }
+}
+
+/*
+* Returns a frame binding the variables of 'bindings' to 'values', listed
+* in order in 'entered' as pooled frames are.
+*/
+static Frame *makeLoopFrame(Value *bindings, Value **values, Frame *parent) {
+    Frame *frame = talloc(sizeof(Frame));
+    Value *entered = makeNull();
+    Value *last = NULL;
+    for (int i = 0; bindings->type == CONS_TYPE; bindings = cdr(bindings)) {
+        Value *binding = cons(car(car(bindings)),
+                              cons(values[i++], makeNull()));
+        Value *cell = cons(binding, makeNull());
+        if (last) {
+            last->c.cdr = cell;
+        } else {
+            entered = cell;
+        }
+        last = cell;
+    }
+    frame->entered = entered;
+    frame->bindings = entered;
+    frame->parent = parent;
+    return frame;
+}
+
+/*
+* Starts the next iteration of a loop in 'frame', the frame of the last
+* one: in place if 'reuse', otherwise in a new frame, since closures made
+* in the last iteration may hold on to it. Returns the frame to use.
+*/
+static Frame *nextIteration(Interpreter *interp, Frame *frame, Value *bindings,
+                            Loop *loop, bool reuse) {
+    if (!reuse) {
+        frame = makeLoopFrame(bindings, loop->values, frame->parent);
+        interp->liveFrames[interp->liveDepth - 1] = frame;
+        return frame;
+    }
+    frame->bindings = frame->entered;
+    Value *binding = frame->entered;
+    for (int i = 0; i < loop->count; i++) {
+        cdr(car(binding))->c.car = loop->values[i];
+        binding = cdr(binding);
+    }
+    return frame;
+}
+
+/*
+* Returns the frame for the first iteration of a loop whose form is 'args'
+* and whose variables, listed in 'bindings', start with loop->values: one
+* from the frame pool if 'reuse', otherwise a new one.
+*/
+static Frame *firstIteration(Interpreter *interp, Value *args, Frame *frame,
+                             Value *bindings, Loop *loop, bool reuse) {
+    Frame *loopFrame = reuse ? takeFrame(interp, args) : NULL;
+    if (loopFrame) {
+        loopFrame->parent = frame;
+        loopFrame = nextIteration(interp, loopFrame, bindings, loop, true);
+    } else {
+        loopFrame = makeLoopFrame(bindings, loop->values, frame);
+    }
+    pushLiveFrame(interp, loopFrame);
+    return loopFrame;
+}
+
+/*
+* Evaluates (let name ((x1 e1) ... (xn en)) body1 ... bodym), given as
+* 'args' without the let: binds name, in the scope of the body, to a
+* procedure of x1 ... xn whose body is body1 ... bodym, and calls it with
+* the values of the ei.
+*
+* When name is only called from tail position in the body (see
+* loopsNatively), no procedure is made: the body runs in a loop in one
+* frame, and each call to name sets the xi for the next iteration. The
+* frame comes from the frame pool, and the xi are set in place, unless the
+* body may capture it, when each iteration gets a new frame. Otherwise the
+* named let is evaluated as
+*   ((letrec ((name (lambda (x1 ... xn) (begin body1 ... bodym)))) name)
+*    e1 ... en)
+*/
+static Value *evalNamedLet(Interpreter *interp, Value *args, Frame *frame) {
+    if (cdr(args)->type != CONS_TYPE || cdr(cdr(args))->type != CONS_TYPE) {
+        evaluationError(interp, "Not enough blocks after 'let'");
+    }
+    Value *name = car(args);
+    Value *bindings = car(cdr(args));
+    Value *body = cdr(cdr(args));
+    int count = listLength(bindings);
+    if (count < 0) {
+        evaluationError(interp, "Invalid synax in 'let'");
+    }
+    FramePoolSlot *slot = framePoolSlot(interp, args);
+    if (!slot->analyzed) {
+        slot->captured = capturesFrame(body);
+        slot->loops = loopsNatively(args);
+        slot->analyzed = true;
+    }
+    if (!slot->loops) {
+        Value *variables = makeNull();
+        Value *inits = makeNull();
+        for (Value *b = bindings; b->type == CONS_TYPE; b = cdr(b)) {
+            assertValidSyntax(interp, car(b));
+            variables = cons(car(car(b)), variables);
+            inits = cons(car(cdr(car(b))), inits);
+        }
+        Value *lambda = makeNull();
+        lambda->type = SYMBOL_TYPE;
+        lambda->s = "lambda";
+        Value *letrec = makeNull();
+        letrec->type = SYMBOL_TYPE;
+        letrec->s = "letrec";
+        if (cdr(body)->type == CONS_TYPE) {
+            Value *begin = makeNull();
+            begin->type = SYMBOL_TYPE;
+            begin->s = "begin";
+            body = cons(begin, body);
+        } else {
+            body = car(body);
+        }
+        Value *procedure = cons(lambda, cons(reverse(variables),
+                                             cons(body, makeNull())));
+        Value *binding = cons(name, cons(procedure, makeNull()));
+        Value *named = cons(letrec, cons(cons(binding, makeNull()),
+                                         cons(name, makeNull())));
+        return eval(interp, cons(named, reverse(inits)), frame);
+    }
+    int depth = interp->argumentDepth;
+    Loop loop = {name->s, count, pushArguments(interp, count)};
+    evalLoopInits(interp, bindings, frame, loop.values, 1, "let");
+    bool reuse = !slot->captured;
+    Frame *loopFrame = firstIteration(interp, args, frame, bindings, &loop,
+                                      reuse);
+    Value *result;
+    while (true) {
+        Value *rest = body;
+        for (; cdr(rest)->type == CONS_TYPE; rest = cdr(rest)) {
+            eval(interp, car(rest), loopFrame);
+        }
+        result = evalLoopTail(interp, car(rest), loopFrame, &loop);
+        if (result) {
+            break;
+        }
+        loopFrame = nextIteration(interp, loopFrame, bindings, &loop, reuse);
+    }
+    leaveLet(interp, args, loopFrame, reuse);
+    interp->argumentDepth = depth;
+    return result;
+}
+
+/*
+* Evaluates (let ((x1 e1) ... (xn en)) body1 ... bodym)
+* Creates a new frame F with given parent frame, evaluates each ei in the
+* parent frame to get vi and binds this to xi in F.
+* Then evaluates body1,...,bodym in frame F and returns the value of bodym.
+* (let name ...) is a named let, evaluated by evalNamedLet.
+*/
+Value *evalLet(Interpreter *interp, Value *args, Frame *frame) {
+    if (args->type == CONS_TYPE && car(args)->type == SYMBOL_TYPE) {
+        return evalNamedLet(interp, args, frame);
+    }
+    bool reuse;
+    Frame *newFrame = enterLet(interp, args, frame, &reuse);
     // Evaluate body1, ... bodym in order, return last one.
-    args = cdr(args);
+    Value *body = cdr(args);
     Value *returnVal = makeNull();
-    while (args->type != NULL_TYPE) {
-        returnVal = eval(car(args), newFrame);
-        args = cdr(args);
+    while (body->type != NULL_TYPE) {
+        returnVal = eval(interp, car(body), newFrame);
+        body = cdr(body);
     }
+    leaveLet(interp, args, newFrame, reuse);
     return returnVal;
 }
 
@@ -1048,10 +2121,11 @@ Value *evalLet(Value *args, Frame *frame) {
 * as its parent, evaluates ei in frame Fi, then binds it to xi in Fi.
 * Last, evaluates body1,...,bodym in frame Fn.
 */
-Value *evalLetStar(Value *args, Frame *frame) {
+Value *evalLetStar(Interpreter *interp, Value *args, Frame *frame) {
     if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE) {
-        evaluationError("Not enough blocks after 'let*'");
+        evaluationError(interp, "Not enough blocks after 'let*'");
     }
+    int depth = interp->liveDepth;
     Frame *previousFrame = frame;
     Frame *lastFrame = talloc(sizeof(Frame)); // will be Fn
     lastFrame->parent = previousFrame;
@@ -1062,12 +2136,13 @@ Value *evalLetStar(Value *args, Frame *frame) {
         Frame *newFrame = talloc(sizeof(Frame));
         newFrame->parent = previousFrame;
         newFrame->bindings = makeNull();
+        pushLiveFrame(interp, newFrame);
         if (toBind->type != CONS_TYPE) {
-            evaluationError("Invalid synax in 'let*'");
+            evaluationError(interp, "Invalid synax in 'let*'");
         }
         currBind = car(toBind);
-        assertValidSyntax(currBind);
-        newFrame->bindings = createBinding(newFrame,
+        assertValidSyntax(interp, currBind);
+        newFrame->bindings = createBinding(interp, newFrame,
                                            newFrame->bindings, currBind);
         toBind = cdr(toBind);
         previousFrame = newFrame;
@@ -1077,9 +2152,10 @@ Value *evalLetStar(Value *args, Frame *frame) {
     args = cdr(args);
     Value *returnVal = makeNull();
     while (args->type != NULL_TYPE) {
-        returnVal = eval(car(args), lastFrame);
+        returnVal = eval(interp, car(args), lastFrame);
         args = cdr(args);
     }
+    interp->liveDepth = depth;
     return returnVal;
 }
 
@@ -1089,9 +2165,9 @@ Value *evalLetStar(Value *args, Frame *frame) {
 * value in F, then evaluates each ei in F, then bind the results
 * to the corresponding xi's. Last, evaluates body1,...,bodym in frame F.
 */
-Value *evalLetRec(Value *args, Frame *frame) {
+Value *evalLetRec(Interpreter *interp, Value *args, Frame *frame) {
     if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE) {
-        evaluationError("Not enough blocks after 'letrec'");
+        evaluationError(interp, "Not enough blocks after 'letrec'");
     }
     Frame *newFrame = talloc(sizeof(Frame));
     newFrame->parent = frame;
@@ -1100,9 +2176,9 @@ Value *evalLetRec(Value *args, Frame *frame) {
     // bind each xi to an undefined value
     while (toBind->type != NULL_TYPE) {
         if (toBind->type != CONS_TYPE) {
-            evaluationError("Invalid synax in 'letrec'");
+            evaluationError(interp, "Invalid synax in 'letrec'");
         }
-        assertValidSyntax(car(toBind));
+        assertValidSyntax(interp, car(toBind));
         Value *undefined = makeNull();
         undefined->type = SYMBOL_TYPE;
         undefined->s = UNDEFINED_SYMBOL;
@@ -1117,64 +2193,253 @@ Value *evalLetRec(Value *args, Frame *frame) {
     // evaluate the ei in the new frame, add to 'bindings'.
     while (toBind->type != NULL_TYPE) {
         currBind = car(toBind);
-        assertValidLetSyntax(currBind, bindings);
-        Value *result = eval(car(cdr(currBind)), newFrame);
+        assertValidLetSyntax(interp, currBind, bindings);
+        Value *result = eval(interp, car(cdr(currBind)), newFrame);
         if (result->type == SYMBOL_TYPE &&
             !strcmp(result->s, UNDEFINED_SYMBOL)) {
-            evaluationError("Expression in letrec binding could not be "
+            evaluationError(interp, "Expression in letrec binding could not be "
                             "evaluated without assigning or referring to the "
                             "value of another variable in same letrec");
         }
-        eCurrBind = cons(result, makeNull()); // e.g., (x1 eval(v1))
+        nameClosure(result, car(currBind));
+        eCurrBind = cons(result, makeNull()); // e.g., (x1 eval(interp, v1))
         eCurrBind = cons(car(currBind), eCurrBind);
         bindings = cons(eCurrBind, bindings);
         toBind = cdr(toBind);
     }
     newFrame->bindings = bindings;
     // Evaluate body1, ... bodym in order, return last one.
+    pushLiveFrame(interp, newFrame);
     args = cdr(args);
     Value *returnVal = makeNull();
     while (args->type != NULL_TYPE) {
-        returnVal = eval(car(args), newFrame);
+        returnVal = eval(interp, car(args), newFrame);
         args = cdr(args);
     }
+    interp->liveDepth--;
     return returnVal;
 }
 
+/*
+* Evaluates (do ((x1 e1 s1) ... (xn en sn)) (test r1 ... rk) c1 ... cm):
+* binds each xi to the value of ei in a new frame F, then until test is
+* true in F, evaluates c1 ... cm and sets each xi that has an si to the
+* value of si, all si being evaluated before any xi is set. Returns the
+* value of rk, or void if there are no ri. As with a named let running as
+* a loop, F comes from the frame pool and the xi are set in place, unless
+* the body may capture F.
+*/
+Value *evalDo(Interpreter *interp, Value *args, Frame *frame) {
+    if (listLength(args) < 2 || listLength(car(args)) < 0 ||
+        listLength(car(cdr(args))) < 1) {
+        evaluationError(interp, "Invalid syntax in 'do'");
+    }
+    Value *bindings = car(args);
+    Value *exit = car(cdr(args));
+    Value *commands = cdr(cdr(args));
+    FramePoolSlot *slot = framePoolSlot(interp, args);
+    if (!slot->analyzed) {
+        slot->captured = capturesFrame(args);
+        slot->analyzed = true;
+    }
+    int count = listLength(bindings);
+    int depth = interp->argumentDepth;
+    Loop loop = {NULL, count, pushArguments(interp, count)};
+    evalLoopInits(interp, bindings, frame, loop.values, 2, "do");
+    bool reuse = !slot->captured;
+    Frame *loopFrame = firstIteration(interp, args, frame, bindings, &loop,
+                                      reuse);
+    while (true) {
+        Value *test = eval(interp, car(exit), loopFrame);
+        if (test->type != BOOL_TYPE || test->b) {
+            break;
+        }
+        for (Value *c = commands; c->type == CONS_TYPE; c = cdr(c)) {
+            eval(interp, car(c), loopFrame);
+        }
+        Value *binding = loopFrame->entered;
+        Value *b = bindings;
+        for (int i = 0; i < count; i++) {
+            Value *step = cdr(cdr(car(b)));
+            loop.values[i] = step->type == CONS_TYPE ?
+                             eval(interp, car(step), loopFrame) :
+                             car(cdr(car(binding)));
+            binding = cdr(binding);
+            b = cdr(b);
+        }
+        loopFrame = nextIteration(interp, loopFrame, bindings, &loop, reuse);
+    }
+    Value *result = makeNull();
+    result->type = VOID_TYPE;
+    for (Value *r = cdr(exit); r->type == CONS_TYPE; r = cdr(r)) {
+        result = eval(interp, car(r), loopFrame);
+    }
+    leaveLet(interp, args, loopFrame, reuse);
+    interp->argumentDepth = depth;
+    return result;
+}
+
+/*
+* Binds 'symbol' to 'value' in 'frame', replacing any binding it already has
+* there.
+*/
+void defineSymbol(Value *symbol, Value *value, Frame *frame) {
+    nameClosure(value, symbol);
+    Value *cell = findCell(frame, symbol->s);
+    if (cell) {
+        // rebind existing variable; references that cached the cell see it
+        __atomic_store_n(&cell->c.car, value, __ATOMIC_RELEASE);
+        return;
+    }
+    Value *newBinding = makeNull();
+    newBinding = cons(value, newBinding);
+    newBinding = cons(symbol, newBinding);
+    __atomic_store_n(&frame->bindings, cons(newBinding, frame->bindings),
+                     __ATOMIC_RELEASE);
+}
+
 /*
 * Given args=(symbol, s-expr), evaluate s-expr and bind
 * the result to symbol in the current frame.
 */
-Value *evalDefine(Value *args, Frame *frame) {
+Value *evalDefine(Interpreter *interp, Value *args, Frame *frame) {
     if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
        cdr(cdr(args))->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for define.");
+        evaluationError(interp, "Wrong number of arguments provided for define.");
     }
     if (car(args)->type != SYMBOL_TYPE) {
-        evaluationError("Define can only bind to a symbol.");
-    }
-    Value *result = eval(car(cdr(args)), frame);
-    bool found = false;
-    Value *cur; // current binding: (symbol value)
-    Value *bindings = frame->bindings; // ((e1 v1) ... (en vn))
-    while (bindings->type == CONS_TYPE && !found) {
-        cur = car(bindings);
-        assert(cur->type == CONS_TYPE);
-        Value *curSymbol = car(cur);
-        assert(curSymbol->type == SYMBOL_TYPE);
-        if (!strcmp(curSymbol->s, car(args)->s)) {
-            found = true;
-            // rebind existing variable
-            *cdr(cur) = *cons(result, makeNull());
-        }
-        bindings = cdr(bindings);
+        evaluationError(interp, "Define can only bind to a symbol.");
+    }
+    Value *result = eval(interp, car(cdr(args)), frame);
+    defineSymbol(car(args), result, frame);
+    Value *returnValue = makeNull();
+    returnValue->type = VOID_TYPE;
+    return returnValue;
+}
+
+/*
+* Given args=(symbol, spec), where spec is (syntax-rules ...) or the macro
+* already made from it when the form was expanded, binds symbol to the
+* macro in the global frame (see macro.h).
+*/
+Value *evalDefineSyntax(Interpreter *interp, Value *args, Frame *frame) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for define-syntax.");
+    }
+    if (car(args)->type != SYMBOL_TYPE) {
+        evaluationError(interp, "Define-syntax can only bind to a symbol.");
+    }
+    Value *macro = car(cdr(args));
+    if (macro->type != MACRO_TYPE) {
+        macro = makeMacro(interp, macro);
+    }
+    defineSymbol(car(args), macro, interp->global);
+    Value *returnValue = makeNull();
+    returnValue->type = VOID_TYPE;
+    return returnValue;
+}
+
+/*
+* Given args=(expr), returns a promise of expr's value in frame (see
+* promise.h); with 'forcesPromise', as for delay-force, expr must evaluate
+* to a promise.
+*/
+Value *evalDelay(Interpreter *interp, Value *args, Frame *frame,
+                 bool forcesPromise) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, forcesPromise ?
+                        "Wrong number of arguments provided for delay-force." :
+                        "Wrong number of arguments provided for delay.");
+    }
+    return makePromise(car(args), frame, forcesPromise);
+}
+
+/*
+* Given args=(first, rest), returns a stream whose first element is the
+* value of first and whose rest is a promise of the value of rest.
+*/
+Value *evalStreamCons(Interpreter *interp, Value *args, Frame *frame) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for stream-cons.");
+    }
+    Value *first = eval(interp, car(args), frame);
+    return cons(first, makePromise(car(cdr(args)), frame, false));
+}
+
+/*
+* The body of a let/ec form and the frame it is evaluated in.
+*/
+typedef struct {
+    Value *args;
+    Frame *frame;
+} LetEc;
+
+static Value *evalLetEcBody(Interpreter *interp, Value *k, void *data) {
+    LetEc *letEc = data;
+    Frame *newFrame = talloc(sizeof(Frame));
+    newFrame->parent = letEc->frame;
+    newFrame->bindings = cons(cons(car(letEc->args), cons(k, makeNull())),
+                              makeNull());
+    pushLiveFrame(interp, newFrame);
+    Value *returnVal = makeNull();
+    for (Value *body = cdr(letEc->args); body->type != NULL_TYPE;
+         body = cdr(body)) {
+        returnVal = eval(interp, car(body), newFrame);
     }
-    if (!found) {
-        Value *newBinding = makeNull();
-        newBinding = cons(result, newBinding);
-        newBinding = cons(car(args), newBinding);
-        frame->bindings = cons(newBinding, frame->bindings);
+    interp->liveDepth--;
+    return returnVal;
+}
+
+/*
+* Given args=(symbol, body1, ..., bodym), evaluates the bodies in a new
+* frame binding symbol to an escape procedure (see escape.h), returning
+* the value of bodym, or the value the escape procedure is called with.
+*/
+Value *evalLetEc(Interpreter *interp, Value *args, Frame *frame) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE) {
+        evaluationError(interp, "Not enough blocks after 'let/ec'");
+    }
+    if (car(args)->type != SYMBOL_TYPE) {
+        evaluationError(interp, "let/ec can only bind to a symbol");
+    }
+    LetEc letEc = {args, frame};
+    return callWithEscape(interp, evalLetEcBody, &letEc);
+}
+
+/*
+* Given args=(symbol, s-expr) or (symbol, s-expr, capacity), evaluates
+* s-expr to a closure and binds symbol to a memoized copy of it (see
+* memo.h), keeping at most 'capacity' results if given.
+*/
+Value *evalDefineMemoized(Interpreter *interp, Value *args, Frame *frame) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        (cdr(cdr(args))->type != NULL_TYPE &&
+         (cdr(cdr(args))->type != CONS_TYPE ||
+          cdr(cdr(cdr(args)))->type != NULL_TYPE))) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for define-memoized");
+    }
+    if (car(args)->type != SYMBOL_TYPE) {
+        evaluationError(interp, "define-memoized can only bind to a symbol");
+    }
+    Value *procedure = eval(interp, car(cdr(args)), frame);
+    if (procedure->type != CLOSURE_TYPE) {
+        evaluationError(interp, "define-memoized requires a procedure");
+    }
+    int capacity = 0;
+    if (cdr(cdr(args))->type == CONS_TYPE) {
+        Value *limit = eval(interp, car(cdr(cdr(args))), frame);
+        if (limit->type != INT_TYPE || limit->i < 0) {
+            evaluationError(interp,
+                            "define-memoized capacity must be a non-negative "
+                            "integer");
+        }
+        capacity = limit->i;
     }
+    nameClosure(procedure, car(args));
+    defineSymbol(car(args), memoize(interp, procedure, capacity), frame);
     Value *returnValue = makeNull();
     returnValue->type = VOID_TYPE;
     return returnValue;
@@ -1185,59 +2450,68 @@ Value *evalDefine(Value *args, Frame *frame) {
 * frames recursively for the given symbol. If found, bind symbol to v in that
 * frame. Otherwise, throw an error.
 */
-Value *evalSetBang(Value *args, Frame *frame) {
+Value *evalSetBang(Interpreter *interp, Value *args, Frame *frame) {
     if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
        cdr(cdr(args))->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for set!");
+        evaluationError(interp, "Wrong number of arguments provided for set!");
     }
     if (car(args)->type != SYMBOL_TYPE) {
-        evaluationError("set! can only bind to a symbol");
-    }
-    Value *result = eval(car(cdr(args)), frame);
-    Value *cur;
-    Value *bindings = frame->bindings;
-    while (bindings->type == CONS_TYPE) {
-        cur = car(bindings);
-        assert(cur->type == CONS_TYPE);
-        Value *curSymbol = car(cur);
-        assert(curSymbol->type == SYMBOL_TYPE);
-        if (!strcmp(curSymbol->s, car(args)->s)) {
-            *cdr(cur) = *cons(result, makeNull()); // redefine
-            Value *returnValue = makeNull();
-            returnValue->type = VOID_TYPE;
-            return returnValue;
-        }
-        bindings = cdr(bindings);
+        evaluationError(interp, "set! can only bind to a symbol");
     }
-    if (!frame->parent) {
-        evaluationError("Cannot set! an undefined variable");
+    Value *result = eval(interp, car(cdr(args)), frame);
+    Value *cell = lookUpCell(car(args), frame);
+    if (!cell) {
+        evaluationError(interp, "Cannot set! an undefined variable");
     }
-    return evalSetBang(args, frame->parent);
+    __atomic_store_n(&cell->c.car, result, __ATOMIC_RELEASE);
+    Value *returnValue = makeNull();
+    returnValue->type = VOID_TYPE;
+    return returnValue;
 }
 
 /*
 * Given expressions e1, e2, ..., en, evaluate the ei in order, one at a time.
 * The value of the last expression, en, is returned.
 */
-Value *evalBegin(Value *args, Frame *frame) {
+Value *evalBegin(Interpreter *interp, Value *args, Frame *frame) {
     Value *returnVal = makeNull();
     returnVal->type = VOID_TYPE;
     while (args->type != NULL_TYPE) {
-        returnVal = eval(car(args), frame);
+        returnVal = eval(interp, car(args), frame);
         args = cdr(args);
     }
     return returnVal;
 }
 
+/*
+* Returns true if 'parameters' is a list of distinct symbols, the only kind
+* of parameter list applyInReusedFrame handles.
+*/
+static bool reusableParameters(Value *parameters) {
+    for (; parameters->type == CONS_TYPE; parameters = cdr(parameters)) {
+        if (car(parameters)->type != SYMBOL_TYPE) {
+            return false;
+        }
+        for (Value *later = cdr(parameters); later->type == CONS_TYPE;
+             later = cdr(later)) {
+            if (car(later)->type == SYMBOL_TYPE &&
+                !strcmp(car(later)->s, car(parameters)->s)) {
+                return false;
+            }
+        }
+    }
+    return parameters->type == NULL_TYPE;
+}
+
 /*
 * Given ((x1 x2 ... xn) body), or (symbol body), and a frame, creates
 * a closure object with parameters (x1 x2 ... xn), or variadic param
 * 'symbol', function 'body', and frame 'frame'.
 */
-Value *evalLambda(Value *args, Frame *frame) {
+Value *evalLambda(Interpreter *interp, Value *args, Frame *frame) {
     if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
         cdr(cdr(args))->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for lambda");
+        evaluationError(interp, "Wrong number of arguments provided for lambda");
     }
     Value *closure = makeNull();
     closure->type = CLOSURE_TYPE;
@@ -1246,127 +2520,253 @@ Value *evalLambda(Value *args, Frame *frame) {
         // parameters is either a list (if n-adic) or a symbol (if variadic)
         (closure->k).parameters = car(args);
     } else {
-        evaluationError("Wrong formal parameter type in lambda definition");
+        evaluationError(interp, "Wrong formal parameter type in lambda definition");
     }
     (closure->k).function = car(cdr(args));
     (closure->k).frame = frame;
+    (closure->k).name = NULL;
+    (closure->k).memo = NULL;
+    (closure->k).reusesFrames = reusableParameters((closure->k).parameters) &&
+                                !capturesFrame((closure->k).function);
     return closure;
 }
 
+/*
+* Tokenizes and parses everything in 'file', then closes it, whether or not
+* it holds a syntax error.
+*/
+Value *parseFile(Interpreter *interp, FILE *file) {
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (setjmp(onError)) {
+        restore(interp, &saved);
+        fclose(file);
+        raiseObject(interp, interp->raised, interp->error);
+    }
+    interp->in = file;
+    Value *tree = parse(interp, tokenize(interp, false));
+    restore(interp, &saved);
+    fclose(file);
+    return tree;
+}
+
 /*
 * Loads the file with filepath given (as a value of STR_TYPE), executes the
 * scheme code in the file, with given frame (printing output),
 * and then returns the frame after evaluation.
 */
-Frame *evalLoad(Value *args, Frame *frame) {
+Frame *evalLoad(Interpreter *interp, Value *args, Frame *frame) {
     // make sure there is exactly one argument
     if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
-        evaluationError("Wrong number of arguments provided for load");
+        evaluationError(interp, "Wrong number of arguments provided for load");
     }
     if (car(args)->type != STR_TYPE) {
-        evaluationError("Wrong argument type given for load");
+        evaluationError(interp, "Wrong argument type given for load");
     }
     FILE *file = fopen(car(args)->s, "r");
     if (!file) {
-        evaluationError("The given file could not be opened");
+        evaluationError(interp, "The given file could not be opened");
+    }
+    if (tracing) {
+        traceEnter(car(args)->s, TRACE_LOAD);
     }
-    FILE *oldStdin = stdin;
-    stdin = file;
-    Value *list = tokenize(false);
-    Value *tree = parse(list);
+    Value *tree = parseFile(interp, file);
     // below code modified from interpret()
     Value *cur;
     while (tree->type == CONS_TYPE) {
         cur = car(tree);
-        Value *val = eval(cur, frame);
-        printValue(val);
-        if (val->type != VOID_TYPE) {
-            printf("\n");
-        }
+        cur = frame->parent ? expandMacros(interp, cur) : optimize(interp, cur);
+        Value *val = eval(interp, cur, frame);
+        printResult(val);
         tree = cdr(tree);
     }
-    fclose(file);
-    stdin = oldStdin;
+    if (tracing) {
+        traceExit(car(args)->s, TRACE_LOAD);
+    }
     return frame;
 }
 
+static Value *argumentList(int argc, Value **argv) {
+    Value *list = makeNull();
+    for (int i = argc - 1; i >= 0; i--) {
+        list = cons(argv[i], list);
+    }
+    return list;
+}
+
 /*
-* Given args=(e1 ... en), recursively evaluates e1,...,en
-* to get values v1,...,vn, and returns (v1 ... vn).
+* Applies the primitive 'function' to the argc values in argv, through
+* whichever of its direct entry points fits.
 */
-Value *evalCombo(Value *args, Frame *frame) {
-    if (args->type == NULL_TYPE) {
-        return makeNull();
+static Value *applyPrimitive(Interpreter *interp, Value *function, int argc,
+                             Value **argv) {
+    struct Primitive *primitive = &function->pr;
+    if (tracing) {
+        traceEnter(primitive->name, TRACE_PRIMITIVE);
+    }
+    Value *result;
+    if (argc == 1 && primitive->pf1) {
+        result = primitive->pf1(interp, argv[0]);
+    } else if (argc == 2 && primitive->pf2) {
+        result = primitive->pf2(interp, argv[0], argv[1]);
+    } else if (primitive->pfn) {
+        result = primitive->pfn(interp, argc, argv);
+    } else {
+        result = primitive->pf(interp, argumentList(argc, argv));
+    }
+    if (tracing) {
+        traceExit(primitive->name, TRACE_PRIMITIVE);
+    }
+    return result;
+}
+
+/*
+* Evaluates each expression in args in order and applies 'function' to
+* the results, which are kept on the interpreter's argument stack rather
+* than in a list. Closures that reuse frames get the arguments stored
+* straight into their frame, and primitives are called with them directly;
+* only other calls have the arguments made into a list.
+*/
+static Value *evalCall(Interpreter *interp, Value *function, Value *args,
+                       Frame *frame) {
+    int argc = 0;
+    for (Value *arg = args; arg->type == CONS_TYPE; arg = cdr(arg)) {
+        argc++;
+    }
+    int depth = interp->argumentDepth;
+    Value **argv = pushArguments(interp, argc);
+    for (int i = 0; i < argc; i++) {
+        argv[i] = eval(interp, car(args), frame);
+        args = cdr(args);
+    }
+    Value *result;
+    if (function->type == PRIMITIVE_TYPE) {
+        result = applyPrimitive(interp, function, argc, argv);
+    } else if (function->type == CLOSURE_TYPE &&
+               (function->k).reusesFrames && !(function->k).memo) {
+        result = applyInReusedFrame(interp, function, argc, argv);
+    } else {
+        result = apply(interp, function, argumentList(argc, argv));
+    }
+    interp->argumentDepth = depth;
+    return result;
+}
+
+/*
+* Given a guard and args=(fast slow) from the optimizer, returns fast if
+* every global cell the guard checks still holds the value it expects, and
+* slow otherwise, for eval to evaluate in place of the guarded form.
+*/
+static Value *guardBranch(Value *guard, Value *args) {
+    Value *checks = guard->checks;
+    for (; checks->type == CONS_TYPE; checks = cdr(checks)) {
+        Value *cell = car(car(checks));
+        if (__atomic_load_n(&cell->c.car, __ATOMIC_ACQUIRE) != cdr(car(checks))) {
+            return car(cdr(args));
+        }
     }
-    return cons(eval(car(args), frame), evalCombo(cdr(args), frame));
+    return car(args);
 }
 
 /*
 * Given a parse tree of a single S-expression and an environment frame,
 * returns a pointer to a Value represented the expression's value.
 */
-Value *eval(Value *tree, Frame *frame) {
-    switch (tree->type) {
-        case NULL_TYPE:
-            return makeNull();
-        case INT_TYPE:
-        case DOUBLE_TYPE:
-        case STR_TYPE:
-        case BOOL_TYPE:
-            return tree;
-            break;
-        case SYMBOL_TYPE:
-            return lookUpSymbol(tree, frame);
-            break;
-        case CONS_TYPE: {
-            Value *first = car(tree);
-            Value *args = cdr(tree);
-            if (first->type != SYMBOL_TYPE && first->type != CONS_TYPE) {
-                evaluationError("First element in a list is not a symbol.");
-            }
-            if (!strcmp(first->s, "if")) {
-                return evalIf(args, frame);
-            } else if (!strcmp(first->s, "cond")) {
-                return evalCond(args, frame);
-            } else if (!strcmp(first->s, "quote")) {
-                if (args->type != CONS_TYPE) {
-                    evaluationError("Not enough arguments for quote.");
-                } else if (cdr(args)->type != NULL_TYPE) {
-                    evaluationError("Too many arguments for quote.");
+Value *eval(Interpreter *interp, Value *tree, Frame *frame) {
+    // Forms whose value is that of a subexpression, if and guards, go
+    // around again with it rather than recursing.
+    while (true) {
+        switch (tree->type) {
+            case NULL_TYPE:
+                return makeNull();
+            case INT_TYPE:
+            case DOUBLE_TYPE:
+            case STR_TYPE:
+            case BOOL_TYPE:
+                return tree;
+                break;
+            case SYMBOL_TYPE:
+                return lookUpSymbol(interp, tree, frame);
+                break;
+            case CONS_TYPE: {
+                Value *first = car(tree);
+                Value *args = cdr(tree);
+                if (first->type == PRIMITIVE_TYPE) {
+                    // a call the optimizer bound to its primitive
+                    return evalCall(interp, first, args, frame);
                 }
-                return car(args);
-            } else if (!strcmp(first->s, "let")) {
-                return evalLet(args, frame);
-            } else if (!strcmp(first->s, "and")) {
-                return evalAnd(args, frame);
-            } else if (!strcmp(first->s, "or")) {
-                return evalOr(args, frame);
-            } else if (!strcmp(first->s, "let*")) {
-                return evalLetStar(args, frame);
-            } else if (!strcmp(first->s, "letrec")) {
-                return evalLetRec(args, frame);
-            } else if (!strcmp(first->s, "define")) {
-                return evalDefine(args, frame);
-            } else if (!strcmp(first->s, "set!")) {
-                return evalSetBang(args, frame);
-            } else if (!strcmp(first->s, "begin")) {
-                return evalBegin(args, frame);
-            } else if (!strcmp(first->s, "lambda")) {
-                return evalLambda(args, frame);
-            } else if (!strcmp(first->s, "load")) {
-                frame = evalLoad(args, frame);
-                Value *returnVal = makeNull();
-                returnVal->type = VOID_TYPE;
-                return returnVal;
-            } else {
-                Value *results = evalCombo(cons(first, args), frame);
-                return apply(car(results), cdr(results)); // Replace this
+                if (first->type == GUARD_TYPE) {
+                    tree = guardBranch(first, args);
+                    continue;
+                }
+                if (first->type != SYMBOL_TYPE && first->type != CONS_TYPE) {
+                    evaluationError(interp, "First element in a list is not a symbol.");
+                }
+                if (!strcmp(first->s, "if")) {
+                    tree = ifBranch(interp, args, frame);
+                    if (!tree) {
+                        Value *voidVal = makeNull();
+                        voidVal->type = VOID_TYPE;
+                        return voidVal;
+                    }
+                    continue;
+                } else if (!strcmp(first->s, "cond")) {
+                    return evalCond(interp, args, frame);
+                } else if (!strcmp(first->s, "quote")) {
+                    if (args->type != CONS_TYPE) {
+                        evaluationError(interp, "Not enough arguments for quote.");
+                    } else if (cdr(args)->type != NULL_TYPE) {
+                        evaluationError(interp, "Too many arguments for quote.");
+                    }
+                    return car(args);
+                } else if (!strcmp(first->s, "let")) {
+                    return evalLet(interp, args, frame);
+                } else if (!strcmp(first->s, "and")) {
+                    return evalAnd(interp, args, frame);
+                } else if (!strcmp(first->s, "or")) {
+                    return evalOr(interp, args, frame);
+                } else if (!strcmp(first->s, "let*")) {
+                    return evalLetStar(interp, args, frame);
+                } else if (!strcmp(first->s, "letrec")) {
+                    return evalLetRec(interp, args, frame);
+                } else if (!strcmp(first->s, "do")) {
+                    return evalDo(interp, args, frame);
+                } else if (!strcmp(first->s, "define")) {
+                    return evalDefine(interp, args, frame);
+                } else if (!strcmp(first->s, "define-memoized")) {
+                    return evalDefineMemoized(interp, args, frame);
+                } else if (!strcmp(first->s, "define-syntax")) {
+                    return evalDefineSyntax(interp, args, frame);
+                } else if (!strcmp(first->s, "delay")) {
+                    return evalDelay(interp, args, frame, false);
+                } else if (!strcmp(first->s, "delay-force")) {
+                    return evalDelay(interp, args, frame, true);
+                } else if (!strcmp(first->s, "stream-cons")) {
+                    return evalStreamCons(interp, args, frame);
+                } else if (!strcmp(first->s, "let/ec")) {
+                    return evalLetEc(interp, args, frame);
+                } else if (!strcmp(first->s, "set!")) {
+                    return evalSetBang(interp, args, frame);
+                } else if (!strcmp(first->s, "begin")) {
+                    return evalBegin(interp, args, frame);
+                } else if (!strcmp(first->s, "lambda")) {
+                    return evalLambda(interp, args, frame);
+                } else if (!strcmp(first->s, "load")) {
+                    frame = evalLoad(interp, args, frame);
+                    Value *returnVal = makeNull();
+                    returnVal->type = VOID_TYPE;
+                    return returnVal;
+                } else {
+                    return evalCall(interp, eval(interp, first, frame), args,
+                                    frame);
+                }
+                break;
             }
-            break;
+            default:
+                evaluationError(interp, "Input not of a specified type.");
+                break;
         }
-        default:
-            evaluationError("Input not of a specified type.");
-            break;
-   }
-   return makeNull();
+        return makeNull();
+    }
 }
@@ -1,9 +1,11 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include "value.h"
 #include "talloc.h"
 #include "linkedlist.h"
 #include "tokenizer.h"
 #include "parser.h"
+#include "context.h"
 
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
@@ -11,6 +13,9 @@
 struct Frame {
     Value *bindings;
     struct Frame *parent;
+    // For a frame that is reused between calls, the bindings it was entered
+    // with, before any define in the body added to them.
+    Value *entered;
 };
 typedef struct Frame Frame;
 
@@ -19,17 +24,89 @@ typedef struct Frame Frame;
 */
 Frame *makeFrame();
 
+/*
+* Returns the cell of 'name' in 'frame' alone: the pair whose car is its
+* value, which stays the same when the binding is redefined or set!.
+* Returns NULL if the frame does not bind it.
+*/
+Value *findCell(Frame *frame, char *name);
+
+/*
+* Creates an interpreter instance with its own heap, which becomes the
+* calling thread's current heap, and a global frame holding the primitive
+* procedures. Source is read from stdin until interp->in is changed.
+*/
+Interpreter *makeInterpreter();
+
+/*
+* Frees everything the interpreter allocated, including its heap.
+*/
+void destroyInterpreter(Interpreter *interp);
+
+/*
+* Binds 'symbol' to 'value' in 'frame', replacing any binding it already has
+* there.
+*/
+void defineSymbol(Value *symbol, Value *value, Frame *frame);
+
+/*
+* Creates an instance for evaluating on another thread alongside 'parent'.
+* It shares the parent's global frame, which it must treat as read-only, and
+* has its own heap, error handler and live frames. The heap is not made
+* current.
+*/
+Interpreter *makeWorker(Interpreter *parent);
+
+/*
+* Frees a worker made by makeWorker, but not its heap, which the caller
+* merges into another heap or destroys.
+*/
+void releaseWorker(Interpreter *worker);
+
+/*
+* Binds the string 'name' to the primitive 'function' in the given frame.
+*/
+void bindPrimitive(char *name, Value *(*function)(Interpreter *, Value *),
+                   Frame *frame);
+
 /*
 * Given a list of S-expressions (i.e., the output of parser), calls eval on
-* each S-expression in the top-level environment. Prints the result of each
-* eval.
+* each S-expression in the interpreter's top-level environment. Prints the
+* result of each eval. An error in one S-expression is printed and counted
+* in interp->errorCount, and evaluation continues with the next.
 */
-void interpret(Value *tree, Frame *frame);
+void interpret(Interpreter *interp, Value *tree);
+
+/*
+* Tokenizes and parses everything in 'file', then closes it, whether or not
+* it holds a syntax error.
+*/
+Value *parseFile(Interpreter *interp, FILE *file);
 
 /*
 * Given a parse tree of a single S-expression and an environment frame,
 * returns a pointer to a Value represented the expression's value.
 */
-Value *eval(Value *expr, Frame *frame);
+Value *eval(Interpreter *interp, Value *expr, Frame *frame);
+
+/*
+* Applies the given procedure to a list of argument values.
+*/
+Value *apply(Interpreter *interp, Value *function, Value *args);
+
+/*
+* Prints a single value.
+*/
+void printValue(Value *val);
+
+/*
+* Prints a single value to the given stream.
+*/
+void writeValue(FILE *out, Value *val);
+
+/*
+* Reports the supplied error message and abandons the current evaluation.
+*/
+void evaluationError(Interpreter *interp, char *msg);
 
 #endif
@@ -1,26 +1,29 @@
 #include <stdbool.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include "linkedlist.h"
 #include "value.h"
 #include "talloc.h"
+#include "output.h"
 
 /*
  * Create an empty list (a new Value object of type NULL_TYPE).
 */
-Value *makeNull() {
-   Value *lst = talloc(sizeof(Value));
+Value *makeNullAt(const char *site) {
+   Value *lst = tallocAt(sizeof(Value), "makeNull", site);
    lst->type = NULL_TYPE;
+   lst->cell = NULL; // symbols are made from nulls
    return lst;
 }
 
 /*
  * Create a nonempty list (a new Value object of type CONS_TYPE).
  */
-Value *cons(Value *car, Value *cdr) {
-   Value *lst = talloc(sizeof(Value));
+Value *consAt(Value *car, Value *cdr, const char *site) {
+   Value *lst = tallocAt(sizeof(Value), "cons", site);
    lst->type = CONS_TYPE;
    (lst->c).car = car;
    (lst->c).cdr = cdr;
@@ -28,10 +31,24 @@ Value *cons(Value *car, Value *cdr) {
 }
 
 /*
- * Print a representation of the contents of a linked list.
+ * Create the pair (name . count), saturating count to an int.
  */
-void display(Value *list) {
-   printf("( ");
+Value *makeCounter(char *name, long count) {
+   Value *symbol = makeNull();
+   symbol->type = SYMBOL_TYPE;
+   symbol->s = name;
+   Value *number = makeNull();
+   number->type = INT_TYPE;
+   number->i = count > INT_MAX ? INT_MAX : (int)count;
+   return cons(symbol, number);
+}
+
+/*
+ * Write the representation display prints of 'list' into the output buffer.
+ */
+static void displayList(Output *out, Value *list) {
+   char pointer[32];
+   outputString(out, "( ");
    Value *next = list;
    assert(next);
    while ((next->type) != NULL_TYPE) {
@@ -39,38 +56,51 @@ void display(Value *list) {
       assert(val);
       switch (val->type) {
          case INT_TYPE:
-            printf("%i ", val->i);
+            outputInt(out, val->i);
+            outputChar(out, ' ');
             break;
          case DOUBLE_TYPE:
-            printf("%f ", val->d);
+            outputDouble(out, val->d);
+            outputChar(out, ' ');
             break;
          case SYMBOL_TYPE:
          case STR_TYPE: // go to bool case because both are strings
          case BOOL_TYPE:
-            printf("%s ", val->s);
+            outputString(out, val->s);
+            outputChar(out, ' ');
             break;
          case PTR_TYPE:
-            printf("%p ", val->p);
+            snprintf(pointer, sizeof(pointer), "%p ", val->p);
+            outputString(out, pointer);
             break;
          case OPEN_TYPE:
-            printf("( ");
+            outputString(out, "( ");
             break;
          case CLOSE_TYPE:
-            printf(") ");
+            outputString(out, ") ");
             break;
          case CONS_TYPE:
-              display(val);
+              displayList(out, val);
               break;
          default:
-            printf("Error! Why is there null cell in the middle?\n");
+            outputString(out, "Error! Why is there null cell in the middle?\n");
       }
       next = cdr(next);
       assert(next);
    }
-   printf(")\n");
+   outputString(out, ")\n");
    return;
 }
 
+/*
+ * Print a representation of the contents of a linked list.
+ */
+void display(Value *list) {
+   Output *out = outputTo(stdout);
+   displayList(out, list);
+   flushOutput(out);
+}
+
 /*
  * Get the car value of a given list.
  * (Uses assertions to ensure that this is a legitimate operation.)
@@ -6,13 +6,25 @@
 
 /*
  * Create an empty list (a new Value object of type NULL_TYPE).
+ * 'site' is the calling function, for the allocation profiler.
  */
-Value *makeNull();
+Value *makeNullAt(const char *site);
 
 /*
  * Create a nonempty list (a new Value object of type CONS_TYPE).
+ * 'site' is the calling function, for the allocation profiler.
  */
-Value *cons(Value *car, Value *cdr);
+Value *consAt(Value *car, Value *cdr, const char *site);
+
+#define makeNull() makeNullAt(__func__)
+#define cons(a, d) consAt((a), (d), __func__)
+
+/*
+ * Create the pair (name . count), for procedures such as memo-stats that
+ * return counters as an association list. 'name' is not copied. Counts
+ * beyond the range of an integer are given as the largest one.
+ */
+Value *makeCounter(char *name, long count);
 
 /*
  * Print a representation of the contents of a linked list.
@@ -0,0 +1,667 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "macro.h"
+
+#define ELLIPSIS "..."
+#define ITEMS_ON_STACK 16 // list elements expanded before the array is talloc'd
+
+/*
+* A name bound while matching or expanding: a pattern variable and the
+* part of the form it matched, or a name in a template and what it is
+* renamed to. A pattern variable under n ellipses has depth n, and its
+* value is then the list of its values at depth n - 1, one per repetition.
+*/
+typedef struct Binding {
+    char *name;
+    int depth;
+    Value *value;
+    struct Binding *next;
+} Binding;
+
+typedef struct {
+    Value *pattern;
+    Value *template;
+    Binding *binders; // the names the template binds, renamed when expanded
+} Rule;
+
+struct Macro {
+    Value *literals;
+    Rule *rules;
+    int ruleCount;
+};
+typedef struct Macro Macro;
+
+// Set once any macro is defined; until then, only forms mentioning
+// define-syntax need expanding.
+static bool macrosDefined;
+static long renameCount;
+
+static bool isSymbol(Value *value, char *name) {
+    return value->type == SYMBOL_TYPE && !strcmp(value->s, name);
+}
+
+static bool isForm(Value *expr, char *name) {
+    return expr->type == CONS_TYPE && isSymbol(car(expr), name);
+}
+
+static Value *makeSymbol(char *name) {
+    Value *symbol = makeNull();
+    symbol->type = SYMBOL_TYPE;
+    symbol->s = name;
+    return symbol;
+}
+
+static int countList(Value *list) {
+    int count = 0;
+    for (; list->type == CONS_TYPE; list = cdr(list)) {
+        count++;
+    }
+    return list->type == NULL_TYPE ? count : -1;
+}
+
+static Binding *bind(char *name, int depth, Value *value, Binding *next) {
+    Binding *binding = talloc(sizeof(Binding));
+    binding->name = name;
+    binding->depth = depth;
+    binding->value = value;
+    binding->next = next;
+    return binding;
+}
+
+static Binding *lookUp(Binding *bindings, char *name) {
+    for (; bindings; bindings = bindings->next) {
+        if (!strcmp(bindings->name, name)) {
+            return bindings;
+        }
+    }
+    return NULL;
+}
+
+static bool isLiteral(Macro *macro, Value *symbol) {
+    for (Value *l = macro->literals; l->type == CONS_TYPE; l = cdr(l)) {
+        if (!strcmp(car(l)->s, symbol->s)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isPatternVariable(Macro *macro, Value *symbol) {
+    return symbol->type == SYMBOL_TYPE && !isSymbol(symbol, "_") &&
+           !isSymbol(symbol, ELLIPSIS) && !isLiteral(macro, symbol);
+}
+
+/*
+* Adds the pattern variables in 'pattern', which is under 'depth'
+* ellipses, to 'variables'.
+*/
+static Binding *patternVariables(Macro *macro, Value *pattern, int depth,
+                                 Binding *variables) {
+    if (isPatternVariable(macro, pattern)) {
+        return bind(pattern->s, depth, NULL, variables);
+    }
+    for (; pattern->type == CONS_TYPE; pattern = cdr(pattern)) {
+        bool repeated = cdr(pattern)->type == CONS_TYPE &&
+                        isSymbol(car(cdr(pattern)), ELLIPSIS);
+        variables = patternVariables(macro, car(pattern),
+                                     depth + repeated, variables);
+    }
+    return variables;
+}
+
+static bool matchPattern(Macro *macro, Value *pattern, Value *form,
+                         Binding **bindings);
+
+/*
+* Matches the list pattern 'pattern' against 'form'.
+*/
+static bool matchList(Macro *macro, Value *pattern, Value *form,
+                      Binding **bindings) {
+    while (pattern->type == CONS_TYPE) {
+        Value *subpattern = car(pattern);
+        if (subpattern->type == DOT_TYPE) {
+            // the tail pattern matches the rest of the form
+            return cdr(pattern)->type == CONS_TYPE &&
+                   matchPattern(macro, car(cdr(pattern)), form, bindings);
+        }
+        if (cdr(pattern)->type == CONS_TYPE &&
+            isSymbol(car(cdr(pattern)), ELLIPSIS)) {
+            Value *after = cdr(cdr(pattern));
+            int needed = 0;
+            for (Value *a = after; a->type == CONS_TYPE &&
+                 car(a)->type != DOT_TYPE; a = cdr(a)) {
+                needed++;
+            }
+            int available = 0;
+            for (Value *f = form; f->type == CONS_TYPE; f = cdr(f)) {
+                available++;
+            }
+            // the subpattern takes all it can, leaving what comes after
+            Binding *variables = patternVariables(macro, subpattern, 0, NULL);
+            Binding *sequences = NULL;
+            for (Binding *v = variables; v; v = v->next) {
+                sequences = bind(v->name, v->depth + 1, makeNull(), sequences);
+            }
+            for (int i = 0; i < available - needed; i++) {
+                Binding *matched = NULL;
+                if (!matchPattern(macro, subpattern, car(form), &matched)) {
+                    return false;
+                }
+                for (Binding *s = sequences; s; s = s->next) {
+                    s->value = cons(lookUp(matched, s->name)->value, s->value);
+                }
+                form = cdr(form);
+            }
+            for (Binding *s = sequences; s; ) {
+                Binding *next = s->next;
+                s->value = reverse(s->value);
+                s->next = *bindings;
+                *bindings = s;
+                s = next;
+            }
+            pattern = after;
+            continue;
+        }
+        if (form->type != CONS_TYPE ||
+            !matchPattern(macro, subpattern, car(form), bindings)) {
+            return false;
+        }
+        pattern = cdr(pattern);
+        form = cdr(form);
+    }
+    return form->type == NULL_TYPE;
+}
+
+/*
+* Returns true if 'form' matches 'pattern', adding the pattern variables
+* to *bindings.
+*/
+static bool matchPattern(Macro *macro, Value *pattern, Value *form,
+                         Binding **bindings) {
+    switch (pattern->type) {
+        case SYMBOL_TYPE:
+            if (isSymbol(pattern, "_")) {
+                return true;
+            }
+            if (isLiteral(macro, pattern)) {
+                return isSymbol(form, pattern->s);
+            }
+            *bindings = bind(pattern->s, 0, form, *bindings);
+            return true;
+        case CONS_TYPE:
+        case NULL_TYPE:
+            return matchList(macro, pattern, form, bindings);
+        case INT_TYPE:
+            return form->type == INT_TYPE && form->i == pattern->i;
+        case DOUBLE_TYPE:
+            return form->type == DOUBLE_TYPE && form->d == pattern->d;
+        case BOOL_TYPE:
+            return form->type == BOOL_TYPE && form->b == pattern->b;
+        case STR_TYPE:
+            return form->type == STR_TYPE && !strcmp(form->s, pattern->s);
+        default:
+            return false;
+    }
+}
+
+/*
+* Adds the pattern variables of depth at least 1 in 'template' to
+* 'repeated'.
+*/
+static Binding *repeatedVariables(Value *template, Binding *bindings,
+                                  Binding *repeated) {
+    if (template->type == SYMBOL_TYPE) {
+        Binding *binding = lookUp(bindings, template->s);
+        if (binding && binding->depth > 0 && !lookUp(repeated, template->s)) {
+            return bind(binding->name, binding->depth, binding->value, repeated);
+        }
+        return repeated;
+    }
+    for (; template->type == CONS_TYPE; template = cdr(template)) {
+        repeated = repeatedVariables(car(template), bindings, repeated);
+    }
+    return repeated;
+}
+
+/*
+* Appends 'item' to the list ending in the pair *last, or starting it in
+* *list if it is empty.
+*/
+static void append(Value **list, Value **last, Value *item) {
+    Value *pair = cons(item, makeNull());
+    if (*last) {
+        (*last)->c.cdr = pair;
+    } else {
+        *list = pair;
+    }
+    *last = pair;
+}
+
+/*
+* Returns 'template' with pattern variables replaced by what they matched
+* and the names in 'renames' renamed.
+*/
+static Value *instantiate(Interpreter *interp, Value *template,
+                          Binding *bindings, Binding *renames) {
+    if (template->type == SYMBOL_TYPE) {
+        Binding *binding = lookUp(bindings, template->s);
+        if (binding) {
+            if (binding->depth > 0) {
+                evaluationError(interp, "Pattern variable used without ... in template");
+            }
+            return binding->value;
+        }
+        binding = lookUp(renames, template->s);
+        return binding ? binding->value : template;
+    }
+    if (template->type != CONS_TYPE) {
+        return template;
+    }
+    Value *list = makeNull();
+    Value *last = NULL;
+    while (template->type == CONS_TYPE) {
+        Value *element = car(template);
+        if (element->type == DOT_TYPE && cdr(template)->type == CONS_TYPE) {
+            Value *tail = instantiate(interp, car(cdr(template)), bindings,
+                                      renames);
+            if (tail->type == CONS_TYPE || tail->type == NULL_TYPE) {
+                // code has no dotted pairs, so the tail's elements join the list
+                for (; tail->type == CONS_TYPE; tail = cdr(tail)) {
+                    append(&list, &last, car(tail));
+                }
+            } else {
+                append(&list, &last, element);
+                append(&list, &last, tail);
+            }
+            break;
+        }
+        if (cdr(template)->type == CONS_TYPE &&
+            isSymbol(car(cdr(template)), ELLIPSIS)) {
+            Binding *repeated = repeatedVariables(element, bindings, NULL);
+            if (!repeated) {
+                evaluationError(interp, "No pattern variable to repeat before ... in template");
+            }
+            int count = countList(repeated->value);
+            for (Binding *r = repeated->next; r; r = r->next) {
+                if (countList(r->value) != count) {
+                    evaluationError(interp, "Pattern variables repeated by ... matched different numbers of forms");
+                }
+            }
+            // each repetition binds the variables to their next values
+            for (int i = 0; i < count; i++) {
+                Binding *inner = bindings;
+                for (Binding *r = repeated; r; r = r->next) {
+                    inner = bind(r->name, r->depth - 1, car(r->value), inner);
+                    r->value = cdr(r->value);
+                }
+                append(&list, &last,
+                       instantiate(interp, element, inner, renames));
+            }
+            template = cdr(cdr(template));
+            continue;
+        }
+        append(&list, &last, instantiate(interp, element, bindings, renames));
+        template = cdr(template);
+    }
+    return list;
+}
+
+/*
+* Adds 'name' to 'binders' unless it is a pattern variable or already
+* there.
+*/
+static Binding *addBinder(Value *name, Binding *variables, Binding *binders) {
+    if (name->type != SYMBOL_TYPE || isSymbol(name, ELLIPSIS) ||
+        lookUp(variables, name->s) || lookUp(binders, name->s)) {
+        return binders;
+    }
+    return bind(name->s, 0, NULL, binders);
+}
+
+/*
+* Adds the names 'template' binds with lambda, let, let*, letrec, named
+* let or do, other than the pattern variables in 'variables', to
+* 'binders'.
+*/
+static Binding *templateBinders(Value *template, Binding *variables,
+                                Binding *binders) {
+    if (template->type != CONS_TYPE) {
+        return binders;
+    }
+    Value *args = cdr(template);
+    if (isForm(template, "lambda") && args->type == CONS_TYPE) {
+        Value *parameters = car(args);
+        binders = addBinder(parameters, variables, binders);
+        for (; parameters->type == CONS_TYPE; parameters = cdr(parameters)) {
+            binders = addBinder(car(parameters), variables, binders);
+        }
+    } else if ((isForm(template, "let") || isForm(template, "let*") ||
+                isForm(template, "letrec") || isForm(template, "do")) &&
+               args->type == CONS_TYPE) {
+        Value *bindings = car(args);
+        if (bindings->type == SYMBOL_TYPE && cdr(args)->type == CONS_TYPE) {
+            binders = addBinder(bindings, variables, binders);
+            bindings = car(cdr(args));
+        }
+        for (; bindings->type == CONS_TYPE; bindings = cdr(bindings)) {
+            if (car(bindings)->type == CONS_TYPE) {
+                binders = addBinder(car(car(bindings)), variables, binders);
+            }
+        }
+    }
+    for (; template->type == CONS_TYPE; template = cdr(template)) {
+        binders = templateBinders(car(template), variables, binders);
+    }
+    return binders;
+}
+
+Value *makeMacro(Interpreter *interp, Value *spec) {
+    char *invalid = "Invalid syntax-rules specification";
+    if (!isForm(spec, "syntax-rules") || countList(spec) < 2 ||
+        countList(car(cdr(spec))) < 0) {
+        evaluationError(interp, invalid);
+    }
+    Macro *macro = talloc(sizeof(Macro));
+    macro->literals = car(cdr(spec));
+    for (Value *l = macro->literals; l->type == CONS_TYPE; l = cdr(l)) {
+        if (car(l)->type != SYMBOL_TYPE) {
+            evaluationError(interp, invalid);
+        }
+    }
+    Value *rules = cdr(cdr(spec));
+    macro->ruleCount = countList(rules);
+    macro->rules = talloc(macro->ruleCount * sizeof(Rule));
+    for (int i = 0; i < macro->ruleCount; i++, rules = cdr(rules)) {
+        Value *rule = car(rules);
+        if (countList(rule) != 2 || car(rule)->type != CONS_TYPE) {
+            evaluationError(interp, invalid);
+        }
+        // the keyword's position in the pattern matches anything
+        macro->rules[i].pattern = cdr(car(rule));
+        macro->rules[i].template = car(cdr(rule));
+        Binding *variables = patternVariables(macro, macro->rules[i].pattern,
+                                              0, NULL);
+        macro->rules[i].binders = templateBinders(macro->rules[i].template,
+                                                  variables, NULL);
+    }
+    Value *value = makeNull();
+    value->type = MACRO_TYPE;
+    value->macro = macro;
+    __atomic_store_n(&macrosDefined, true, __ATOMIC_RELAXED);
+    return value;
+}
+
+/*
+* Returns true if 'name' is bound in 'scope', a list of the symbols bound
+* locally around the form being expanded.
+*/
+static bool inScope(Value *scope, char *name) {
+    for (; scope->type == CONS_TYPE; scope = cdr(scope)) {
+        if (!strcmp(car(scope)->s, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+* Adds to 'renames' the free names in 'template', those that are neither
+* pattern variables in 'bindings' nor already renamed, that are bound in
+* 'scope' at the use but refer to a global binding in the template. Each
+* is renamed to a symbol no local binding can have, already holding the
+* global cell (see lookUpSymbol), so the use's locals cannot capture it.
+*/
+static Binding *globalRenames(Interpreter *interp, Value *template,
+                              Binding *bindings, Value *scope,
+                              Binding *renames) {
+    if (template->type == SYMBOL_TYPE) {
+        if (lookUp(bindings, template->s) || lookUp(renames, template->s) ||
+            !inScope(scope, template->s)) {
+            return renames;
+        }
+        Value *cell = findCell(interp->global, template->s);
+        if (!cell) {
+            return renames;
+        }
+        // no symbol read from source contains a #
+        char *name = talloc(strlen(template->s) + 8);
+        sprintf(name, "%s#global", template->s);
+        Value *symbol = makeSymbol(name);
+        symbol->cell = cell;
+        return bind(template->s, 0, symbol, renames);
+    }
+    for (; template->type == CONS_TYPE; template = cdr(template)) {
+        renames = globalRenames(interp, car(template), bindings, scope,
+                                renames);
+    }
+    return renames;
+}
+
+/*
+* Returns the expansion of 'form', a use of the macro 'macro' in 'scope'.
+*/
+static Value *expandUse(Interpreter *interp, Macro *macro, Value *form,
+                        Value *scope) {
+    for (int i = 0; i < macro->ruleCount; i++) {
+        Rule *rule = &macro->rules[i];
+        Binding *bindings = NULL;
+        if (!matchPattern(macro, rule->pattern, cdr(form), &bindings)) {
+            continue;
+        }
+        Binding *renames = NULL;
+        for (Binding *b = rule->binders; b; b = b->next) {
+            long n = __atomic_add_fetch(&renameCount, 1, __ATOMIC_RELAXED);
+            // no symbol read from source contains a #
+            char *name = talloc(strlen(b->name) + 24);
+            sprintf(name, "%s#%ld", b->name, n);
+            renames = bind(b->name, 0, makeSymbol(name), renames);
+        }
+        renames = globalRenames(interp, rule->template, bindings, scope,
+                                renames);
+        return instantiate(interp, rule->template, bindings, renames);
+    }
+    char *message = talloc(strlen(car(form)->s) + 40);
+    sprintf(message, "No syntax-rules pattern matches %s", car(form)->s);
+    evaluationError(interp, message);
+    return NULL;
+}
+
+/*
+* Adds the symbols in a parameter list, a variadic parameter, or the
+* variables of let or do bindings to 'scope'.
+*/
+static Value *bindNames(Value *names, Value *scope) {
+    if (names->type == SYMBOL_TYPE) {
+        return cons(names, scope);
+    }
+    for (; names->type == CONS_TYPE; names = cdr(names)) {
+        Value *name = car(names);
+        if (name->type == CONS_TYPE) {
+            name = car(name);
+        }
+        if (name->type == SYMBOL_TYPE) {
+            scope = cons(name, scope);
+        }
+    }
+    return scope;
+}
+
+/*
+* Adds the names defined directly in 'body' to 'scope'.
+*/
+static Value *bindDefinitions(Value *body, Value *scope) {
+    for (; body->type == CONS_TYPE; body = cdr(body)) {
+        if (isForm(car(body), "define") && cdr(car(body))->type == CONS_TYPE &&
+            car(cdr(car(body)))->type == SYMBOL_TYPE) {
+            scope = cons(car(cdr(car(body))), scope);
+        }
+    }
+    return scope;
+}
+
+static Value *expandIn(Interpreter *interp, Value *expr, Value *scope);
+
+/*
+* Expands each element of 'list' in 'scope'. Returns 'list' itself if
+* nothing in it changed.
+*/
+static Value *expandEach(Interpreter *interp, Value *list, Value *scope) {
+    int count = 0;
+    for (Value *l = list; l->type == CONS_TYPE; l = cdr(l)) {
+        count++;
+    }
+    Value *onStack[ITEMS_ON_STACK];
+    Value **items = count <= ITEMS_ON_STACK ? onStack
+                                            : talloc(count * sizeof(Value *));
+    bool changed = false;
+    Value *l = list;
+    for (int i = 0; i < count; i++, l = cdr(l)) {
+        items[i] = expandIn(interp, car(l), scope);
+        changed = changed || items[i] != car(l);
+    }
+    if (!changed) {
+        return list;
+    }
+    Value *result = l; // keeps an improper tail as it is
+    for (int i = count - 1; i >= 0; i--) {
+        result = cons(items[i], result);
+    }
+    return result;
+}
+
+/*
+* (let bindings body ...), (let* ...), (letrec ...), named let, or
+* (do bindings (test result ...) command ...), given as 'args' without the
+* keyword.
+*/
+static Value *expandBindingForm(Interpreter *interp, char *form, Value *args,
+                                Value *scope) {
+    bool named = args->type == CONS_TYPE && car(args)->type == SYMBOL_TYPE &&
+                 cdr(args)->type == CONS_TYPE;
+    Value *bindings = named ? car(cdr(args)) : car(args);
+    Value *rest = named ? cdr(cdr(args)) : cdr(args);
+    Value *inner = bindNames(bindings, named ? cons(car(args), scope) : scope);
+    inner = bindDefinitions(rest, inner);
+    // let and do evaluate their initial values outside the new scope
+    Value *initScope = !strcmp(form, "let") || !strcmp(form, "do") ? scope
+                                                                  : inner;
+    Value *reversed = makeNull();
+    bool changed = false;
+    for (Value *b = bindings; b->type == CONS_TYPE; b = cdr(b)) {
+        Value *binding = car(b);
+        if (countList(binding) >= 2) {
+            Value *init = expandIn(interp, car(cdr(binding)), initScope);
+            Value *step = expandEach(interp, cdr(cdr(binding)), inner);
+            if (init != car(cdr(binding)) || step != cdr(cdr(binding))) {
+                binding = cons(car(binding), cons(init, step));
+                changed = true;
+            }
+        }
+        reversed = cons(binding, reversed);
+    }
+    Value *newRest = expandEach(interp, rest, inner);
+    if (!changed && newRest == rest) {
+        return args;
+    }
+    Value *newBindings = bindings->type == CONS_TYPE ? makeNull() : bindings;
+    for (; reversed->type == CONS_TYPE; reversed = cdr(reversed)) {
+        newBindings = cons(car(reversed), newBindings);
+    }
+    return named ? cons(car(args), cons(newBindings, newRest))
+                 : cons(newBindings, newRest);
+}
+
+static Value *expandIn(Interpreter *interp, Value *expr, Value *scope) {
+    if (expr->type != CONS_TYPE) {
+        return expr;
+    }
+    Value *first = car(expr);
+    Value *args = cdr(expr);
+    if (first->type != SYMBOL_TYPE) {
+        return expandEach(interp, expr, scope);
+    }
+    char *name = first->s;
+    if (!strcmp(name, "quote")) {
+        return expr;
+    }
+    if (!strcmp(name, "define-syntax")) {
+        // made now, so the forms after it can use it
+        if (countList(args) != 2 || car(args)->type != SYMBOL_TYPE ||
+            car(cdr(args))->type == MACRO_TYPE) {
+            return expr;
+        }
+        Value *macro = makeMacro(interp, car(cdr(args)));
+        defineSymbol(car(args), macro, interp->global);
+        return cons(first, cons(car(args), cons(macro, makeNull())));
+    }
+    if (!inScope(scope, name)) {
+        // a name renamed by globalRenames already has its global cell
+        Value *cell = __atomic_load_n(&first->cell, __ATOMIC_ACQUIRE);
+        if (!cell) {
+            cell = findCell(interp->global, name);
+        }
+        if (cell && car(cell)->type == MACRO_TYPE) {
+            return expandIn(interp,
+                            expandUse(interp, car(cell)->macro, expr, scope),
+                            scope);
+        }
+    }
+    Value *rest = args;
+    if (!strcmp(name, "lambda") && args->type == CONS_TYPE) {
+        Value *inner = bindDefinitions(cdr(args),
+                                       bindNames(car(args), scope));
+        Value *body = expandEach(interp, cdr(args), inner);
+        rest = body == cdr(args) ? args : cons(car(args), body);
+    } else if ((!strcmp(name, "let") || !strcmp(name, "let*") ||
+                !strcmp(name, "letrec") || !strcmp(name, "do")) &&
+               args->type == CONS_TYPE) {
+        rest = expandBindingForm(interp, name, args, scope);
+    } else if (!strcmp(name, "define") && args->type == CONS_TYPE) {
+        Value *value = expandEach(interp, cdr(args), scope);
+        rest = value == cdr(args) ? args : cons(car(args), value);
+    } else {
+        rest = expandEach(interp, args, scope);
+    }
+    return rest == args ? expr : cons(first, rest);
+}
+
+/*
+* Returns true if the symbol 'name' appears anywhere in 'tree'.
+*/
+static bool mentions(Value *tree, char *name) {
+    while (tree->type == CONS_TYPE) {
+        if (mentions(car(tree), name)) {
+            return true;
+        }
+        tree = cdr(tree);
+    }
+    return isSymbol(tree, name);
+}
+
+Value *expandMacros(Interpreter *interp, Value *form) {
+    if (!__atomic_load_n(&macrosDefined, __ATOMIC_RELAXED) &&
+        !mentions(form, "define-syntax")) {
+        return form;
+    }
+    return expandIn(interp, form, makeNull());
+}
+
+size_t macroReferences(Value *macro, HeapVisitor visit, void *data) {
+    Macro *m = macro->macro;
+    visit(data, m->literals, false);
+    size_t size = sizeof(Macro) + m->ruleCount * sizeof(Rule);
+    for (int i = 0; i < m->ruleCount; i++) {
+        visit(data, m->rules[i].pattern, false);
+        visit(data, m->rules[i].template, false);
+        for (Binding *b = m->rules[i].binders; b; b = b->next) {
+            size += sizeof(Binding);
+        }
+    }
+    return size;
+}
@@ -0,0 +1,50 @@
+#include "value.h"
+#include "context.h"
+#include "heapdump.h"
+
+#ifndef MACRO_H
+#define MACRO_H
+
+/*
+* syntax-rules macros. (define-syntax name (syntax-rules (literal ...)
+* (pattern template) ...)) binds name in the global frame to a macro, and
+* a form (name ...) is then rewritten using the template of the first
+* pattern it matches. Patterns may contain literals, _, nested lists, a
+* dotted tail, and ... after a subpattern, which matches it any number of
+* times.
+*
+* Forms are expanded once, before they are evaluated, along with the
+* other rewrites applied to top-level forms (see optimizer.h), so a macro
+* costs nothing when the code runs: the expanded code is what is cached
+* in closures and evaluated. A macro must therefore be defined before the
+* forms using it are read; a use read before is evaluated as a call, and
+* raises an error.
+*
+* Names the template binds (with lambda, let, let*, letrec, named let or
+* do) are renamed at each expansion, so they cannot capture variables of
+* the code the macro is used in. Other names in the template that are
+* bound globally when the macro is used refer to that global binding, even
+* inside a local binding of the same name at the use; the rest refer to
+* whatever they are bound to there.
+*/
+
+/*
+* Returns the macro described by (syntax-rules (literal ...) rule ...),
+* raising an error if it is malformed.
+*/
+Value *makeMacro(Interpreter *interp, Value *spec);
+
+/*
+* Returns 'form', a form about to be evaluated, with every use of a macro
+* in it expanded, and any define-syntax in it made first. Names bound
+* locally hide macros of the same name. The form itself is not modified.
+*/
+Value *expandMacros(Interpreter *interp, Value *form);
+
+/*
+* Visits the literals, patterns and templates of the macro 'macro', for
+* heap-dump (see heapdump.h), and returns the size of its rules.
+*/
+size_t macroReferences(Value *macro, HeapVisitor visit, void *data);
+
+#endif
@@ -5,10 +5,16 @@
 #include "tokenizer.h"
 #include "parser.h"
 #include "interpreter.h"
+#include "trace.h"
+#include "profiler.h"
+#include "scheme.h"
+#include "server.h"
+#include "optimizer.h"
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <setjmp.h>
 
 /**********
 countParen and append are helper functions for the REPL loop.
@@ -52,9 +58,127 @@ Value *append(Value *arg1, Value *arg2) {
     return arg2;
 }
 
-int main(void) {
+/*
+* Reads one line in the REPL, adding its tokens to those of earlier lines
+* that are still waiting for closing parentheses, and evaluates the
+* expressions once they are complete. Returns the tokens still waiting. A
+* syntax error is printed and discards the waiting tokens.
+*/
+Value *replLine(Interpreter *interp, Value *prevList) {
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (setjmp(onError)) {
+        restore(interp, &saved);
+        printf("%s", interp->error);
+        interp->errorCount++;
+        return makeNull();
+    }
+    Value *list = tokenize(interp, true);
+    // store past lines to eval multi-line commands
+    prevList = append(prevList, list);
+    if (countParen(prevList) <= 0) {
+        Value *tree = parse(interp, prevList);
+        interpret(interp, tree);
+        prevList = makeNull();
+    }
+    restore(interp, &saved);
+    return prevList;
+}
+
+// Set by parseOptions.
+static char *servePath = NULL;
+static bool serveForking = false;
+static char **loadPaths = NULL;
+static int loadCount = 0;
+static int optimizations = OPTIMIZE_ALL;
+
+/*
+* Handles command-line options. Currently supported:
+*     --trace FILE    record closure, primitive, load and top-level form
+*                     events and write them to FILE as Chrome trace JSON
+*     --profile-alloc attribute every allocation to its C call site and the
+*                     Scheme procedure running, reporting the top sites
+*                     on stderr at exit
+*     --load FILE     evaluate FILE, without printing results, before
+*                     reading the program; may be given more than once
+*     --serve SOCKET  load math.scm and any --load files, then evaluate
+*                     programs sent over the Unix domain socket SOCKET
+*     --fork          with --serve, run each request in a forked child
+*     --optimize LIST rewrites to apply to each top-level form, from fold,
+*                     primitives, let, unused, helpers, all and none
+*                     (see optimizer.h); all by default
+* Exits with an error message on an unknown option.
+*/
+void parseOptions(int argc, char *argv[]) {
+    loadPaths = malloc(argc * sizeof(char *));
+    assert(loadPaths);
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            i++;
+            if (!traceStart(argv[i])) {
+                printf("Error: could not open trace file %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(argv[i], "--profile-alloc")) {
+            profileStart();
+        } else if (!strcmp(argv[i], "--load") && i + 1 < argc) {
+            loadPaths[loadCount++] = argv[++i];
+        } else if (!strcmp(argv[i], "--serve") && i + 1 < argc) {
+            servePath = argv[++i];
+        } else if (!strcmp(argv[i], "--fork")) {
+            serveForking = true;
+        } else if (!strcmp(argv[i], "--optimize") && i + 1 < argc &&
+                   parseOptimizations(argv[i + 1]) >= 0) {
+            optimizations = parseOptimizations(argv[++i]);
+        } else {
+            printf("Usage: %s [--trace FILE] [--profile-alloc] [--load FILE]"
+                   " [--serve SOCKET [--fork]] [--optimize LIST]\n", argv[0]);
+            exit(1);
+        }
+    }
+}
+
+/*
+* Loads the --load files, and in server mode math.scm before them. Returns
+* false, having printed the error, if one of them fails.
+*/
+bool loadFiles(Interpreter *interp) {
+    if (servePath && !schemeLoad(interp, "math.scm")) {
+        printf("%s", schemeError(interp));
+        return false;
+    }
+    for (int i = 0; i < loadCount; i++) {
+        if (!schemeLoad(interp, loadPaths[i])) {
+            printf("%s", schemeError(interp));
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    parseOptions(argc, argv);
     int t = isatty(0);
-    Frame *frame = makeFrame();
+    Interpreter *interp = makeInterpreter();
+    interp->optimizations = optimizations;
+    if (!loadFiles(interp)) {
+        destroyInterpreter(interp);
+        return 1;
+    }
+    if (servePath) {
+        serve(interp, servePath, serveForking);
+        destroyInterpreter(interp);
+        return 1;
+    }
+    jmp_buf onError;
+    if (setjmp(onError)) {
+        // a syntax error in batch mode: report it and stop
+        printf("%s", interp->error);
+        destroyInterpreter(interp);
+        return 1;
+    }
+    interp->onError = &onError;
     if (t) {
         // isatty is true: want interactive loop
         printf("> ");
@@ -62,16 +186,8 @@ int main(void) {
         Value *prevList = makeNull();
         while (charRead != EOF) {
             ungetc(charRead, stdin);
-            Value *list = tokenize(true);
-            // store past lines to eval multi-line commands
-            prevList = append(prevList, list);
-            int count = countParen(prevList); 
-            if (count <= 0) {
-                Value *tree = parse(prevList);
-                interpret(tree, frame);
-                prevList = makeNull();
-                count = 0;
-            }
+            prevList = replLine(interp, prevList);
+            int count = countParen(prevList);
             printf("> ");
             for (int i=0; i<count; i++) {
                 printf("   ");
@@ -80,10 +196,11 @@ int main(void) {
         }
     } else {
         // isatty is false: proceed like normal
-        Value *list = tokenize(false);
-        Value *tree = parse(list);
-        interpret(tree, frame);
+        Value *list = tokenize(interp, false);
+        Value *tree = parse(interp, list);
+        interpret(interp, tree);
     }
-    tfree();
-    return 0;
+    int status = interp->errorCount ? 1 : 0;
+    destroyInterpreter(interp);
+    return status;
 }
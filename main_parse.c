@@ -5,13 +5,15 @@
 #include "tokenizer.h"
 #include "talloc.h"
 #include "linkedlist.h"
+#include "interpreter.h"
 #include "parser.h"
 
 int main(void) {
-    Value *list = tokenize(stdin);
-    Value *tree = parse(list);
+    Interpreter *interp = makeInterpreter();
+    Value *list = tokenize(interp, false);
+    Value *tree = parse(interp, list);
     printTree(tree);
     printf("\n");
-    tfree();
+    destroyInterpreter(interp);
     return 0;
 }
@@ -5,11 +5,13 @@
 #include "tokenizer.h"
 #include "talloc.h"
 #include "linkedlist.h"
+#include "interpreter.h"
 
 int main(void) {
-   Value *list = tokenize(stdin);
+   Interpreter *interp = makeInterpreter();
+   Value *list = tokenize(interp, false);
    displayTokens(list);
    //display(list);
-   tfree();
+   destroyInterpreter(interp);
    return 0;
 }
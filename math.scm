@@ -6,12 +6,19 @@
   (lambda (x)
     (if x #f #t)))
 
+;; Helper function: returns #t if every element of lst is a number,
+;; stopping at the first that is not
+(define all-numbers?
+  (lambda (lst)
+    (let/ec return
+      (foldl (lambda (x acc) (if (number? x) acc (return #f))) #t lst))))
+
 ;; Given at least 2 numbers, returns #t if they are all equal
 (define =
   (lambda args
     (cond ((<= (length args) 1)
            (error "Wrong number of arguments provided for ="))
-          ((not (foldl (lambda (a b) (and a b)) #t (map number? args)))
+          ((not (all-numbers? args))
            (error "Wrong argument type provided for ="))
           (else
            (and (apply <= args) (apply <= (reverse args)))))))
@@ -21,7 +28,7 @@
   (lambda args
     (cond ((<= (length args) 1)
            (error "Wrong number of arguments provided for >="))
-          ((not (foldl (lambda (a b) (and a b)) #t (map number? args)))
+          ((not (all-numbers? args))
            (error "Wrong argument type provided for >="))
           (else
            (apply <= (reverse args))))))
@@ -40,7 +47,7 @@
                       (else (diff (cdr lst)))))))
       (cond ((<= (length args) 1)
              (error "Wrong number of arguments provided for <"))
-            ((not (foldl (lambda (a b) (and a b)) #t (map number? args)))
+            ((not (all-numbers? args))
              (error "Wrong argument type provided for <"))
             (else
              (and (apply <= args) (diff args)))))))
@@ -50,7 +57,7 @@
   (lambda args
     (cond ((<= (length args) 1)
            (error "Wrong number of arguments provided for <"))
-          ((not (foldl (lambda (a b) (and a b)) #t (map number? args)))
+          ((not (all-numbers? args))
            (error "Wrong argument type provided for <"))
           (else
            (apply < (reverse args))))))
@@ -117,7 +124,7 @@
                        (maxhelper curmax (cdr lst)))))))
       (cond ((= (length args) 0)
              (error "Wrong number of arguments provided for max"))
-            ((not (foldl (lambda (a b) (and a b)) #t (map number? args)))
+            ((not (all-numbers? args))
              (error "Wrong argument type provided for max"))
             (else (maxhelper '() args))))))
 
@@ -126,7 +133,7 @@
   (lambda args
     (cond ((= (length args) 0)
            (error "Wrong number of arguments provided for min"))
-          ((not (foldl (lambda (a b) (and a b)) #t (map number? args)))
+          ((not (all-numbers? args))
            (error "Wrong argument type provided for min"))
           (else (- 0 (apply max (map (lambda (x) (- 0 x)) args)))))))
 
@@ -194,11 +201,15 @@
                        (gcd-helper (min (abs n) (abs m))
                                    (max (abs n) (abs m))))))))
       (cond ((null? args) 0)
-            ((not (number? (car args)))
+            ((not (all-numbers? args))
              (error "Wrong argument type provided for gcd"))
             ((= (length args) 1)
              (car args))
-            (else (foldl gcd-two 0 args))))))
+            (else ; stop once the gcd so far is 1
+             (let/ec return
+               (foldl (lambda (n acc)
+                        (if (= acc 1) (return 1) (gcd-two n acc)))
+                      0 args)))))))
 
 ;; Given n = <digit>* <dot> <digit>*, returns
 ;; the number resulting from removing everything after <dot>
@@ -226,11 +237,15 @@
                                 (abs m)
                                 (abs m))))))
       (cond ((null? args) 1)
-            ((not (foldl (lambda (a b) (and a b)) #t (map number? args)))
+            ((not (all-numbers? args))
              (error "Wrong argument type provided for lcm"))
             ((= (length args) 1)
              (car args))
-            (else (foldl lcm-two 1 args))))))
+            (else ; stop at the first 0
+             (let/ec return
+               (foldl (lambda (n acc)
+                        (if (zero? n) (return 0) (lcm-two n acc)))
+                      1 args)))))))
 
 ;; Rounds to the closest integer. If it is halfway between two integers,
 ;; rounds to the even one
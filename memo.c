@@ -0,0 +1,345 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "memo.h"
+#include "text.h"
+
+#define INITIAL_BUCKETS 64 // must be a power of two
+
+/*
+* A cached result. Entries are chained in their bucket and kept on a list
+* from most to least recently used.
+*/
+typedef struct Entry {
+    unsigned long hash;
+    Value *key;     // the argument list
+    Value *result;
+    struct Entry *chain;
+    struct Entry *newer;
+    struct Entry *older;
+} Entry;
+
+/*
+* The cache of one memoized procedure. It lives on the heap that was
+* current when it was made; entries evicted or cleared are reused rather
+* than allocated again.
+*/
+struct Memo {
+    Value *procedure; // the closure being memoized
+    int capacity;     // 0 if unbounded
+    int count;
+    Entry **buckets;
+    int bucketCount;  // a power of two
+    Entry *newest;
+    Entry *oldest;
+    Entry *spare;     // cleared entries, chained through 'chain'
+    long hits;
+    long misses;
+    long evictions;
+    pthread_mutex_t lock;
+};
+typedef struct Memo Memo;
+
+static unsigned long mix(unsigned long hash, unsigned long value) {
+    return hash ^ (value + 0x9e3779b97f4a7c15UL + (hash << 6) + (hash >> 2));
+}
+
+/*
+* FNV-1a.
+*/
+static unsigned long hashString(char *s) {
+    unsigned long hash = 14695981039346656037UL;
+    for (; *s; s++) {
+        hash = (hash ^ (unsigned char)*s) * 1099511628211UL;
+    }
+    return hash;
+}
+
+/*
+* Hashes 'value' consistently with equalValues.
+*/
+static unsigned long hashValue(Value *value) {
+    unsigned long hash = CONS_TYPE;
+    // the spine of a list is hashed in a loop, its elements recursively
+    while (value->type == CONS_TYPE) {
+        hash = mix(hash, hashValue(car(value)));
+        value = cdr(value);
+    }
+    hash = mix(hash, value->type);
+    switch (value->type) {
+        case INT_TYPE:
+            return mix(hash, (unsigned long)value->i);
+        case DOUBLE_TYPE: {
+            unsigned long bits = 0;
+            memcpy(&bits, &value->d, sizeof(value->d));
+            return mix(hash, bits);
+        }
+        case STR_TYPE:
+            return mix(hash, stringHash(value));
+        case SYMBOL_TYPE:
+            return mix(hash, hashString(value->s));
+        case BOOL_TYPE:
+            return mix(hash, value->b);
+        case NULL_TYPE:
+        case VOID_TYPE:
+            return hash;
+        default:
+            return mix(hash, (unsigned long)value);
+    }
+}
+
+/*
+* Returns true if 'a' and 'b' are equal? to each other.
+*/
+static bool equalValues(Value *a, Value *b) {
+    while (a->type == CONS_TYPE && b->type == CONS_TYPE) {
+        if (!equalValues(car(a), car(b))) {
+            return false;
+        }
+        a = cdr(a);
+        b = cdr(b);
+    }
+    if (a->type != b->type) {
+        return false;
+    }
+    switch (a->type) {
+        case INT_TYPE:
+            return a->i == b->i;
+        case DOUBLE_TYPE:
+            return a->d == b->d;
+        case STR_TYPE:
+            return stringLength(a) == stringLength(b) &&
+                   !memcmp(a->s, b->s, stringLength(a));
+        case SYMBOL_TYPE:
+            return !strcmp(a->s, b->s);
+        case BOOL_TYPE:
+            return a->b == b->b;
+        case NULL_TYPE:
+        case VOID_TYPE:
+            return true;
+        default:
+            return a == b;
+    }
+}
+
+static Entry *findEntry(Memo *memo, unsigned long hash, Value *key) {
+    Entry *entry = memo->buckets[hash & (memo->bucketCount - 1)];
+    while (entry && (entry->hash != hash || !equalValues(entry->key, key))) {
+        entry = entry->chain;
+    }
+    return entry;
+}
+
+static void unlinkRecent(Memo *memo, Entry *entry) {
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        memo->newest = entry->older;
+    }
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        memo->oldest = entry->newer;
+    }
+}
+
+static void linkNewest(Memo *memo, Entry *entry) {
+    entry->newer = NULL;
+    entry->older = memo->newest;
+    if (memo->newest) {
+        memo->newest->newer = entry;
+    } else {
+        memo->oldest = entry;
+    }
+    memo->newest = entry;
+}
+
+static void unlinkChain(Memo *memo, Entry *entry) {
+    Entry **link = &memo->buckets[entry->hash & (memo->bucketCount - 1)];
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+}
+
+/*
+* Doubles the number of buckets once there are more entries than buckets.
+*/
+static void growBuckets(Memo *memo) {
+    int count = memo->bucketCount * 2;
+    Entry **buckets = talloc(count * sizeof(Entry *));
+    memset(buckets, 0, count * sizeof(Entry *));
+    for (Entry *entry = memo->newest; entry; entry = entry->older) {
+        Entry **bucket = &buckets[entry->hash & (count - 1)];
+        entry->chain = *bucket;
+        *bucket = entry;
+    }
+    memo->buckets = buckets;
+    memo->bucketCount = count;
+}
+
+/*
+* Caches 'result' for 'key', evicting the least recently used entry if the
+* cache is full. Another thread may have cached the same key meanwhile, in
+* which case that entry is kept.
+*/
+static void insertEntry(Memo *memo, unsigned long hash, Value *key,
+                        Value *result) {
+    if (findEntry(memo, hash, key)) {
+        return;
+    }
+    Entry *entry;
+    if (memo->capacity && memo->count >= memo->capacity) {
+        entry = memo->oldest;
+        unlinkRecent(memo, entry);
+        unlinkChain(memo, entry);
+        memo->count--;
+        memo->evictions++;
+    } else if (memo->spare) {
+        entry = memo->spare;
+        memo->spare = entry->chain;
+    } else {
+        entry = talloc(sizeof(Entry));
+    }
+    entry->hash = hash;
+    entry->key = key;
+    entry->result = result;
+    Entry **bucket = &memo->buckets[hash & (memo->bucketCount - 1)];
+    entry->chain = *bucket;
+    *bucket = entry;
+    linkNewest(memo, entry);
+    memo->count++;
+    if (memo->count > memo->bucketCount) {
+        growBuckets(memo);
+    }
+}
+
+Value *memoize(Interpreter *interp, Value *procedure, int capacity) {
+    Memo *memo = talloc(sizeof(Memo));
+    memo->procedure = procedure;
+    memo->capacity = capacity;
+    memo->count = 0;
+    memo->bucketCount = INITIAL_BUCKETS;
+    memo->buckets = talloc(INITIAL_BUCKETS * sizeof(Entry *));
+    memset(memo->buckets, 0, INITIAL_BUCKETS * sizeof(Entry *));
+    memo->newest = NULL;
+    memo->oldest = NULL;
+    memo->spare = NULL;
+    memo->hits = 0;
+    memo->misses = 0;
+    memo->evictions = 0;
+    pthread_mutex_init(&memo->lock, NULL);
+    Value *memoized = makeNull();
+    *memoized = *procedure;
+    (memoized->k).memo = memo;
+    return memoized;
+}
+
+Value *applyMemoized(Interpreter *interp, Value *function, Value *args) {
+    Memo *memo = (function->k).memo;
+    unsigned long hash = hashValue(args);
+    pthread_mutex_lock(&memo->lock);
+    Entry *entry = findEntry(memo, hash, args);
+    if (entry) {
+        memo->hits++;
+        unlinkRecent(memo, entry);
+        linkNewest(memo, entry);
+        Value *result = entry->result;
+        pthread_mutex_unlock(&memo->lock);
+        return result;
+    }
+    memo->misses++;
+    pthread_mutex_unlock(&memo->lock);
+    Value *result = apply(interp, memo->procedure, args);
+    pthread_mutex_lock(&memo->lock);
+    insertEntry(memo, hash, args, result);
+    pthread_mutex_unlock(&memo->lock);
+    return result;
+}
+
+/*
+* Returns the cache of a memoized procedure argument, raising 'message' if
+* it is not one.
+*/
+static Memo *memoArgument(Interpreter *interp, Value *args, char *message) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE ||
+        car(args)->type != CLOSURE_TYPE || !(car(args)->k).memo) {
+        evaluationError(interp, message);
+    }
+    return (car(args)->k).memo;
+}
+
+Value *primitiveMemoize(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || (cdr(args)->type != NULL_TYPE &&
+        (cdr(args)->type != CONS_TYPE || cdr(cdr(args))->type != NULL_TYPE))) {
+        evaluationError(interp, "Wrong number of arguments provided for memoize");
+    }
+    Value *procedure = car(args);
+    int capacity = 0;
+    if (cdr(args)->type == CONS_TYPE) {
+        if (car(cdr(args))->type != INT_TYPE || car(cdr(args))->i < 0) {
+            evaluationError(interp, "Wrong argument type provided for memoize");
+        }
+        capacity = car(cdr(args))->i;
+    }
+    if (procedure->type != CLOSURE_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for memoize");
+    }
+    return memoize(interp, procedure, capacity);
+}
+
+Value *primitiveMemoStats(Interpreter *interp, Value *args) {
+    Memo *memo = memoArgument(interp, args,
+                              "memo-stats requires a memoized procedure");
+    pthread_mutex_lock(&memo->lock);
+    Value *stats = makeNull();
+    stats = cons(makeCounter("size", memo->count), stats);
+    stats = cons(makeCounter("evictions", memo->evictions), stats);
+    stats = cons(makeCounter("misses", memo->misses), stats);
+    stats = cons(makeCounter("hits", memo->hits), stats);
+    pthread_mutex_unlock(&memo->lock);
+    return stats;
+}
+
+Value *primitiveMemoClear(Interpreter *interp, Value *args) {
+    Memo *memo = memoArgument(interp, args,
+                              "memo-clear! requires a memoized procedure");
+    pthread_mutex_lock(&memo->lock);
+    while (memo->newest) {
+        Entry *entry = memo->newest;
+        memo->newest = entry->older;
+        entry->chain = memo->spare;
+        memo->spare = entry;
+    }
+    memo->oldest = NULL;
+    memset(memo->buckets, 0, memo->bucketCount * sizeof(Entry *));
+    memo->count = 0;
+    memo->hits = 0;
+    memo->misses = 0;
+    memo->evictions = 0;
+    pthread_mutex_unlock(&memo->lock);
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+size_t memoReferences(struct Memo *memo, HeapVisitor visit, void *data) {
+    pthread_mutex_lock(&memo->lock);
+    visit(data, memo->procedure, false);
+    size_t size = sizeof(Memo) + memo->bucketCount * sizeof(Entry *);
+    for (Entry *entry = memo->newest; entry; entry = entry->older) {
+        visit(data, entry->key, false);
+        visit(data, entry->result, false);
+        size += sizeof(Entry);
+    }
+    for (Entry *entry = memo->spare; entry; entry = entry->chain) {
+        size += sizeof(Entry);
+    }
+    pthread_mutex_unlock(&memo->lock);
+    return size;
+}
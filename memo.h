@@ -0,0 +1,59 @@
+#include "value.h"
+#include "context.h"
+#include "heapdump.h"
+
+#ifndef MEMO_H
+#define MEMO_H
+
+/*
+* Memoized procedures: (memoize proc) returns a procedure that behaves like
+* proc but caches its results in a hash table keyed on the argument list,
+* compared as with equal? (numbers by type and value, strings and symbols
+* by content, pairs element by element, anything else by identity). With a
+* capacity, (memoize proc capacity) keeps at most that many results and
+* evicts the least recently used first.
+*
+* (define-memoized name expr [capacity]) binds name to the memoized value
+* of expr, so a recursive procedure's calls to itself hit the cache too.
+*
+* The memoized procedure is a closure like proc, tagged with its cache, so
+* it can be passed anywhere proc could. Tables are locked, so futures and
+* parallel-map may share one; results are computed outside the lock.
+*/
+
+/*
+* Returns a memoized copy of the closure 'procedure', keeping at most
+* 'capacity' results (any number if 0).
+*/
+Value *memoize(Interpreter *interp, Value *procedure, int capacity);
+
+/*
+* Applies a memoized closure: returns the cached result for 'args', or
+* applies the original closure and caches what it returns.
+*/
+Value *applyMemoized(Interpreter *interp, Value *function, Value *args);
+
+/*
+* (memoize proc) or (memoize proc capacity)
+*/
+Value *primitiveMemoize(Interpreter *interp, Value *args);
+
+/*
+* (memo-stats proc) returns ((hits . n) (misses . n) (evictions . n)
+* (size . n)) for a memoized procedure. A count too large for an integer
+* is given as the largest one.
+*/
+Value *primitiveMemoStats(Interpreter *interp, Value *args);
+
+/*
+* (memo-clear! proc) empties a memoized procedure's cache and counters.
+*/
+Value *primitiveMemoClear(Interpreter *interp, Value *args);
+
+/*
+* Visits the procedure and the cached arguments and results of 'memo', for
+* heap-dump (see heapdump.h), and returns the size of its table.
+*/
+size_t memoReferences(struct Memo *memo, HeapVisitor visit, void *data);
+
+#endif
@@ -0,0 +1,618 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "optimizer.h"
+#include "macro.h"
+
+#define INLINE_SIZE 16  // most nodes in the body of a procedure inlined
+#define INLINE_DEPTH 4  // most procedures inlined within one another
+
+// Names eval treats as special forms whatever they are bound to. Forms not
+// handled by optimizeExpr are left as they are.
+static char *specialForms[] = {
+    "if", "cond", "quote", "let", "and", "or", "let*", "letrec", "define",
+    "define-memoized", "set!", "begin", "lambda", "load", "do",
+    "define-syntax", "delay", "delay-force", "stream-cons",
+    "let/ec", NULL
+};
+
+// Primitives without side effects whose calls on constants can be folded.
+// cons is not one of them: every call must make a new pair.
+static char *foldable[] = {
+    "+", "-", "*", "/", "<=", "eq?", "null?", "pair?", "number?", "car",
+    "cdr", NULL
+};
+
+static bool isOneOf(char *name, char **names) {
+    for (int i = 0; names[i]; i++) {
+        if (!strcmp(name, names[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isForm(Value *expr, char *name) {
+    return expr->type == CONS_TYPE && car(expr)->type == SYMBOL_TYPE &&
+           !strcmp(car(expr)->s, name);
+}
+
+int parseOptimizations(char *list) {
+    static struct {
+        char *name;
+        int flags;
+    } names[] = {
+        {"fold", OPTIMIZE_FOLD}, {"primitives", OPTIMIZE_PRIMITIVES},
+        {"let", OPTIMIZE_LAMBDA_LET}, {"unused", OPTIMIZE_UNUSED},
+        {"helpers", OPTIMIZE_HELPERS}, {"all", OPTIMIZE_ALL}, {"none", 0},
+        {NULL, 0}
+    };
+    int flags = 0;
+    while (*list) {
+        size_t length = strcspn(list, ",");
+        int i = 0;
+        while (names[i].name && (strlen(names[i].name) != length ||
+                                 strncmp(names[i].name, list, length))) {
+            i++;
+        }
+        if (!names[i].name) {
+            return -1;
+        }
+        flags |= names[i].flags;
+        list += length;
+        if (*list == ',') {
+            list++;
+        }
+    }
+    return flags;
+}
+
+/*
+* Returns true if 'name' is bound in 'scope', a list of the symbols bound
+* by the enclosing lambdas and lets.
+*/
+static bool inScope(Value *scope, char *name) {
+    for (; scope->type == CONS_TYPE; scope = cdr(scope)) {
+        if (!strcmp(car(scope)->s, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+* Adds the symbols in a parameter list, or a variadic parameter, to 'scope'.
+*/
+static Value *bindParameters(Value *parameters, Value *scope) {
+    if (parameters->type == SYMBOL_TYPE) {
+        return cons(parameters, scope);
+    }
+    for (; parameters->type == CONS_TYPE; parameters = cdr(parameters)) {
+        if (car(parameters)->type == SYMBOL_TYPE) {
+            scope = cons(car(parameters), scope);
+        }
+    }
+    return scope;
+}
+
+/*
+* Adds the names a body may define in its own frame to 'scope'. Any define
+* in it counts, however deeply nested, so that the scope errs on the side
+* of treating a name as local.
+*/
+static Value *bindDefinitions(Value *body, Value *scope) {
+    for (; body->type == CONS_TYPE; body = cdr(body)) {
+        Value *expr = car(body);
+        if ((isForm(expr, "define") || isForm(expr, "define-memoized")) &&
+            cdr(expr)->type == CONS_TYPE && car(cdr(expr))->type == SYMBOL_TYPE) {
+            scope = cons(car(cdr(expr)), scope);
+        }
+        if (expr->type == CONS_TYPE && !isForm(expr, "quote")) {
+            scope = bindDefinitions(expr, scope);
+        }
+    }
+    return scope;
+}
+
+/*
+* Returns true if the symbol 'name' appears anywhere in 'tree'.
+*/
+static bool mentions(Value *tree, char *name) {
+    while (tree->type == CONS_TYPE) {
+        if (mentions(car(tree), name)) {
+            return true;
+        }
+        tree = cdr(tree);
+    }
+    return tree->type == SYMBOL_TYPE && !strcmp(tree->s, name);
+}
+
+/*
+* Returns true if a symbol in 'tree' other than those in 'except' is bound
+* in 'scope'.
+*/
+static bool captures(Value *tree, Value *scope, Value *except) {
+    while (tree->type == CONS_TYPE) {
+        if (captures(car(tree), scope, except)) {
+            return true;
+        }
+        tree = cdr(tree);
+    }
+    return tree->type == SYMBOL_TYPE && !inScope(except, tree->s) &&
+           inScope(scope, tree->s);
+}
+
+static int treeSize(Value *tree) {
+    int size = 1;
+    while (tree->type == CONS_TYPE) {
+        size += treeSize(car(tree));
+        tree = cdr(tree);
+    }
+    return size;
+}
+
+/*
+* Returns the number of symbols in 'parameters', or -1 if it is not a list
+* of distinct symbols, as for a variadic parameter list (a bare symbol, or
+* a list with a dot in it).
+*/
+static int countParameters(Value *parameters) {
+    if (parameters->type != NULL_TYPE && parameters->type != CONS_TYPE) {
+        return -1;
+    }
+    int count = 0;
+    for (Value *p = parameters; p->type == CONS_TYPE; p = cdr(p)) {
+        if (car(p)->type != SYMBOL_TYPE) {
+            return -1;
+        }
+        for (Value *q = cdr(p); q->type == CONS_TYPE; q = cdr(q)) {
+            if (car(q)->type == SYMBOL_TYPE && !strcmp(car(p)->s, car(q)->s)) {
+                return -1;
+            }
+        }
+        count++;
+    }
+    return count;
+}
+
+static int countList(Value *list) {
+    int count = 0;
+    for (; list->type == CONS_TYPE; list = cdr(list)) {
+        count++;
+    }
+    return list->type == NULL_TYPE ? count : -1;
+}
+
+/*
+* Returns the cell of the global binding 'symbol' refers to in 'scope', or
+* NULL if it is local, a special form or not bound yet.
+*/
+static Value *globalCell(Interpreter *interp, Value *symbol, Value *scope) {
+    if (symbol->type != SYMBOL_TYPE || inScope(scope, symbol->s) ||
+        isOneOf(symbol->s, specialForms)) {
+        return NULL;
+    }
+    return findCell(interp->global, symbol->s);
+}
+
+/*
+* Returns (fast slow) behind a guard: eval runs 'fast' while every (cell .
+* value) pair in 'checks' still holds, and 'slow' otherwise.
+*/
+static Value *makeGuard(Value *checks, Value *fast, Value *slow) {
+    Value *guard = makeNull();
+    guard->type = GUARD_TYPE;
+    guard->checks = checks;
+    return cons(guard, cons(fast, cons(slow, makeNull())));
+}
+
+static Value *appendChecks(Value *checks, Value *more) {
+    for (; more->type == CONS_TYPE; more = cdr(more)) {
+        checks = cons(car(more), checks);
+    }
+    return checks;
+}
+
+/*
+* Returns the value of 'expr' if it is a constant, adding the guards it
+* depends on to *checks, or NULL if it is not.
+*/
+static Value *constantValue(Value *expr, Value **checks) {
+    switch (expr->type) {
+        case INT_TYPE:
+        case DOUBLE_TYPE:
+        case STR_TYPE:
+        case BOOL_TYPE:
+        case NULL_TYPE:
+            return expr;
+        case CONS_TYPE:
+            if (isForm(expr, "quote") && cdr(expr)->type == CONS_TYPE &&
+                cdr(cdr(expr))->type == NULL_TYPE) {
+                return car(cdr(expr));
+            }
+            if (car(expr)->type == GUARD_TYPE) {
+                Value *value = constantValue(car(cdr(expr)), checks);
+                if (value) {
+                    *checks = appendChecks(*checks, car(expr)->checks);
+                }
+                return value;
+            }
+            return NULL;
+        default:
+            return NULL;
+    }
+}
+
+/*
+* Returns an expression evaluating to 'value'.
+*/
+static Value *literal(Value *value) {
+    switch (value->type) {
+        case INT_TYPE:
+        case DOUBLE_TYPE:
+        case STR_TYPE:
+        case BOOL_TYPE:
+            return value;
+        default: {
+            Value *quote = makeNull();
+            quote->type = SYMBOL_TYPE;
+            quote->s = "quote";
+            return cons(quote, cons(value, makeNull()));
+        }
+    }
+}
+
+/*
+* Applies a primitive to constant arguments. Returns NULL if it raises an
+* error, which is then left for the program to raise when it runs.
+*/
+static Value *fold(Interpreter *interp, Value *primitive, Value *args) {
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (setjmp(onError)) {
+        restore(interp, &saved);
+        return NULL;
+    }
+    Value *result = apply(interp, primitive, args);
+    restore(interp, &saved);
+    return result;
+}
+
+/*
+* Returns true if evaluating 'expr' in 'scope' can have no effect and
+* cannot raise an error.
+*/
+static bool isPure(Interpreter *interp, Value *expr, Value *scope) {
+    Value *checks = makeNull();
+    if (constantValue(expr, &checks) || isForm(expr, "lambda")) {
+        return true;
+    }
+    return expr->type == SYMBOL_TYPE && !isOneOf(expr->s, specialForms) &&
+           (inScope(scope, expr->s) || findCell(interp->global, expr->s));
+}
+
+static Value *optimizeExpr(Interpreter *interp, Value *expr, Value *scope,
+                           int depth);
+
+static Value *optimizeList(Interpreter *interp, Value *list, Value *scope,
+                           int depth) {
+    Value *reversed = makeNull();
+    for (; list->type == CONS_TYPE; list = cdr(list)) {
+        reversed = cons(optimizeExpr(interp, car(list), scope, depth),
+                        reversed);
+    }
+    Value *result = list; // keeps an improper tail as it is
+    for (; reversed->type == CONS_TYPE; reversed = cdr(reversed)) {
+        result = cons(car(reversed), result);
+    }
+    return result;
+}
+
+/*
+* (lambda parameters body)
+*/
+static Value *optimizeLambda(Interpreter *interp, Value *expr, Value *scope,
+                             int depth) {
+    Value *args = cdr(expr);
+    if (countList(args) != 2) {
+        return expr;
+    }
+    Value *parameters = car(args);
+    Value *bodyScope = bindDefinitions(cdr(args),
+                                       bindParameters(parameters, scope));
+    Value *body = optimizeExpr(interp, car(cdr(args)), bodyScope, depth);
+    return cons(car(expr), cons(parameters, cons(body, makeNull())));
+}
+
+/*
+* Returns true if 'bindings' is a list of (symbol expr) pairs.
+*/
+static bool validBindings(Value *bindings) {
+    if (countList(bindings) < 0) {
+        return false;
+    }
+    for (; bindings->type == CONS_TYPE; bindings = cdr(bindings)) {
+        Value *binding = car(bindings);
+        if (countList(binding) != 2 || car(binding)->type != SYMBOL_TYPE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+* (let bindings body ...), (let* bindings body ...) or
+* (letrec bindings body ...)
+*/
+static Value *optimizeLet(Interpreter *interp, Value *expr, Value *scope,
+                          int depth) {
+    char *form = car(expr)->s;
+    Value *args = cdr(expr);
+    if (countList(args) < 2 || !validBindings(car(args))) {
+        return expr;
+    }
+    bool sequential = !strcmp(form, "let*");
+    bool recursive = !strcmp(form, "letrec");
+    Value *bodyScope = scope;
+    for (Value *b = car(args); b->type == CONS_TYPE; b = cdr(b)) {
+        bodyScope = cons(car(car(b)), bodyScope);
+    }
+    Value *initScope = recursive ? bodyScope : scope;
+    Value *reversed = makeNull();
+    for (Value *b = car(args); b->type == CONS_TYPE; b = cdr(b)) {
+        Value *init = optimizeExpr(interp, car(cdr(car(b))), initScope, depth);
+        reversed = cons(cons(car(car(b)), cons(init, makeNull())), reversed);
+        if (sequential) {
+            initScope = cons(car(car(b)), initScope);
+        }
+    }
+    Value *defined = bindDefinitions(cdr(args), bodyScope);
+    Value *body = optimizeList(interp, cdr(args), defined, depth);
+
+    Value *bindings = makeNull();
+    for (; reversed->type == CONS_TYPE; reversed = cdr(reversed)) {
+        Value *binding = car(reversed);
+        if ((interp->optimizations & OPTIMIZE_UNUSED) && !strcmp(form, "let") &&
+            !mentions(body, car(binding)->s) &&
+            isPure(interp, car(cdr(binding)), scope)) {
+            continue;
+        }
+        bindings = cons(binding, bindings);
+    }
+    if (bindings->type == NULL_TYPE && defined == bodyScope &&
+        (interp->optimizations & OPTIMIZE_UNUSED)) {
+        // nothing is bound in the let's frame any more
+        if (cdr(body)->type == NULL_TYPE) {
+            return car(body);
+        }
+        Value *begin = makeNull();
+        begin->type = SYMBOL_TYPE;
+        begin->s = "begin";
+        return cons(begin, body);
+    }
+    return cons(car(expr), cons(bindings, body));
+}
+
+/*
+* (let name bindings body ...)
+*/
+static Value *optimizeNamedLet(Interpreter *interp, Value *expr, Value *scope,
+                               int depth) {
+    Value *args = cdr(expr);
+    if (countList(args) < 3 || !validBindings(car(cdr(args)))) {
+        return expr;
+    }
+    Value *bodyScope = cons(car(args), scope);
+    Value *reversed = makeNull();
+    for (Value *b = car(cdr(args)); b->type == CONS_TYPE; b = cdr(b)) {
+        Value *init = optimizeExpr(interp, car(cdr(car(b))), scope, depth);
+        reversed = cons(cons(car(car(b)), cons(init, makeNull())), reversed);
+        bodyScope = cons(car(car(b)), bodyScope);
+    }
+    Value *bindings = makeNull();
+    for (; reversed->type == CONS_TYPE; reversed = cdr(reversed)) {
+        bindings = cons(car(reversed), bindings);
+    }
+    Value *body = cdr(cdr(args));
+    body = optimizeList(interp, body, bindDefinitions(body, bodyScope), depth);
+    return cons(car(expr), cons(car(args), cons(bindings, body)));
+}
+
+/*
+* (do ((var init [step]) ...) (test result ...) command ...)
+*/
+static Value *optimizeDo(Interpreter *interp, Value *expr, Value *scope,
+                         int depth) {
+    Value *args = cdr(expr);
+    if (countList(args) < 2 || countList(car(args)) < 0 ||
+        countList(car(cdr(args))) < 1) {
+        return expr;
+    }
+    Value *bodyScope = scope;
+    for (Value *b = car(args); b->type == CONS_TYPE; b = cdr(b)) {
+        int length = countList(car(b));
+        if (length < 2 || length > 3 || car(car(b))->type != SYMBOL_TYPE) {
+            return expr;
+        }
+        bodyScope = cons(car(car(b)), bodyScope);
+    }
+    bodyScope = bindDefinitions(cdr(args), bodyScope);
+    Value *reversed = makeNull();
+    for (Value *b = car(args); b->type == CONS_TYPE; b = cdr(b)) {
+        Value *init = optimizeExpr(interp, car(cdr(car(b))), scope, depth);
+        Value *step = optimizeList(interp, cdr(cdr(car(b))), bodyScope, depth);
+        reversed = cons(cons(car(car(b)), cons(init, step)), reversed);
+    }
+    Value *bindings = makeNull();
+    for (; reversed->type == CONS_TYPE; reversed = cdr(reversed)) {
+        bindings = cons(car(reversed), bindings);
+    }
+    Value *rest = optimizeList(interp, cdr(args), bodyScope, depth);
+    return cons(car(expr), cons(bindings, rest));
+}
+
+/*
+* Returns (let ((p1 a1) ...) body) for parameters (p1 ...) and arguments
+* (a1 ...), which must be as many.
+*/
+static Value *makeLet(Value *parameters, Value *args, Value *body) {
+    Value *reversed = makeNull();
+    while (parameters->type == CONS_TYPE) {
+        reversed = cons(cons(car(parameters), cons(car(args), makeNull())),
+                        reversed);
+        parameters = cdr(parameters);
+        args = cdr(args);
+    }
+    Value *bindings = makeNull();
+    for (; reversed->type == CONS_TYPE; reversed = cdr(reversed)) {
+        bindings = cons(car(reversed), bindings);
+    }
+    Value *let = makeNull();
+    let->type = SYMBOL_TYPE;
+    let->s = "let";
+    return cons(let, cons(bindings, cons(body, makeNull())));
+}
+
+/*
+* Returns true if the closure 'procedure', bound to 'name', can replace a
+* call with 'count' arguments in 'scope' by its body.
+*/
+static bool isInlinable(Interpreter *interp, Value *procedure, char *name,
+                        int count, Value *scope) {
+    if (procedure->type != CLOSURE_TYPE || (procedure->k).memo ||
+        (procedure->k).frame != interp->global) {
+        return false;
+    }
+    Value *parameters = (procedure->k).parameters;
+    Value *body = (procedure->k).function;
+    return countParameters(parameters) == count &&
+           treeSize(body) <= INLINE_SIZE && !mentions(body, name) &&
+           !mentions(body, "define") && !mentions(body, "load") &&
+           !captures(body, scope, parameters);
+}
+
+/*
+* A call whose operator is the symbol 'name'.
+*/
+static Value *optimizeCall(Interpreter *interp, Value *expr, Value *scope,
+                           int depth) {
+    Value *operator = car(expr);
+    Value *args = optimizeList(interp, cdr(expr), scope, depth);
+    Value *call = cons(operator, args);
+    Value *cell = globalCell(interp, operator, scope);
+    if (!cell || countList(args) < 0) {
+        return call;
+    }
+    Value *procedure = car(cell);
+    Value *checks = cons(cons(cell, procedure), makeNull());
+    if (procedure->type == PRIMITIVE_TYPE &&
+        !strcmp((procedure->pr).name, operator->s)) {
+        if ((interp->optimizations & OPTIMIZE_FOLD) &&
+            isOneOf(operator->s, foldable)) {
+            Value *reversed = makeNull();
+            Value *a = args;
+            for (; a->type == CONS_TYPE; a = cdr(a)) {
+                Value *value = constantValue(car(a), &checks);
+                if (!value) {
+                    break;
+                }
+                reversed = cons(value, reversed);
+            }
+            Value *values = makeNull();
+            for (; reversed->type == CONS_TYPE; reversed = cdr(reversed)) {
+                values = cons(car(reversed), values);
+            }
+            Value *result = a->type == NULL_TYPE ?
+                            fold(interp, procedure, values) : NULL;
+            if (result) {
+                return makeGuard(checks, literal(result), call);
+            }
+            checks = cons(cons(cell, procedure), makeNull());
+        }
+        if (interp->optimizations & OPTIMIZE_PRIMITIVES) {
+            return makeGuard(checks, cons(procedure, args), call);
+        }
+    } else if ((interp->optimizations & OPTIMIZE_HELPERS) &&
+               depth < INLINE_DEPTH &&
+               isInlinable(interp, procedure, operator->s, countList(args),
+                           scope)) {
+        Value *let = makeLet((procedure->k).parameters, args,
+                             (procedure->k).function);
+        return makeGuard(checks, optimizeExpr(interp, let, scope, depth + 1),
+                         call);
+    }
+    return call;
+}
+
+static Value *optimizeExpr(Interpreter *interp, Value *expr, Value *scope,
+                           int depth) {
+    if (expr->type != CONS_TYPE) {
+        return expr;
+    }
+    Value *first = car(expr);
+    if (first->type == CONS_TYPE) {
+        if ((interp->optimizations & OPTIMIZE_LAMBDA_LET) &&
+            isForm(first, "lambda") && countList(cdr(first)) == 2 &&
+            countParameters(car(cdr(first))) >= 0 &&
+            countParameters(car(cdr(first))) == countList(cdr(expr))) {
+            Value *let = makeLet(car(cdr(first)), cdr(expr),
+                                 car(cdr(cdr(first))));
+            return optimizeExpr(interp, let, scope, depth);
+        }
+        return optimizeList(interp, expr, scope, depth);
+    }
+    if (first->type != SYMBOL_TYPE) {
+        // already optimized, or not a valid form
+        return expr;
+    }
+    char *name = first->s;
+    if (!isOneOf(name, specialForms)) {
+        return optimizeCall(interp, expr, scope, depth);
+    }
+    if (!strcmp(name, "if") || !strcmp(name, "begin") ||
+        !strcmp(name, "and") || !strcmp(name, "or") ||
+        !strcmp(name, "delay") || !strcmp(name, "delay-force") ||
+        !strcmp(name, "stream-cons")) {
+        return cons(first, optimizeList(interp, cdr(expr), scope, depth));
+    } else if (!strcmp(name, "cond")) {
+        Value *clauses = makeNull();
+        Value *c = cdr(expr);
+        for (; c->type == CONS_TYPE; c = cdr(c)) {
+            clauses = cons(optimizeList(interp, car(c), scope, depth), clauses);
+        }
+        Value *result = c;
+        for (; clauses->type == CONS_TYPE; clauses = cdr(clauses)) {
+            result = cons(car(clauses), result);
+        }
+        return cons(first, result);
+    } else if (!strcmp(name, "lambda")) {
+        return optimizeLambda(interp, expr, scope, depth);
+    } else if (!strcmp(name, "let") && cdr(expr)->type == CONS_TYPE &&
+               car(cdr(expr))->type == SYMBOL_TYPE) {
+        return optimizeNamedLet(interp, expr, scope, depth);
+    } else if (!strcmp(name, "do")) {
+        return optimizeDo(interp, expr, scope, depth);
+    } else if (!strcmp(name, "let") || !strcmp(name, "let*") ||
+               !strcmp(name, "letrec")) {
+        return optimizeLet(interp, expr, scope, depth);
+    } else if ((!strcmp(name, "define") || !strcmp(name, "set!")) &&
+               countList(cdr(expr)) == 2) {
+        Value *value = optimizeExpr(interp, car(cdr(cdr(expr))), scope, depth);
+        return cons(first, cons(car(cdr(expr)), cons(value, makeNull())));
+    }
+    return expr;
+}
+
+Value *optimize(Interpreter *interp, Value *form) {
+    form = expandMacros(interp, form);
+    if (!interp->optimizations) {
+        return form;
+    }
+    return optimizeExpr(interp, form, makeNull(), 0);
+}
@@ -0,0 +1,48 @@
+#include "value.h"
+#include "context.h"
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+/*
+* Rewrites applied to each top-level form after parsing and before it is
+* evaluated. Every rewrite that relies on a global binding (a primitive or
+* a prelude procedure) is guarded: the rewritten code runs only while the
+* binding still holds what it held when the form was optimized, and the
+* original code runs otherwise, so redefining car or cadr later is still
+* seen everywhere. Local bindings are tracked, so a parameter named car is
+* never mistaken for the primitive.
+*/
+
+// Calls of pure primitives on constants are evaluated once, e.g.
+// (+ 1 (* 2 3)) becomes 7; calls that would raise are left alone.
+#define OPTIMIZE_FOLD 1
+// Calls of primitives are made directly, without looking the name up and
+// testing it against every special form first.
+#define OPTIMIZE_PRIMITIVES 2
+// ((lambda (x ...) body) e ...) becomes (let ((x e) ...) body).
+#define OPTIMIZE_LAMBDA_LET 4
+// Bindings of let whose names are never used are dropped when evaluating
+// the expression has no effect.
+#define OPTIMIZE_UNUSED 8
+// Calls of small, non-recursive global procedures, such as the c[ad]+r
+// family in lists.scm, are replaced with their bodies.
+#define OPTIMIZE_HELPERS 16
+
+#define OPTIMIZE_ALL 31
+
+/*
+* Returns the OPTIMIZE_ flags named in a comma-separated list of "fold",
+* "primitives", "let", "unused", "helpers", "all" and "none", or -1 if the
+* list holds anything else.
+*/
+int parseOptimizations(char *list);
+
+/*
+* Returns 'form', a top-level form about to be evaluated in the global
+* frame, with its macros expanded (see macro.h) and interp->optimizations
+* applied. The form itself is not modified.
+*/
+Value *optimize(Interpreter *interp, Value *form);
+
+#endif
@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "output.h"
+
+#define OUTPUT_BUFFER_SIZE 65536
+#define STACK_ON_C_STACK 64 // list nesting printed before the stack is malloc'd
+
+struct Output {
+    FILE *file;
+    size_t length;
+    char data[OUTPUT_BUFFER_SIZE];
+};
+
+static __thread Output buffer;
+
+Output *outputTo(FILE *file) {
+    if (buffer.file != file) {
+        flushOutput(&buffer);
+        buffer.file = file;
+    }
+    return &buffer;
+}
+
+void flushOutput(Output *out) {
+    if (out->length) {
+        fwrite(out->data, 1, out->length, out->file);
+        out->length = 0;
+    }
+}
+
+void outputChars(Output *out, char *chars, size_t length) {
+    if (out->length + length > OUTPUT_BUFFER_SIZE) {
+        flushOutput(out);
+        if (length > OUTPUT_BUFFER_SIZE) {
+            fwrite(chars, 1, length, out->file);
+            return;
+        }
+    }
+    memcpy(out->data + out->length, chars, length);
+    out->length += length;
+}
+
+void outputString(Output *out, char *s) {
+    outputChars(out, s, strlen(s));
+}
+
+void outputChar(Output *out, char c) {
+    if (out->length == OUTPUT_BUFFER_SIZE) {
+        flushOutput(out);
+    }
+    out->data[out->length++] = c;
+}
+
+void outputInt(Output *out, long i) {
+    char digits[24];
+    char *start = digits + sizeof(digits);
+    // work with the negative value, which also covers LONG_MIN
+    long rest = i < 0 ? i : -i;
+    do {
+        *--start = '0' - rest % 10;
+        rest /= 10;
+    } while (rest);
+    if (i < 0) {
+        *--start = '-';
+    }
+    outputChars(out, start, digits + sizeof(digits) - start);
+}
+
+void outputDouble(Output *out, double d) {
+    if (isnan(d)) {
+        outputString(out, "+nan.0");
+        return;
+    }
+    if (isinf(d)) {
+        outputString(out, d > 0 ? "+inf.0" : "-inf.0");
+        return;
+    }
+    // Rounding to more digits never moves further from d, so the digit
+    // counts that read back as d are all those from some count up to 17:
+    // find the least by bisection.
+    char text[32];
+    int low = 1;
+    int high = 17;
+    while (low < high) {
+        int digits = (low + high) / 2;
+        snprintf(text, sizeof(text), "%.*g", digits, d);
+        if (strtod(text, NULL) == d) {
+            high = digits;
+        } else {
+            low = digits + 1;
+        }
+    }
+    int length = snprintf(text, sizeof(text), "%.*g", low, d);
+    if (!strpbrk(text, ".e")) {
+        strcpy(text + length, ".0");
+        length += 2;
+    }
+    outputChars(out, text, length);
+}
+
+/*
+* Writes a value that is not a pair.
+*/
+static void outputAtom(Output *out, Value *val) {
+    switch (val->type) {
+        case BOOL_TYPE:
+            outputString(out, val->b ? "#t" : "#f");
+            break;
+        case STR_TYPE:
+            outputChar(out, '"');
+            outputString(out, val->s);
+            outputChar(out, '"');
+            break;
+        case SYMBOL_TYPE:
+            outputString(out, val->s);
+            break;
+        case INT_TYPE:
+            outputInt(out, val->i);
+            break;
+        case DOUBLE_TYPE:
+            outputDouble(out, val->d);
+            break;
+        case CLOSURE_TYPE:
+        case ESCAPE_TYPE:
+            outputString(out, "#<procedure>");
+            break;
+        case FUTURE_TYPE:
+            outputString(out, "#<future>");
+            break;
+        case PLACE_TYPE:
+            outputString(out, "#<place-channel>");
+            break;
+        case TASK_TYPE:
+            outputString(out, "#<task>");
+            break;
+        case CHANNEL_TYPE:
+            outputString(out, "#<channel>");
+            break;
+        case GUARD_TYPE:
+            outputString(out, "#<guard>");
+            break;
+        case BUILDER_TYPE:
+            outputString(out, "#<string-builder>");
+            break;
+        case PORT_TYPE:
+            outputString(out, "#<input-port>");
+            break;
+        case EOF_TYPE:
+            outputString(out, "#<eof>");
+            break;
+        case MACRO_TYPE:
+            outputString(out, "#<syntax>");
+            break;
+        case PROMISE_TYPE:
+            outputString(out, "#<promise>");
+            break;
+        case NULL_TYPE:
+            outputString(out, "()");
+            break;
+        case DOT_TYPE:
+            outputChar(out, '.');
+            break;
+        default:
+            break;
+    }
+}
+
+void outputValue(Output *out, Value *val) {
+    // the rest of each list being printed, innermost last
+    Value *onCStack[STACK_ON_C_STACK];
+    Value **rests = onCStack;
+    int capacity = STACK_ON_C_STACK;
+    int depth = 0;
+    while (true) {
+        while (val->type == CONS_TYPE) {
+            if (depth == capacity) {
+                capacity *= 2;
+                if (rests == onCStack) {
+                    rests = malloc(capacity * sizeof(Value *));
+                    assert(rests);
+                    memcpy(rests, onCStack, sizeof(onCStack));
+                } else {
+                    rests = realloc(rests, capacity * sizeof(Value *));
+                    assert(rests);
+                }
+            }
+            outputChar(out, '(');
+            rests[depth++] = cdr(val);
+            val = car(val);
+        }
+        outputAtom(out, val);
+        // finish the lists that have no elements left, then go on with the
+        // next element of the innermost one that has
+        while (depth > 0 && rests[depth - 1]->type != CONS_TYPE) {
+            Value *rest = rests[--depth];
+            if (rest->type != NULL_TYPE) {
+                outputString(out, " . ");
+                outputAtom(out, rest);
+            }
+            outputChar(out, ')');
+        }
+        if (depth == 0) {
+            break;
+        }
+        outputChar(out, ' ');
+        val = car(rests[depth - 1]);
+        rests[depth - 1] = cdr(rests[depth - 1]);
+    }
+    if (rests != onCStack) {
+        free(rests);
+    }
+}
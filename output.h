@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include "value.h"
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+/*
+* Buffered output for printing values. Each thread has one large buffer,
+* reused for every print, which characters are copied into without
+* printf and passed to the stream with a single fwrite when it fills or is
+* flushed. Printing writes a whole value into the buffer before flushing,
+* so printing a list of 100,000 elements costs a few fwrite calls rather
+* than several printf calls per element.
+*
+* Nothing stays in the buffer between prints: outputValue and the other
+* writers leave their characters buffered only until the caller flushes,
+* which it does before anything else writes to the same stream.
+*/
+
+/*
+* A thread's output buffer.
+*/
+typedef struct Output Output;
+
+/*
+* Returns the calling thread's buffer, set to write to 'file'. Anything
+* still buffered for another stream is flushed first.
+*/
+Output *outputTo(FILE *file);
+
+/*
+* Passes everything buffered to the stream (with fwrite; the stream's own
+* buffering still applies).
+*/
+void flushOutput(Output *out);
+
+void outputChars(Output *out, char *chars, size_t length);
+void outputString(Output *out, char *s);
+void outputChar(Output *out, char c);
+
+/*
+* Writes the decimal digits of 'i'.
+*/
+void outputInt(Output *out, long i);
+
+/*
+* Writes the shortest decimal that reads back as exactly 'd', with ".0"
+* added if it would otherwise look like an integer, or +inf.0, -inf.0 or
+* +nan.0.
+*/
+void outputDouble(Output *out, double d);
+
+/*
+* Writes 'val' as the interpreter prints results. Nested lists are walked
+* with an explicit stack, so any depth can be printed.
+*/
+void outputValue(Output *out, Value *val);
+
+#endif
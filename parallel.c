@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <assert.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "pool.h"
+#include "parallel.h"
+
+#define CHUNKS_PER_THREAD 4 // more chunks than threads balances uneven work
+
+typedef enum {
+    PARALLEL_MAP,
+    PARALLEL_FOR_EACH,
+    PARALLEL_REDUCE
+} parallelMode;
+
+/*
+* One chunk of the list and what evaluating it produced.
+*/
+typedef struct {
+    Interpreter *worker;
+    parallelMode mode;
+    Value *function;
+    Value *initial;   // for PARALLEL_REDUCE
+    Value **items;
+    int count;
+    Value *result;    // mapped list or folded value
+    Value *last;      // last pair of a mapped list
+    bool failed;
+} Chunk;
+
+/*
+* Pool task: evaluates one chunk on its worker's heap.
+*/
+static void runChunk(void *arg) {
+    Chunk *chunk = arg;
+    Interpreter *interp = chunk->worker;
+    Heap *previous = tswitch(interp->heap);
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (setjmp(onError)) {
+        restore(interp, &saved);
+        chunk->failed = true;
+        tswitch(previous);
+        return;
+    }
+    if (chunk->mode == PARALLEL_REDUCE) {
+        Value *acc = chunk->initial;
+        for (int i = 0; i < chunk->count; i++) {
+            Value *args = cons(acc, cons(chunk->items[i], makeNull()));
+            acc = apply(interp, chunk->function, args);
+        }
+        chunk->result = acc;
+    } else {
+        Value *results = makeNull();
+        for (int i = chunk->count - 1; i >= 0; i--) {
+            Value *args = cons(chunk->items[i], makeNull());
+            Value *value = apply(interp, chunk->function, args);
+            if (chunk->mode == PARALLEL_MAP) {
+                results = cons(value, results);
+                if (!chunk->last) {
+                    chunk->last = results;
+                }
+            }
+        }
+        chunk->result = results;
+    }
+    restore(interp, &saved);
+    tswitch(previous);
+}
+
+/*
+* Checks that 'function' is a procedure and 'list' a proper list, naming
+* the primitive 'name' in the error otherwise.
+*/
+static void checkArguments(Interpreter *interp, Value *function, Value *list,
+                           char *name) {
+    if (function->type != CLOSURE_TYPE && function->type != PRIMITIVE_TYPE) {
+        evaluationError(interp, name);
+    }
+    while (list->type == CONS_TYPE) {
+        list = cdr(list);
+    }
+    if (list->type != NULL_TYPE) {
+        evaluationError(interp, name);
+    }
+}
+
+/*
+* Splits 'list' into chunks, evaluates them on the thread pool and merges
+* the workers' heaps into the caller's. Returns the chunks, which the caller
+* frees, and their number in *chunkCount.
+*/
+static Chunk *runParallel(Interpreter *interp, parallelMode mode,
+                          Value *function, Value *initial, Value *list,
+                          int *chunkCount) {
+    int n = length(list);
+    Value **items = malloc((n + 1) * sizeof(Value *));
+    assert(items);
+    for (int i = 0; i < n; i++) {
+        items[i] = car(list);
+        list = cdr(list);
+    }
+    int count = poolSize() * CHUNKS_PER_THREAD;
+    if (count > n) {
+        count = n;
+    }
+    Chunk *chunks = calloc(count + 1, sizeof(Chunk));
+    void **args = malloc((count + 1) * sizeof(void *));
+    assert(chunks && args);
+    for (int c = 0; c < count; c++) {
+        int start = (long)n * c / count;
+        int end = (long)n * (c + 1) / count;
+        chunks[c].worker = makeWorker(interp);
+        chunks[c].mode = mode;
+        chunks[c].function = function;
+        chunks[c].initial = initial;
+        chunks[c].items = items + start;
+        chunks[c].count = end - start;
+        args[c] = &chunks[c];
+    }
+    poolRun(runChunk, args, count);
+    for (int c = 0; c < count; c++) {
+        tmerge(interp->heap, chunks[c].worker->heap);
+    }
+    free(args);
+    free(items);
+    *chunkCount = count;
+    return chunks;
+}
+
+/*
+* Frees the chunks' workers and the chunks, then raises the first chunk
+* error, if any.
+*/
+static void finishParallel(Interpreter *interp, Chunk *chunks, int count) {
+    Value *raised = NULL;
+    char *error = NULL;
+    for (int c = 0; c < count; c++) {
+        if (chunks[c].failed && !error) {
+            raised = chunks[c].worker->raised;
+            error = chunks[c].worker->error;
+        }
+        releaseWorker(chunks[c].worker);
+    }
+    free(chunks);
+    if (error) {
+        raiseObject(interp, raised, error);
+    }
+}
+
+Value *primitiveParallelMap(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for parallel-map");
+    }
+    Value *function = car(args);
+    Value *list = car(cdr(args));
+    checkArguments(interp, function, list,
+                   "Wrong argument type provided for parallel-map");
+    int count;
+    Chunk *chunks = runParallel(interp, PARALLEL_MAP, function, NULL, list,
+                                &count);
+    Value *result = makeNull();
+    for (int c = count - 1; c >= 0; c--) {
+        if (!chunks[c].failed && chunks[c].last) {
+            chunks[c].last->c.cdr = result;
+            result = chunks[c].result;
+        }
+    }
+    finishParallel(interp, chunks, count);
+    return result;
+}
+
+Value *primitiveParallelForEach(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for "
+                        "parallel-for-each");
+    }
+    Value *function = car(args);
+    Value *list = car(cdr(args));
+    checkArguments(interp, function, list,
+                   "Wrong argument type provided for parallel-for-each");
+    int count;
+    Chunk *chunks = runParallel(interp, PARALLEL_FOR_EACH, function, NULL,
+                                list, &count);
+    finishParallel(interp, chunks, count);
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+Value *primitiveParallelReduce(Interpreter *interp, Value *args) {
+    int argc = length(args);
+    if (argc != 3 && argc != 4) {
+        evaluationError(interp, "Wrong number of arguments provided for "
+                        "parallel-reduce");
+    }
+    Value *function = car(args);
+    Value *combine = function;
+    if (argc == 4) {
+        args = cdr(args);
+        combine = car(args);
+    }
+    Value *initial = car(cdr(args));
+    Value *list = car(cdr(cdr(args)));
+    checkArguments(interp, function, list,
+                   "Wrong argument type provided for parallel-reduce");
+    if (combine->type != CLOSURE_TYPE && combine->type != PRIMITIVE_TYPE) {
+        evaluationError(interp,
+                        "Wrong argument type provided for parallel-reduce");
+    }
+    int count;
+    Chunk *chunks = runParallel(interp, PARALLEL_REDUCE, function, initial,
+                                list, &count);
+    Value *results = makeNull();
+    for (int c = count - 1; c >= 0; c--) {
+        if (!chunks[c].failed) {
+            results = cons(chunks[c].result, results);
+        }
+    }
+    finishParallel(interp, chunks, count);
+    Value *acc = initial;
+    while (results->type == CONS_TYPE) {
+        Value *pair = cons(acc, cons(car(results), makeNull()));
+        acc = apply(interp, combine, pair);
+        results = cdr(results);
+    }
+    return acc;
+}
@@ -0,0 +1,39 @@
+#include "value.h"
+#include "context.h"
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/*
+* Data-parallel primitives. Each splits its list into chunks and evaluates
+* the chunks on the thread pool, each under a worker instance (see
+* makeWorker) with its own heap. The procedure must not define or set!
+* anything outside itself, since all chunks share the global frame and any
+* captured frames. Once every chunk has finished, the workers' heaps are
+* merged into the caller's, and the first error raised by a chunk, in list
+* order, is raised again in the caller.
+*/
+
+/*
+* (parallel-map f list) returns the list of (f x) for each x, in order.
+*/
+Value *primitiveParallelMap(Interpreter *interp, Value *args);
+
+/*
+* (parallel-for-each f list) calls (f x) for each x, in no particular order.
+*/
+Value *primitiveParallelForEach(Interpreter *interp, Value *args);
+
+/*
+* (parallel-reduce f combine init list) folds each chunk with (f acc x),
+* starting from init, then folds the chunk results in order with
+* (combine acc result), again from init. combine must be associative and
+* init its identity, and f must agree with it: folding a list in two parts
+* and combining the results must give the same as folding it whole. For
+* example, (parallel-reduce (lambda (n x) (+ n 1)) + 0 list) counts the
+* list. (parallel-reduce f init list) uses f as combine, as with
+* (parallel-reduce + 0 list).
+*/
+Value *primitiveParallelReduce(Interpreter *interp, Value *args);
+
+#endif
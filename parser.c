@@ -9,11 +9,13 @@
 #include <assert.h>
 
 /*
-* Called to exit the parser and print an error message.
+* Called to exit the parser with an error message.
 */
-void exitParserWithError(char *message) {
-    printf("%s\n",message);
-    texit(1);
+void exitParserWithError(Interpreter *interp, char *message) {
+    char *text = talloc(strlen(message) + 2);
+    strcpy(text, message);
+    strcat(text, "\n");
+    raiseError(interp, text);
 }
 
 /*
@@ -23,9 +25,10 @@ void exitParserWithError(char *message) {
 * If successful, pops the new list containing all items found between
 * the parenthesis pair back onto the tree.
 */
-Value *popItems(Value *tree) {
+Value *popItems(Interpreter *interp, Value *tree) {
     if(tree->type != CONS_TYPE || !(car(tree))) {
-        exitParserWithError("Syntax error: too many closed parentheses\n");
+        exitParserWithError(interp,
+                            "Syntax error: too many closed parentheses\n");
     }
     Value *newEntry = makeNull();
     Value *popped = car(tree);
@@ -33,7 +36,8 @@ Value *popItems(Value *tree) {
     while (! (popped->type == OPEN_TYPE)) {
         newEntry = cons(popped,newEntry);
         if (tree->type != CONS_TYPE || !(car(tree))) {
-            exitParserWithError("Syntax error: too many closed parentheses\n");
+            exitParserWithError(interp,
+                                "Syntax error: too many closed parentheses\n");
         }
         popped = car(tree);
         tree = cdr(tree);
@@ -48,7 +52,8 @@ Value *popItems(Value *tree) {
 * After this, returns the tree along with the remaining tokens:
 * Specifically, returns (resulting tree, remaining tokens).
 */
-Value *addQuasiquoted(Value *tree, Value *next, Value *tokens) {
+Value *addQuasiquoted(Interpreter *interp, Value *tree, Value *next,
+                      Value *tokens) {
     Value *open = makeNull();
     open->type = OPEN_TYPE;
     int openCount = 0;
@@ -57,7 +62,8 @@ Value *addQuasiquoted(Value *tree, Value *next, Value *tokens) {
     next->s = "quote";
     tree = cons(next, tree);
     if(tokens->type == NULL_TYPE){
-        exitParserWithError("Syntax error: missing datum after a single quote\n");
+        exitParserWithError(interp,
+                            "Syntax error: missing datum after a single quote\n");
     }
     next = car(tokens);
     tokens = cdr(tokens);
@@ -68,7 +74,8 @@ Value *addQuasiquoted(Value *tree, Value *next, Value *tokens) {
         openCount++;
         while (openCount != 0) {
             if (tokens->type == NULL_TYPE) {
-                exitParserWithError("Syntax error: not enough close parentheses\n");
+                exitParserWithError(interp,
+                                    "Syntax error: not enough close parentheses\n");
             }
             next = car(tokens);
             tokens = cdr(tokens);
@@ -79,7 +86,7 @@ Value *addQuasiquoted(Value *tree, Value *next, Value *tokens) {
                 if (next->type == SYMBOL_TYPE && !strcmp(next->s, "\'")) {
                     // If we run across a single quote, recurse.
                     Value *returnPair = makeNull();
-                    returnPair = addQuasiquoted(tree, next, tokens);
+                    returnPair = addQuasiquoted(interp, tree, next, tokens);
                     tree = car(returnPair);
                     tokens = car(cdr(returnPair));
                 } else {
@@ -87,13 +94,13 @@ Value *addQuasiquoted(Value *tree, Value *next, Value *tokens) {
                 }
             } else {
                 openCount--;
-                tree = popItems(tree);
+                tree = popItems(interp, tree);
             }
         }
     } else {
         tree = cons(next, tree);
     }
-    tree = popItems(tree); // add the last )
+    tree = popItems(interp, tree); // add the last )
     Value *returnPair = makeNull();
     returnPair = cons(tokens, returnPair);
     returnPair = cons(tree, returnPair);
@@ -105,7 +112,7 @@ Value *addQuasiquoted(Value *tree, Value *next, Value *tokens) {
 * Given a linked list of Scheme tokens returns a pointer to the
 * corresponding parse tree
 */
-Value *parse(Value *tokens) {
+Value *parse(Interpreter *interp, Value *tokens) {
     Value *tree = makeNull();
     if (!tokens || tokens->type == NULL_TYPE) {
         return tree;
@@ -121,7 +128,7 @@ Value *parse(Value *tokens) {
             if (next->type == SYMBOL_TYPE && !strcmp(next->s, "\'")) {
                 // Handles a single quote, replacing 'a with (quote a).
                 Value *returnPair = makeNull();
-                returnPair = addQuasiquoted(tree, next, tokens);
+                returnPair = addQuasiquoted(interp, tree, next, tokens);
                 tree = car(returnPair);
                 tokens = car(cdr(returnPair));
             } else {
@@ -129,7 +136,7 @@ Value *parse(Value *tokens) {
             }
         } else {
             openCount--;
-            tree = popItems(tree);
+            tree = popItems(interp, tree);
         }
         if (tokens->type != NULL_TYPE) {
             next = car(tokens);
@@ -139,7 +146,8 @@ Value *parse(Value *tokens) {
         }
     }
     if (! (openCount == 0)) {
-        exitParserWithError("Syntax error: not enough close parentheses\n");
+        exitParserWithError(interp,
+                            "Syntax error: not enough close parentheses\n");
     }
     return reverse(tree);
 }
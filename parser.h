@@ -11,7 +11,7 @@
 * Given a linked list of Scheme tokens returns a pointer to the 
 * corresponding parse tree
 */
-Value *parse(Value *tokens);
+Value *parse(Interpreter *interp, Value *tokens);
 
 /*
 * Given a parse tree, prints the tree using Scheme structure.
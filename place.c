@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <assert.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "optimizer.h"
+#include "place.h"
+
+#define PLACE_STACK_SIZE (64 * 1024 * 1024) // eval recurses deeply
+
+/*
+* A sent value and the heap it was copied onto.
+*/
+typedef struct Message {
+    Value *value;
+    Heap *heap;
+    struct Message *next;
+} Message;
+
+/*
+* Messages travelling one way, oldest first.
+*/
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t arrived;
+    Message *head;
+    Message *tail;
+} Mailbox;
+
+typedef struct Place Place;
+
+/*
+* One end of a place channel. Ends and mailboxes are never freed, since
+* either side may keep its end, or send it on, for as long as it likes.
+*/
+struct PlaceChannel {
+    Mailbox *in;
+    Mailbox *out;
+    Place *place; // the place this end talks to, or NULL in the place
+};
+typedef struct PlaceChannel PlaceChannel;
+
+struct Place {
+    pthread_t thread;
+    char *path;
+    char *entry;
+    PlaceChannel *channel; // the place's end
+    int status;
+    bool joined;
+};
+
+static Mailbox *makeMailbox() {
+    Mailbox *mailbox = malloc(sizeof(Mailbox));
+    assert(mailbox);
+    pthread_mutex_init(&mailbox->lock, NULL);
+    pthread_cond_init(&mailbox->arrived, NULL);
+    mailbox->head = NULL;
+    mailbox->tail = NULL;
+    return mailbox;
+}
+
+static Value *channelValue(PlaceChannel *channel) {
+    Value *value = makeNull();
+    value->type = PLACE_TYPE;
+    value->pc = channel;
+    return value;
+}
+
+/*
+* Copies 'value' onto the current heap. Returns NULL if it holds something
+* that cannot be sent.
+*/
+static Value *copyMessage(Value *value) {
+    Value *copy = makeNull();
+    Value *head = copy;
+    // the spine of a list is copied in a loop, its elements recursively
+    while (value->type == CONS_TYPE) {
+        Value *element = copyMessage(car(value));
+        if (!element) {
+            return NULL;
+        }
+        Value *rest = makeNull();
+        copy->type = CONS_TYPE;
+        copy->c.car = element;
+        copy->c.cdr = rest;
+        copy = rest;
+        value = cdr(value);
+    }
+    switch (value->type) {
+        case NULL_TYPE:
+        case INT_TYPE:
+        case DOUBLE_TYPE:
+        case BOOL_TYPE:
+        case VOID_TYPE:
+        case PLACE_TYPE:
+            *copy = *value;
+            break;
+        case STR_TYPE:
+        case SYMBOL_TYPE:
+            copy->type = value->type;
+            copy->s = talloc(strlen(value->s) + 1);
+            strcpy(copy->s, value->s);
+            break;
+        default:
+            return NULL;
+    }
+    return head;
+}
+
+/*
+* Evaluates every expression in the place's file, then calls its entry
+* procedure. Runs on the place's own thread with a new instance.
+*/
+static void *runPlace(void *arg) {
+    Place *place = arg;
+    Interpreter *interp = makeInterpreter();
+    jmp_buf onError;
+    if (setjmp(onError)) {
+        printf("%s", interp->error);
+        fflush(stdout);
+        place->status = 1;
+        destroyInterpreter(interp);
+        return NULL;
+    }
+    interp->onError = &onError;
+    FILE *file = fopen(place->path, "r");
+    if (!file) {
+        evaluationError(interp, "The place's file could not be opened");
+    }
+    Value *tree = parseFile(interp, file);
+    while (tree->type == CONS_TYPE) {
+        eval(interp, optimize(interp, car(tree)), interp->global);
+        tree = cdr(tree);
+    }
+    Value *entry = makeNull();
+    entry->type = SYMBOL_TYPE;
+    entry->s = place->entry;
+    Value *procedure = eval(interp, entry, interp->global);
+    apply(interp, procedure, cons(channelValue(place->channel), makeNull()));
+    fflush(stdout);
+    place->status = 0;
+    destroyInterpreter(interp);
+    return NULL;
+}
+
+Value *primitiveDynamicPlace(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for dynamic-place");
+    }
+    if (car(args)->type != STR_TYPE || car(cdr(args))->type != SYMBOL_TYPE) {
+        evaluationError(interp,
+                        "Wrong argument type provided for dynamic-place");
+    }
+    Place *place = malloc(sizeof(Place));
+    PlaceChannel *ours = malloc(sizeof(PlaceChannel));
+    PlaceChannel *theirs = malloc(sizeof(PlaceChannel));
+    assert(place && ours && theirs);
+    place->path = strdup(car(args)->s);
+    place->entry = strdup(car(cdr(args))->s);
+    place->status = 0;
+    place->joined = false;
+    ours->in = makeMailbox();
+    ours->out = makeMailbox();
+    ours->place = place;
+    theirs->in = ours->out;
+    theirs->out = ours->in;
+    theirs->place = NULL;
+    place->channel = theirs;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, PLACE_STACK_SIZE);
+    int failed = pthread_create(&place->thread, &attr, runPlace, place);
+    pthread_attr_destroy(&attr);
+    if (failed) {
+        evaluationError(interp, "Could not start a place");
+    }
+    return channelValue(ours);
+}
+
+Value *primitivePlaceChannelPut(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for "
+                        "place-channel-put");
+    }
+    if (car(args)->type != PLACE_TYPE) {
+        evaluationError(interp,
+                        "Wrong argument type provided for place-channel-put");
+    }
+    Message *message = malloc(sizeof(Message));
+    assert(message);
+    message->heap = makeHeap();
+    message->next = NULL;
+    Heap *previous = tswitch(message->heap);
+    message->value = copyMessage(car(cdr(args)));
+    tswitch(previous);
+    if (!message->value) {
+        tdestroy(message->heap);
+        free(message);
+        evaluationError(interp, "Only numbers, booleans, strings, symbols, "
+                        "lists and place channels can be sent to a place");
+    }
+    Mailbox *mailbox = car(args)->pc->out;
+    pthread_mutex_lock(&mailbox->lock);
+    if (mailbox->tail) {
+        mailbox->tail->next = message;
+    } else {
+        mailbox->head = message;
+    }
+    mailbox->tail = message;
+    pthread_cond_signal(&mailbox->arrived);
+    pthread_mutex_unlock(&mailbox->lock);
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+Value *primitivePlaceChannelGet(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for "
+                        "place-channel-get");
+    }
+    if (car(args)->type != PLACE_TYPE) {
+        evaluationError(interp,
+                        "Wrong argument type provided for place-channel-get");
+    }
+    Mailbox *mailbox = car(args)->pc->in;
+    pthread_mutex_lock(&mailbox->lock);
+    while (!mailbox->head) {
+        pthread_cond_wait(&mailbox->arrived, &mailbox->lock);
+    }
+    Message *message = mailbox->head;
+    mailbox->head = message->next;
+    if (!mailbox->head) {
+        mailbox->tail = NULL;
+    }
+    pthread_mutex_unlock(&mailbox->lock);
+    Value *value = message->value;
+    tmerge(interp->heap, message->heap);
+    free(message);
+    return value;
+}
+
+Value *primitivePlaceWait(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp,
+                        "Wrong number of arguments provided for place-wait");
+    }
+    if (car(args)->type != PLACE_TYPE || !car(args)->pc->place) {
+        evaluationError(interp, "Wrong argument type provided for place-wait");
+    }
+    Place *place = car(args)->pc->place;
+    if (!place->joined) {
+        pthread_join(place->thread, NULL);
+        place->joined = true;
+    }
+    Value *status = makeNull();
+    status->type = INT_TYPE;
+    status->i = place->status;
+    return status;
+}
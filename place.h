@@ -0,0 +1,41 @@
+#include "value.h"
+#include "context.h"
+
+#ifndef PLACE_H
+#define PLACE_H
+
+/*
+* Places: interpreter instances running on their own OS threads, each with
+* its own heap and global frame, so nothing is shared and nothing needs
+* locking. A place talks to its creator over a place channel, a pair of
+* queues of messages. A message is deep-copied onto a heap of its own when
+* it is sent, and that heap is merged into the receiver's when it is
+* received. Numbers, booleans, strings, symbols, lists and place channels
+* can be sent; procedures and futures cannot.
+*/
+
+/*
+* (dynamic-place path entry) starts a place that loads the file at 'path'
+* and calls the procedure named by the symbol 'entry' with its end of a
+* new place channel. Returns the creator's end, which also identifies the
+* place for place-wait.
+*/
+Value *primitiveDynamicPlace(Interpreter *interp, Value *args);
+
+/*
+* (place-channel-put channel value) sends a copy of value.
+*/
+Value *primitivePlaceChannelPut(Interpreter *interp, Value *args);
+
+/*
+* (place-channel-get channel) waits for the next message and returns it.
+*/
+Value *primitivePlaceChannelGet(Interpreter *interp, Value *args);
+
+/*
+* (place-wait place) waits for the place's entry procedure to return, and
+* returns 0, or 1 if the place stopped with an error (which it prints).
+*/
+Value *primitivePlaceWait(Interpreter *interp, Value *args);
+
+#endif
@@ -0,0 +1,335 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+#include "pool.h"
+
+#define WORKER_STACK_SIZE (64 * 1024 * 1024) // eval recurses deeply
+#define MAX_DEQUES 1024 // threads that can ever queue tasks
+#define INITIAL_DEQUE_SIZE 256 // must be a power of two
+
+/*
+* A queued task. Tasks from poolRun belong to a batch, which counts those
+* not yet finished; tasks from poolSpawn have none and are freed once run.
+*/
+typedef struct {
+    void (*task)(void *);
+    void *arg;
+    int *remaining;
+    void *group; // as given to poolSpawn
+} Job;
+
+/*
+* Circular array of a deque. When a deque outgrows it the array is replaced
+* but never freed, since a thief may still be reading it.
+*/
+typedef struct {
+    long size;
+    Job **slots;
+} Ring;
+
+/*
+* Chase-Lev work-stealing deque. Only its owning thread pushes and takes,
+* at the bottom; any thread may steal from the top. See "Correct and
+* Efficient Work-Stealing for Weak Memory Models" (Le et al., PPoPP 2013).
+*/
+typedef struct {
+    long top;
+    long bottom;
+    Ring *ring;
+} Deque;
+
+static Deque *deques[MAX_DEQUES];
+static int dequeCount;
+static __thread Deque *own; // the calling thread's deque, once it has one
+static __thread unsigned int victimSeed;
+
+static pthread_once_t started = PTHREAD_ONCE_INIT;
+static int workerCount;
+static long steals;
+
+// Idle threads sleep until 'epoch' changes; poolNotify advances it.
+static pthread_mutex_t sleepLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static unsigned long epoch;
+static int sleepers;
+
+static Ring *makeRing(long size) {
+    Ring *ring = malloc(sizeof(Ring));
+    assert(ring);
+    ring->size = size;
+    ring->slots = malloc(size * sizeof(Job *));
+    assert(ring->slots);
+    return ring;
+}
+
+/*
+* Returns the calling thread's deque, creating and registering it first if
+* need be.
+*/
+static Deque *ownDeque() {
+    if (!own) {
+        Deque *deque = malloc(sizeof(Deque));
+        assert(deque);
+        deque->top = 0;
+        deque->bottom = 0;
+        deque->ring = makeRing(INITIAL_DEQUE_SIZE);
+        int index = __atomic_fetch_add(&dequeCount, 1, __ATOMIC_SEQ_CST);
+        assert(index < MAX_DEQUES);
+        __atomic_store_n(&deques[index], deque, __ATOMIC_RELEASE);
+        own = deque;
+        victimSeed = index * 2654435761u + 1;
+    }
+    return own;
+}
+
+/*
+* Pushes a job at the bottom of the calling thread's deque.
+*/
+static void push(Job *job) {
+    Deque *deque = ownDeque();
+    long b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    long t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    Ring *ring = __atomic_load_n(&deque->ring, __ATOMIC_RELAXED);
+    if (b - t > ring->size - 1) {
+        Ring *bigger = makeRing(2 * ring->size);
+        for (long i = t; i < b; i++) {
+            bigger->slots[i & (bigger->size - 1)] =
+                __atomic_load_n(&ring->slots[i & (ring->size - 1)],
+                                __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&deque->ring, bigger, __ATOMIC_RELEASE);
+        ring = bigger;
+    }
+    __atomic_store_n(&ring->slots[b & (ring->size - 1)], job,
+                     __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+/*
+* Takes the most recently pushed job from the calling thread's deque, or
+* returns NULL if it is empty.
+*/
+static Job *take() {
+    Deque *deque = ownDeque();
+    long b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    Ring *ring = __atomic_load_n(&deque->ring, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    Job *job = NULL;
+    if (t <= b) {
+        job = __atomic_load_n(&ring->slots[b & (ring->size - 1)],
+                              __ATOMIC_RELAXED);
+        if (t == b) {
+            // last job: race thieves for it
+            if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false,
+                                             __ATOMIC_SEQ_CST,
+                                             __ATOMIC_RELAXED)) {
+                job = NULL;
+            }
+            __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return job;
+}
+
+/*
+* Steals the oldest job from another thread's deque. Returns NULL if it is
+* empty or another thread won the race for the job.
+*/
+static Job *steal(Deque *deque) {
+    long t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) {
+        return NULL;
+    }
+    Ring *ring = __atomic_load_n(&deque->ring, __ATOMIC_ACQUIRE);
+    Job *job = __atomic_load_n(&ring->slots[t & (ring->size - 1)],
+                               __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return job;
+}
+
+/*
+* Runs a job and, if it belongs to a batch, counts it finished.
+*/
+static void runJob(Job *job) {
+    job->task(job->arg);
+    if (!job->remaining) {
+        free(job);
+    } else if (__atomic_sub_fetch(job->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+        poolNotify();
+    }
+}
+
+bool poolHelp() {
+    Job *job = take();
+    if (!job) {
+        int count = __atomic_load_n(&dequeCount, __ATOMIC_ACQUIRE);
+        int start = count ? rand_r(&victimSeed) % count : 0;
+        for (int i = 0; i < count && !job; i++) {
+            Deque *victim = __atomic_load_n(&deques[(start + i) % count],
+                                            __ATOMIC_ACQUIRE);
+            if (victim && victim != own) {
+                job = steal(victim);
+            }
+        }
+        if (!job) {
+            return false;
+        }
+        __atomic_add_fetch(&steals, 1, __ATOMIC_RELAXED);
+    }
+    runJob(job);
+    return true;
+}
+
+/*
+* Takes the newest job from the calling thread's deque if it was pushed at
+* index 'base' or above, or returns NULL.
+*/
+static Job *takeAbove(long base) {
+    Deque *deque = ownDeque();
+    if (__atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) <= base) {
+        return NULL;
+    }
+    return take();
+}
+
+bool poolHelpGroup(void *group) {
+    Job *job = take();
+    if (!job) {
+        return false;
+    }
+    if (job->remaining || job->group != group) {
+        // put back where it was; only this thread pushes and takes there
+        push(job);
+        return false;
+    }
+    runJob(job);
+    return true;
+}
+
+unsigned long poolEpoch() {
+    return __atomic_load_n(&epoch, __ATOMIC_SEQ_CST);
+}
+
+void poolNotify() {
+    __atomic_add_fetch(&epoch, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&sleepLock);
+        pthread_cond_broadcast(&wake);
+        pthread_mutex_unlock(&sleepLock);
+    }
+}
+
+void poolSleep(unsigned long seen) {
+    pthread_mutex_lock(&sleepLock);
+    __atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&epoch, __ATOMIC_SEQ_CST) == seen) {
+        pthread_cond_wait(&wake, &sleepLock);
+    }
+    __atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&sleepLock);
+}
+
+static void *worker(void *unused) {
+    ownDeque();
+    while (true) {
+        unsigned long seen = poolEpoch();
+        if (!poolHelp()) {
+            poolSleep(seen);
+        }
+    }
+    return NULL;
+}
+
+/*
+* Starts one worker per online CPU besides the caller, or enough to make
+* $SCHEME_THREADS threads in all if that is set.
+*/
+static void startWorkers() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    char *threads = getenv("SCHEME_THREADS");
+    if (threads && atoi(threads) > 0) {
+        cpus = atoi(threads);
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (long i = 1; i < cpus; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, worker, NULL) == 0) {
+            workerCount++;
+        }
+    }
+    pthread_attr_destroy(&attr);
+}
+
+int poolSize() {
+    pthread_once(&started, startWorkers);
+    return workerCount + 1;
+}
+
+long poolSteals() {
+    return __atomic_load_n(&steals, __ATOMIC_RELAXED);
+}
+
+void poolSpawn(void (*task)(void *), void *arg, void *group) {
+    pthread_once(&started, startWorkers);
+    Job *job = malloc(sizeof(Job));
+    assert(job);
+    job->task = task;
+    job->arg = arg;
+    job->remaining = NULL;
+    job->group = group;
+    push(job);
+    poolNotify();
+}
+
+void poolRun(void (*task)(void *), void **args, int count) {
+    pthread_once(&started, startWorkers);
+    if (count == 0) {
+        return;
+    }
+    Job *jobs = malloc(count * sizeof(Job));
+    assert(jobs);
+    int remaining = count;
+    long base = __atomic_load_n(&ownDeque()->bottom, __ATOMIC_RELAXED);
+    // pushed last first, so that the caller takes them in order
+    for (int i = count - 1; i >= 0; i--) {
+        jobs[i].task = task;
+        jobs[i].arg = args[i];
+        jobs[i].remaining = &remaining;
+        jobs[i].group = NULL;
+        push(&jobs[i]);
+    }
+    poolNotify();
+    // While waiting, run only the jobs of this batch, and any they queued
+    // on this thread, which all sit at 'base' or above: any other job
+    // could touch a future suspended lower on this thread's stack, and
+    // never finish. Stolen jobs are waited for.
+    while (true) {
+        unsigned long seen = poolEpoch();
+        if (__atomic_load_n(&remaining, __ATOMIC_ACQUIRE) == 0) {
+            break;
+        }
+        Job *job = takeAbove(base);
+        if (job) {
+            runJob(job);
+        } else {
+            poolSleep(seen);
+        }
+    }
+    free(jobs);
+}
@@ -0,0 +1,62 @@
+#include <stdbool.h>
+
+#ifndef POOL_H
+#define POOL_H
+
+/*
+* A process-wide pool of worker threads, one per online CPU besides the
+* caller (or $SCHEME_THREADS - 1), started the first time it is used.
+*
+* Every thread that queues tasks gets its own work-stealing deque: it takes
+* its own tasks newest first, and idle threads steal the oldest tasks from
+* other threads' deques. A task may run on any thread, so one that
+* allocates must switch to a heap of its own and back before returning.
+*/
+
+/*
+* Returns the number of threads that run tasks: the workers plus the
+* calling thread.
+*/
+int poolSize();
+
+/*
+* Runs task(args[i]) for every i below count and returns once all of them
+* have finished. While it waits, the calling thread runs those of the
+* tasks no other thread has taken, and tasks they queue, but nothing else,
+* so poolRun may be used from inside a task.
+*/
+void poolRun(void (*task)(void *), void **args, int count);
+
+/*
+* Queues task(arg) to be run once, by a worker or by a thread that helps.
+* 'group' marks it for poolHelpGroup.
+*/
+void poolSpawn(void (*task)(void *), void *arg, void *group);
+
+/*
+* Runs the calling thread's newest queued task if poolSpawn was given
+* 'group' for it. Returns false if it has none, or another one is newer.
+*/
+bool poolHelpGroup(void *group);
+
+/*
+* Runs one queued task, the calling thread's newest if it has any, else one
+* stolen from another thread. Returns false if there was none.
+*/
+bool poolHelp();
+
+/*
+* For waiting on something another thread does: read poolEpoch(), check
+* the condition, and if it does not hold yet call poolSleep with the value
+* read. poolSleep returns once poolNotify has been called since that read.
+*/
+unsigned long poolEpoch();
+void poolSleep(unsigned long seen);
+void poolNotify();
+
+/*
+* Returns the number of tasks stolen so far.
+*/
+long poolSteals();
+
+#endif
@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <assert.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "text.h"
+#include "port.h"
+
+#define PORT_BUFFER_SIZE (1 << 20)
+
+struct Port {
+    FILE *file;          // NULL once closed
+    char *text;          // a string port's characters
+    // Scratch space for read-line and read, grown as needed. It is only
+    // used with the stream locked, so threads sharing a port take turns.
+    char *buffer;
+    size_t capacity;
+};
+
+static Port standardInput;
+
+/*
+* What scanning for the text of a datum found.
+*/
+typedef enum {
+    SCAN_DATUM,
+    SCAN_END,        // nothing but whitespace and comments before the end
+    SCAN_UNFINISHED, // the end came in the middle of a datum
+    SCAN_CLOSE       // a ) with no ( before it
+} ScanResult;
+
+static Value *makePortValue(FILE *file, char *text) {
+    setvbuf(file, NULL, _IOFBF, PORT_BUFFER_SIZE);
+    Port *port = talloc(sizeof(Port));
+    port->file = file;
+    port->text = text;
+    port->buffer = NULL;
+    port->capacity = 0;
+    Value *value = makeNull();
+    value->type = PORT_TYPE;
+    value->port = port;
+    return value;
+}
+
+static void closePort(Port *port) {
+    if (port->file) {
+        fclose(port->file);
+        port->file = NULL;
+        free(port->text);
+        port->text = NULL;
+        free(port->buffer);
+        port->buffer = NULL;
+        port->capacity = 0;
+    }
+}
+
+static Value *makeEof() {
+    Value *value = makeNull();
+    value->type = EOF_TYPE;
+    return value;
+}
+
+/*
+* Returns the port to read from: the only element of 'args', or the current
+* input port if args is empty. Raises an error naming 'name' otherwise, or
+* if the port is closed.
+*/
+static Port *portArgument(Interpreter *interp, Value *args, char *name) {
+    char message[100];
+    Port *port = NULL;
+    if (args->type == NULL_TYPE) {
+        port = interp->input;
+        if (!port) {
+            port = &standardInput;
+            port->file = stdin;
+        }
+    } else if (cdr(args)->type != NULL_TYPE) {
+        snprintf(message, sizeof(message),
+                 "Wrong number of arguments provided for %s", name);
+        evaluationError(interp, message);
+    } else if (car(args)->type != PORT_TYPE) {
+        snprintf(message, sizeof(message),
+                 "Wrong argument type provided for %s", name);
+        evaluationError(interp, message);
+    } else {
+        port = car(args)->port;
+    }
+    if (!port->file) {
+        evaluationError(interp, "The port is closed");
+    }
+    return port;
+}
+
+/*
+* Appends 'c' to the port's scratch space, which holds 'length' characters.
+*/
+static void append(Port *port, size_t length, char c) {
+    if (length == port->capacity) {
+        port->capacity = port->capacity ? 2 * port->capacity : 256;
+        port->buffer = realloc(port->buffer, port->capacity);
+        assert(port->buffer);
+    }
+    port->buffer[length] = c;
+}
+
+static bool isDelimiter(int c) {
+    return c == EOF || c == ' ' || c == '\n' || c == '\t' || c == '\r' ||
+           c == '(' || c == ')' || c == '"' || c == ';';
+}
+
+/*
+* Reads the text of the next datum into the port's scratch space, leaving
+* its length in *length. The stream must be locked.
+*/
+static ScanResult scanDatum(Port *port, size_t *length) {
+    FILE *file = port->file;
+    int c = getc_unlocked(file);
+    // skip whitespace and comments
+    while (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == ';') {
+        if (c == ';') {
+            while (c != '\n' && c != EOF) {
+                c = getc_unlocked(file);
+            }
+        }
+        c = getc_unlocked(file);
+    }
+    if (c == EOF) {
+        return SCAN_END;
+    }
+    if (c == ')') {
+        return SCAN_CLOSE;
+    }
+    append(port, (*length)++, c);
+    if (c == '\'') {
+        ScanResult quoted = scanDatum(port, length);
+        return quoted == SCAN_END ? SCAN_UNFINISHED : quoted;
+    }
+    if (c != '(' && c != '"') {
+        // an atom runs up to the next delimiter
+        while (!isDelimiter(c = getc_unlocked(file))) {
+            append(port, (*length)++, c);
+        }
+        ungetc(c, file);
+        return SCAN_DATUM;
+    }
+    int depth = c == '(';
+    bool inString = c == '"';
+    while (depth > 0 || inString) {
+        c = getc_unlocked(file);
+        if (c == EOF) {
+            return SCAN_UNFINISHED;
+        }
+        append(port, (*length)++, c);
+        if (inString) {
+            if (c == '\\') {
+                c = getc_unlocked(file);
+                if (c == EOF) {
+                    return SCAN_UNFINISHED;
+                }
+                append(port, (*length)++, c);
+            } else if (c == '"') {
+                inString = false;
+            }
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')') {
+            depth--;
+        } else if (c == ';') {
+            while ((c = getc_unlocked(file)) != '\n' && c != EOF) {
+            }
+            append(port, (*length)++, '\n');
+        }
+    }
+    return SCAN_DATUM;
+}
+
+Value *primitiveOpenInputFile(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for open-input-file");
+    }
+    if (car(args)->type != STR_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for open-input-file");
+    }
+    FILE *file = fopen(car(args)->s, "r");
+    if (!file) {
+        evaluationError(interp, "The file could not be opened");
+    }
+    return makePortValue(file, NULL);
+}
+
+Value *primitiveOpenInputString(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for open-input-string");
+    }
+    if (car(args)->type != STR_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for open-input-string");
+    }
+    int length = stringLength(car(args));
+    // the port keeps its own copy, which outlives the heap it came from
+    char *text = malloc(length + 1);
+    assert(text);
+    memcpy(text, car(args)->s, length + 1);
+    FILE *file = length ? fmemopen(text, length, "r") : fopen("/dev/null", "r");
+    assert(file);
+    return makePortValue(file, text);
+}
+
+Value *primitiveCloseInputPort(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for close-input-port");
+    }
+    if (car(args)->type != PORT_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for close-input-port");
+    }
+    closePort(car(args)->port);
+    Value *returnVal = makeNull();
+    returnVal->type = VOID_TYPE;
+    return returnVal;
+}
+
+Value *primitiveReadChar(Interpreter *interp, Value *args) {
+    Port *port = portArgument(interp, args, "read-char");
+    int c = getc(port->file);
+    if (c == EOF) {
+        return makeEof();
+    }
+    char chars[1] = {c};
+    return makeString(chars, 1);
+}
+
+Value *primitivePeekChar(Interpreter *interp, Value *args) {
+    Port *port = portArgument(interp, args, "peek-char");
+    flockfile(port->file);
+    int c = getc_unlocked(port->file);
+    if (c != EOF) {
+        ungetc(c, port->file);
+    }
+    funlockfile(port->file);
+    if (c == EOF) {
+        return makeEof();
+    }
+    char chars[1] = {c};
+    return makeString(chars, 1);
+}
+
+Value *primitiveReadLine(Interpreter *interp, Value *args) {
+    Port *port = portArgument(interp, args, "read-line");
+    flockfile(port->file);
+    ssize_t length = getline(&port->buffer, &port->capacity, port->file);
+    Value *line;
+    if (length < 0) {
+        line = makeEof();
+    } else {
+        if (length && port->buffer[length - 1] == '\n') {
+            length--;
+        }
+        line = makeString(port->buffer, length);
+    }
+    funlockfile(port->file);
+    return line;
+}
+
+Value *primitiveRead(Interpreter *interp, Value *args) {
+    Port *port = portArgument(interp, args, "read");
+    flockfile(port->file);
+    size_t length = 0;
+    ScanResult result = scanDatum(port, &length);
+    // the tokenizer needs a delimiter after the last token
+    char *source = talloc(length + 1);
+    memcpy(source, port->buffer, length);
+    source[length++] = '\n';
+    funlockfile(port->file);
+    if (result == SCAN_END) {
+        return makeEof();
+    } else if (result == SCAN_UNFINISHED) {
+        evaluationError(interp, "Unexpected end of input in read");
+    } else if (result == SCAN_CLOSE) {
+        evaluationError(interp, "Unexpected ) in read");
+    }
+    Value *tree = parseFile(interp, fmemopen(source, length, "r"));
+    assert(tree->type == CONS_TYPE && cdr(tree)->type == NULL_TYPE);
+    return car(tree);
+}
+
+Value *primitiveIsEofObject(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for eof-object?");
+    }
+    Value *returnVal = makeNull();
+    returnVal->type = BOOL_TYPE;
+    returnVal->b = car(args)->type == EOF_TYPE;
+    return returnVal;
+}
+
+Value *primitiveWithInputFromFile(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for with-input-from-file");
+    }
+    Value *thunk = car(cdr(args));
+    if (thunk->type != CLOSURE_TYPE && thunk->type != PRIMITIVE_TYPE) {
+        evaluationError(interp, "Wrong argument type provided for with-input-from-file");
+    }
+    Port *port = primitiveOpenInputFile(interp, cons(car(args), makeNull()))->port;
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (setjmp(onError)) {
+        restore(interp, &saved);
+        closePort(port);
+        raiseObject(interp, interp->raised, interp->error);
+    }
+    interp->input = port;
+    Value *result = apply(interp, thunk, makeNull());
+    restore(interp, &saved);
+    closePort(port);
+    return result;
+}
+
+size_t portSize(Value *port) {
+    Port *p = port->port;
+    size_t size = sizeof(Port) + p->capacity;
+    if (p->file) {
+        size += PORT_BUFFER_SIZE;
+    }
+    if (p->text) {
+        size += strlen(p->text) + 1;
+    }
+    return size;
+}
@@ -0,0 +1,86 @@
+#include "value.h"
+#include "context.h"
+#include "heapdump.h"
+
+#ifndef PORT_H
+#define PORT_H
+
+/*
+* Input ports, for reading data files from Scheme one piece at a time
+* instead of loading them as code. A port reads through a stdio stream
+* with a 1MB buffer, so read-char and read-line cost a buffer access per
+* character rather than a system call, and a file of any size can be
+* streamed in constant memory.
+*
+* There is no character type, so read-char and peek-char return strings of
+* one character. At the end of the input, the reading procedures return an
+* end-of-file object, recognized by eof-object?.
+*
+* Each instance has a current input port, standard input unless changed by
+* with-input-from-file, which the reading procedures use when not given a
+* port. Errors restore it along with the rest of the state saved by
+* checkpoint, and each green thread has its own.
+*/
+
+/*
+* An input port.
+*/
+typedef struct Port Port;
+
+/*
+* (open-input-file path) returns a port reading the file at path.
+*/
+Value *primitiveOpenInputFile(Interpreter *interp, Value *args);
+
+/*
+* (open-input-string s) returns a port reading the characters of s.
+*/
+Value *primitiveOpenInputString(Interpreter *interp, Value *args);
+
+/*
+* (close-input-port port) closes port; reading from it afterwards is an
+* error. Closing a closed port does nothing.
+*/
+Value *primitiveCloseInputPort(Interpreter *interp, Value *args);
+
+/*
+* (read-char [port]) returns the next character and moves past it.
+*/
+Value *primitiveReadChar(Interpreter *interp, Value *args);
+
+/*
+* (peek-char [port]) returns the next character without moving past it.
+*/
+Value *primitivePeekChar(Interpreter *interp, Value *args);
+
+/*
+* (read-line [port]) returns the characters up to the next newline, which
+* is skipped but not included.
+*/
+Value *primitiveReadLine(Interpreter *interp, Value *args);
+
+/*
+* (read [port]) returns the next datum, as quote would return it. The
+* datum's text is read up to its end, then tokenized and parsed as source
+* code is.
+*/
+Value *primitiveRead(Interpreter *interp, Value *args);
+
+/*
+* (eof-object? obj) returns #t if obj is the end-of-file object.
+*/
+Value *primitiveIsEofObject(Interpreter *interp, Value *args);
+
+/*
+* (with-input-from-file path thunk) calls (thunk) with a port reading the
+* file at path as the current input port, then closes the port, whether
+* thunk returns or raises.
+*/
+Value *primitiveWithInputFromFile(Interpreter *interp, Value *args);
+
+/*
+* Returns the size of the port 'port' and its buffers, for heap-dump.
+*/
+size_t portSize(Value *port);
+
+#endif
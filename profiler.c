@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include "profiler.h"
+
+#define PROFILE_TOP 20 // rows printed per table
+
+/*
+* Allocation totals for one (allocator, C caller, Scheme procedure) triple.
+* The table is keyed on the three pointers; the procedure name is copied so
+* the report can be printed after the talloc heap has been freed.
+*/
+typedef struct {
+    const char *kind;
+    const char *site;
+    char *procedureKey;
+    char *procedure;
+    long count;
+    long bytes;
+} Site;
+
+bool profiling = false;
+__thread char *profileProcedure = "toplevel";
+
+// Interpreters on several threads may allocate at once.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Site *sites; // open-addressed hash table, NULL kind = empty slot
+static int capacity;
+static int used;
+static long totalCount;
+static long totalBytes;
+
+/*
+* Hashes the three pointers that identify a site.
+*/
+static unsigned hashSite(const char *kind, const char *site, char *procedure) {
+    uintptr_t h = (uintptr_t)kind * 31 + (uintptr_t)site;
+    h = h * 31 + (uintptr_t)procedure;
+    h ^= h >> 17;
+    h *= 0xed5ad4bb;
+    h ^= h >> 11;
+    return (unsigned)h;
+}
+
+/*
+* Doubles the table, reinserting every site.
+*/
+static void growSites() {
+    Site *old = sites;
+    int oldCapacity = capacity;
+    capacity *= 2;
+    sites = calloc(capacity, sizeof(Site));
+    assert(sites);
+    for (int i = 0; i < oldCapacity; i++) {
+        if (old[i].kind) {
+            unsigned h = hashSite(old[i].kind, old[i].site,
+                                  old[i].procedureKey);
+            while (sites[h & (capacity - 1)].kind) {
+                h++;
+            }
+            sites[h & (capacity - 1)] = old[i];
+        }
+    }
+    free(old);
+}
+
+void profileStart() {
+    capacity = 1024;
+    sites = calloc(capacity, sizeof(Site));
+    assert(sites);
+    profiling = true;
+    atexit(profileReport);
+}
+
+void profileAllocation(size_t size, const char *kind, const char *site) {
+    pthread_mutex_lock(&lock);
+    totalCount++;
+    totalBytes += size;
+    unsigned h = hashSite(kind, site, profileProcedure);
+    Site *entry = &sites[h & (capacity - 1)];
+    while (entry->kind) {
+        if (entry->kind == kind && entry->site == site &&
+            entry->procedureKey == profileProcedure) {
+            entry->count++;
+            entry->bytes += size;
+            pthread_mutex_unlock(&lock);
+            return;
+        }
+        h++;
+        entry = &sites[h & (capacity - 1)];
+    }
+    entry->kind = kind;
+    entry->site = site;
+    entry->procedureKey = profileProcedure;
+    entry->procedure = strdup(profileProcedure);
+    entry->count = 1;
+    entry->bytes = size;
+    used++;
+    if (used * 10 > capacity * 7) {
+        growSites();
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+* Orders sites by allocator, caller and procedure name, so that sites whose
+* procedures share a name end up next to each other.
+*/
+static int compareNames(const void *a, const void *b) {
+    const Site *x = a;
+    const Site *y = b;
+    int c = strcmp(x->kind, y->kind);
+    if (!c) {
+        c = strcmp(x->site, y->site);
+    }
+    if (!c) {
+        c = strcmp(x->procedure, y->procedure);
+    }
+    return c;
+}
+
+static int compareBytes(const void *a, const void *b) {
+    const Site *x = a;
+    const Site *y = b;
+    return (y->bytes > x->bytes) - (y->bytes < x->bytes);
+}
+
+static int compareCount(const void *a, const void *b) {
+    const Site *x = a;
+    const Site *y = b;
+    return (y->count > x->count) - (y->count < x->count);
+}
+
+/*
+* Prints the first PROFILE_TOP rows of 'list'.
+*/
+static void printSites(Site *list, int n, char *title) {
+    fprintf(stderr, "%s\n", title);
+    fprintf(stderr, "%12s %14s %6s  %-28s %s\n", "count", "bytes", "bytes%",
+            "C site", "Scheme procedure");
+    for (int i = 0; i < n && i < PROFILE_TOP; i++) {
+        char where[64];
+        snprintf(where, sizeof(where), "%s <- %s", list[i].kind, list[i].site);
+        fprintf(stderr, "%12li %14li %5.1f%%  %-28s %s\n", list[i].count,
+                list[i].bytes,
+                totalBytes ? 100.0 * list[i].bytes / totalBytes : 0.0, where,
+                list[i].procedure);
+    }
+}
+
+void profileReport() {
+    pthread_mutex_lock(&lock);
+    if (!profiling) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    profiling = false;
+    // Collect used entries and merge those that differ only in which string
+    // holds the procedure name.
+    Site *list = malloc((used + 1) * sizeof(Site));
+    assert(list);
+    int n = 0;
+    for (int i = 0; i < capacity; i++) {
+        if (sites[i].kind) {
+            list[n++] = sites[i];
+        }
+    }
+    qsort(list, n, sizeof(Site), compareNames);
+    int merged = 0;
+    for (int i = 0; i < n; i++) {
+        if (merged > 0 && !compareNames(&list[merged - 1], &list[i])) {
+            list[merged - 1].count += list[i].count;
+            list[merged - 1].bytes += list[i].bytes;
+        } else {
+            list[merged++] = list[i];
+        }
+    }
+    fprintf(stderr, "\nAllocation profile: %li allocations, %li bytes\n\n",
+            totalCount, totalBytes);
+    qsort(list, merged, sizeof(Site), compareBytes);
+    printSites(list, merged, "Top allocation sites by bytes:");
+    qsort(list, merged, sizeof(Site), compareCount);
+    fprintf(stderr, "\n");
+    printSites(list, merged, "Top allocation sites by count:");
+    free(list);
+    for (int i = 0; i < capacity; i++) {
+        free(sites[i].procedure);
+    }
+    free(sites);
+    sites = NULL;
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,36 @@
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/*
+* True while allocations are being recorded.
+*/
+extern bool profiling;
+
+/*
+* Name of the Scheme procedure currently being evaluated on this thread,
+* which allocations are charged to. apply() keeps this up to date while
+* profiling.
+*/
+extern __thread char *profileProcedure;
+
+/*
+* Starts recording allocations. A report of the top allocation sites is
+* printed to stderr when the process exits.
+*/
+void profileStart();
+
+/*
+* Charges an allocation of 'size' bytes, made by the allocator 'kind' on
+* behalf of the C function 'site', to the current Scheme procedure.
+*/
+void profileAllocation(size_t size, const char *kind, const char *site);
+
+/*
+* Prints the top allocation sites by bytes and by count to stderr.
+*/
+void profileReport();
+
+#endif
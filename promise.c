@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "promise.h"
+
+/*
+* What a promise will produce. Promises joined by forcing a delay-force
+* share one, so forcing any of them afterwards finds the same value.
+*/
+typedef struct {
+    bool done;
+    bool forcesPromise; // expr evaluates to a promise to take over
+    Value *value;       // once done
+    Value *expr;        // until done
+    Frame *frame;
+} Box;
+
+struct Promise {
+    Box *box;
+};
+
+typedef struct Promise Promise;
+
+static pthread_mutex_t promiseLock = PTHREAD_MUTEX_INITIALIZER;
+
+static Value *makePromiseValue(Box *box) {
+    Promise *promise = talloc(sizeof(Promise));
+    promise->box = box;
+    Value *value = makeNull();
+    value->type = PROMISE_TYPE;
+    value->promise = promise;
+    return value;
+}
+
+Value *makePromise(Value *expr, Frame *frame, bool forcesPromise) {
+    Box *box = talloc(sizeof(Box));
+    box->done = false;
+    box->forcesPromise = forcesPromise;
+    box->value = NULL;
+    box->expr = expr;
+    box->frame = frame;
+    return makePromiseValue(box);
+}
+
+Value *force(Interpreter *interp, Value *value) {
+    if (value->type != PROMISE_TYPE) {
+        return value;
+    }
+    Promise *promise = value->promise;
+    while (true) {
+        pthread_mutex_lock(&promiseLock);
+        Box *box = promise->box;
+        if (box->done) {
+            Value *result = box->value;
+            pthread_mutex_unlock(&promiseLock);
+            return result;
+        }
+        Value *expr = box->expr;
+        Frame *frame = box->frame;
+        bool forcesPromise = box->forcesPromise;
+        pthread_mutex_unlock(&promiseLock);
+
+        Value *result = eval(interp, expr, frame);
+        if (forcesPromise && result->type != PROMISE_TYPE) {
+            evaluationError(interp, "delay-force expression did not return a promise");
+        }
+
+        pthread_mutex_lock(&promiseLock);
+        // Forcing expr may have forced this promise too; its value stands.
+        box = promise->box;
+        if (!box->done) {
+            if (forcesPromise) {
+                // Take over the other promise's state, and have it share
+                // ours, then go around again to force it.
+                Promise *next = result->promise;
+                *box = *next->box;
+                next->box = box;
+            } else {
+                box->done = true;
+                box->value = result;
+                box->expr = NULL;
+                box->frame = NULL;
+            }
+        }
+        pthread_mutex_unlock(&promiseLock);
+    }
+}
+
+Value *primitiveForce(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for force");
+    }
+    return force(interp, car(args));
+}
+
+Value *primitiveMakePromise(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for make-promise");
+    }
+    if (car(args)->type == PROMISE_TYPE) {
+        return car(args);
+    }
+    Box *box = talloc(sizeof(Box));
+    box->done = true;
+    box->forcesPromise = false;
+    box->value = car(args);
+    box->expr = NULL;
+    box->frame = NULL;
+    return makePromiseValue(box);
+}
+
+Value *primitiveIsPromise(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for promise?");
+    }
+    Value *returnVal = makeNull();
+    returnVal->type = BOOL_TYPE;
+    returnVal->b = car(args)->type == PROMISE_TYPE;
+    return returnVal;
+}
+
+/*
+* Returns the stream that is the only argument in 'args', raising an error
+* with 'message' unless it is a nonempty stream.
+*/
+static Value *streamArgument(Interpreter *interp, Value *args, char *message) {
+    if (args->type != CONS_TYPE || cdr(args)->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for stream operation");
+    }
+    if (car(args)->type != CONS_TYPE) {
+        evaluationError(interp, message);
+    }
+    return car(args);
+}
+
+Value *primitiveStreamCar(Interpreter *interp, Value *args) {
+    return car(streamArgument(interp, args, "stream-car requires a nonempty stream"));
+}
+
+Value *primitiveStreamCdr(Interpreter *interp, Value *args) {
+    Value *stream = streamArgument(interp, args, "stream-cdr requires a nonempty stream");
+    return force(interp, cdr(stream));
+}
+
+Value *primitiveStreamTake(Interpreter *interp, Value *args) {
+    if (args->type != CONS_TYPE || cdr(args)->type != CONS_TYPE ||
+        cdr(cdr(args))->type != NULL_TYPE) {
+        evaluationError(interp, "Wrong number of arguments provided for stream-take");
+    }
+    Value *stream = car(args);
+    Value *count = car(cdr(args));
+    if (count->type != INT_TYPE || count->i < 0) {
+        evaluationError(interp, "stream-take requires a non-negative integer count");
+    }
+    Value *head = makeNull();
+    Value *last = NULL;
+    for (int i = 0; i < count->i; i++) {
+        if (stream->type == NULL_TYPE) {
+            break;
+        }
+        if (stream->type != CONS_TYPE) {
+            evaluationError(interp, "stream-take requires a stream");
+        }
+        Value *pair = cons(car(stream), makeNull());
+        if (last) {
+            last->c.cdr = pair;
+        } else {
+            head = pair;
+        }
+        last = pair;
+        // the rest is only forced if another element is wanted
+        if (i + 1 < count->i) {
+            stream = force(interp, cdr(stream));
+        }
+    }
+    return head;
+}
+
+size_t promiseReferences(Value *promise, HeapVisitor visit, void *data) {
+    pthread_mutex_lock(&promiseLock);
+    Box *box = promise->promise->box;
+    visit(data, box->value, false);
+    visit(data, box->expr, false);
+    visit(data, box->frame, true);
+    pthread_mutex_unlock(&promiseLock);
+    return sizeof(Promise) + sizeof(Box);
+}
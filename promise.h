@@ -0,0 +1,79 @@
+#include "value.h"
+#include "context.h"
+#include "heapdump.h"
+
+#ifndef PROMISE_H
+#define PROMISE_H
+
+/*
+* Promises and lazy streams. (delay expr) returns a promise that evaluates
+* expr, in the frame the delay was evaluated in, the first time it is
+* forced, and remembers the value for later forces. (delay-force expr) is
+* the same, except that expr must evaluate to another promise, whose value
+* becomes this one's. Forcing follows a chain of delay-forces in a loop,
+* each promise taking over the state of the one its expression returned,
+* so an iterative lazy algorithm (one that ends in delay-force of a
+* recursive call) runs in constant stack however long the chain.
+*
+* A stream is a pair whose cdr is a promise of the rest of the stream, or
+* (). (stream-cons a b) evaluates a and delays b, so each element of a
+* lazy pipeline is computed once, when the stream is first walked that
+* far, and shared by everything walking it afterwards.
+*
+* Promise state is updated under a lock, but the expression is evaluated
+* outside it: a promise forced by two threads at once may be evaluated by
+* both, and the first to finish decides its value.
+*/
+
+/*
+* Returns a promise of the value of 'expr' in 'frame'. If 'forcesPromise'
+* is true, expr must evaluate to a promise, as with delay-force.
+*/
+Value *makePromise(Value *expr, Frame *frame, bool forcesPromise);
+
+/*
+* Returns the value of 'promise', evaluating it if it has not been forced
+* yet. Anything other than a promise is returned as it is.
+*/
+Value *force(Interpreter *interp, Value *promise);
+
+/*
+* (force obj) returns the value of the promise obj, or obj if it is not a
+* promise.
+*/
+Value *primitiveForce(Interpreter *interp, Value *args);
+
+/*
+* (make-promise obj) returns a promise already forced to obj, or obj
+* itself if it is a promise.
+*/
+Value *primitiveMakePromise(Interpreter *interp, Value *args);
+
+/*
+* (promise? obj) returns whether obj is a promise.
+*/
+Value *primitiveIsPromise(Interpreter *interp, Value *args);
+
+/*
+* (stream-car s) returns the first element of the stream s.
+*/
+Value *primitiveStreamCar(Interpreter *interp, Value *args);
+
+/*
+* (stream-cdr s) returns the rest of the stream s, forcing it.
+*/
+Value *primitiveStreamCdr(Interpreter *interp, Value *args);
+
+/*
+* (stream-take s n) returns a list of the first n elements of the stream
+* s, or all of them if it has fewer.
+*/
+Value *primitiveStreamTake(Interpreter *interp, Value *args);
+
+/*
+* Visits what the promise 'promise' refers to, for heap-dump (see
+* heapdump.h), and returns the size of the promise and its box.
+*/
+size_t promiseReferences(Value *promise, HeapVisitor visit, void *data);
+
+#endif
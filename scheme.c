@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "interpreter.h"
+#include "optimizer.h"
+#include "scheme.h"
+
+/*
+* State of the host's thread and of the instance on entry to an API call,
+* restored when the call returns, whether or not it failed.
+*/
+typedef struct {
+    Heap *heap;
+    Checkpoint checkpoint;
+} Saved;
+
+static void enter(Interpreter *interp, Saved *saved, jmp_buf *onError) {
+    saved->heap = tswitch(interp->heap);
+    checkpoint(interp, &saved->checkpoint, onError);
+}
+
+static void leave(Interpreter *interp, Saved *saved) {
+    restore(interp, &saved->checkpoint);
+    tswitch(saved->heap);
+}
+
+/*
+* Evaluates every expression read from 'file' in the global frame and
+* returns the value of the last one.
+*/
+static Value *evalFile(Interpreter *interp, FILE *file) {
+    interp->in = file;
+    Value *tree = parse(interp, tokenize(interp, false));
+    Value *result = makeNull();
+    result->type = VOID_TYPE;
+    while (tree->type == CONS_TYPE) {
+        result = eval(interp, optimize(interp, car(tree)), interp->global);
+        tree = cdr(tree);
+    }
+    return result;
+}
+
+Interpreter *schemeCreate() {
+    Heap *previous = tswitch(NULL);
+    Interpreter *interp = makeInterpreter();
+    tswitch(previous);
+    return interp;
+}
+
+void schemeDestroy(Interpreter *interp) {
+    destroyInterpreter(interp);
+}
+
+bool schemeLoad(Interpreter *interp, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        Saved saved;
+        enter(interp, &saved, NULL);
+        char *format = "Error: could not open %s\n";
+        interp->error = talloc(strlen(format) + strlen(path));
+        sprintf(interp->error, format, path);
+        leave(interp, &saved);
+        return false;
+    }
+    Saved saved;
+    jmp_buf onError;
+    enter(interp, &saved, &onError);
+    volatile bool ok = false;
+    if (!setjmp(onError)) {
+        evalFile(interp, file);
+        ok = true;
+    }
+    fclose(file);
+    leave(interp, &saved);
+    return ok;
+}
+
+Value *schemeEval(Interpreter *interp, const char *source) {
+    FILE *file = fmemopen((void *)source, strlen(source), "r");
+    if (!file) {
+        return NULL;
+    }
+    Saved saved;
+    jmp_buf onError;
+    enter(interp, &saved, &onError);
+    Value *volatile result = NULL;
+    if (!setjmp(onError)) {
+        result = evalFile(interp, file);
+    }
+    fclose(file);
+    leave(interp, &saved);
+    return result;
+}
+
+char *schemeError(Interpreter *interp) {
+    return interp->error;
+}
+
+Value *schemeApply(Interpreter *interp, Value *function, Value *args) {
+    Saved saved;
+    jmp_buf onError;
+    enter(interp, &saved, &onError);
+    Value *volatile result = NULL;
+    if (!setjmp(onError)) {
+        if (function->type != CLOSURE_TYPE &&
+            function->type != PRIMITIVE_TYPE) {
+            evaluationError(interp, "Attempted to apply a non-procedure");
+        }
+        result = apply(interp, function, args);
+    }
+    leave(interp, &saved);
+    return result;
+}
+
+void schemeDefine(Interpreter *interp, const char *name,
+                  Value *(*function)(Interpreter *, Value *)) {
+    Saved saved;
+    enter(interp, &saved, NULL);
+    char *copy = talloc(strlen(name) + 1);
+    strcpy(copy, name);
+    bindPrimitive(copy, function, interp->global);
+    leave(interp, &saved);
+}
+
+void schemeDefineValue(Interpreter *interp, const char *name, Value *value) {
+    Saved saved;
+    enter(interp, &saved, NULL);
+    defineSymbol(schemeSymbol(interp, name), value, interp->global);
+    leave(interp, &saved);
+}
+
+/*
+* Makes a value of the given type on the instance's heap.
+*/
+static Value *makeValue(Interpreter *interp, valueType type) {
+    Heap *previous = tswitch(interp->heap);
+    Value *value = makeNull();
+    value->type = type;
+    tswitch(previous);
+    return value;
+}
+
+/*
+* Copies 'text' onto the instance's heap.
+*/
+static char *copyString(Interpreter *interp, const char *text) {
+    Heap *previous = tswitch(interp->heap);
+    char *copy = talloc(strlen(text) + 1);
+    strcpy(copy, text);
+    tswitch(previous);
+    return copy;
+}
+
+Value *schemeInteger(Interpreter *interp, int i) {
+    Value *value = makeValue(interp, INT_TYPE);
+    value->i = i;
+    return value;
+}
+
+Value *schemeDouble(Interpreter *interp, double d) {
+    Value *value = makeValue(interp, DOUBLE_TYPE);
+    value->d = d;
+    return value;
+}
+
+Value *schemeBoolean(Interpreter *interp, bool b) {
+    Value *value = makeValue(interp, BOOL_TYPE);
+    value->b = b;
+    return value;
+}
+
+Value *schemeString(Interpreter *interp, const char *text) {
+    Value *value = makeValue(interp, STR_TYPE);
+    value->s = copyString(interp, text);
+    return value;
+}
+
+Value *schemeSymbol(Interpreter *interp, const char *text) {
+    Value *value = makeValue(interp, SYMBOL_TYPE);
+    value->s = copyString(interp, text);
+    return value;
+}
+
+Value *schemeCons(Interpreter *interp, Value *car, Value *cdr) {
+    Heap *previous = tswitch(interp->heap);
+    Value *pair = cons(car, cdr);
+    tswitch(previous);
+    return pair;
+}
+
+Value *schemeNull(Interpreter *interp) {
+    return makeValue(interp, NULL_TYPE);
+}
+
+bool schemeToInteger(Value *value, int *out) {
+    if (value->type != INT_TYPE) {
+        return false;
+    }
+    *out = value->i;
+    return true;
+}
+
+bool schemeToDouble(Value *value, double *out) {
+    if (value->type == INT_TYPE) {
+        *out = value->i;
+    } else if (value->type == DOUBLE_TYPE) {
+        *out = value->d;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool schemeToBoolean(Value *value, bool *out) {
+    if (value->type != BOOL_TYPE) {
+        return false;
+    }
+    *out = value->b;
+    return true;
+}
+
+bool schemeToString(Value *value, const char **out) {
+    if (value->type != STR_TYPE && value->type != SYMBOL_TYPE) {
+        return false;
+    }
+    *out = value->s;
+    return true;
+}
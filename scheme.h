@@ -0,0 +1,92 @@
+#include <stdbool.h>
+#include "value.h"
+#include "context.h"
+
+#ifndef SCHEME_H
+#define SCHEME_H
+
+/*
+* C API for embedding the interpreter in another program. Link against
+* libscheme.a or libscheme.so (see "make libscheme.a libscheme.so").
+*
+* Every function that evaluates or allocates switches the calling thread to
+* the instance's heap for the duration of the call and restores the previous
+* heap afterwards, so instances can be mixed freely on one thread. Values
+* returned by an instance live on its heap until schemeDestroy.
+*
+* Errors never terminate the host: the function returns NULL (or false) and
+* schemeError returns the message.
+*/
+
+/*
+* Creates an instance with the primitive procedures bound. Returns NULL if
+* the instance could not be created.
+*/
+Interpreter *schemeCreate();
+
+/*
+* Frees the instance and every value it allocated.
+*/
+void schemeDestroy(Interpreter *interp);
+
+/*
+* Evaluates every expression in the file at 'path' in the global frame,
+* without printing results. Returns false on error.
+*/
+bool schemeLoad(Interpreter *interp, const char *path);
+
+/*
+* Evaluates every expression in 'source' in the global frame and returns the
+* value of the last one (a VOID_TYPE value if there are none), or NULL on
+* error.
+*/
+Value *schemeEval(Interpreter *interp, const char *source);
+
+/*
+* Returns the message of the most recent error, including its trailing
+* newline, or NULL if no call on this instance has failed yet.
+*/
+char *schemeError(Interpreter *interp);
+
+/*
+* Binds 'name' in the global frame to a primitive implemented in C, the same
+* way the built-in primitives are bound. 'function' receives the list of
+* evaluated arguments; it may report errors with evaluationError and allocate
+* with makeNull, cons and talloc.
+*/
+void schemeDefine(Interpreter *interp, const char *name,
+                  Value *(*function)(Interpreter *, Value *));
+
+/*
+* Binds 'name' in the global frame to a value.
+*/
+void schemeDefineValue(Interpreter *interp, const char *name, Value *value);
+
+/*
+* Make values on the instance's heap from C values. 'text' is copied.
+*/
+Value *schemeInteger(Interpreter *interp, int i);
+Value *schemeDouble(Interpreter *interp, double d);
+Value *schemeBoolean(Interpreter *interp, bool b);
+Value *schemeString(Interpreter *interp, const char *text);
+Value *schemeSymbol(Interpreter *interp, const char *text);
+Value *schemeCons(Interpreter *interp, Value *car, Value *cdr);
+Value *schemeNull(Interpreter *interp);
+
+/*
+* Read C values out of a value. Each returns false, leaving *out unchanged,
+* if the value has the wrong type. schemeToDouble accepts integers too.
+* The string from schemeToString belongs to the instance's heap.
+*/
+bool schemeToInteger(Value *value, int *out);
+bool schemeToDouble(Value *value, double *out);
+bool schemeToBoolean(Value *value, bool *out);
+bool schemeToString(Value *value, const char **out);
+
+/*
+* Calls a procedure (a closure or primitive) with a list of arguments.
+* Returns NULL on error.
+*/
+Value *schemeApply(Interpreter *interp, Value *function, Value *args);
+
+#endif
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <string.h>
+#include "value.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "scheme.h"
+
+/*
+* (square x) implemented in C.
+*/
+Value *square(Interpreter *interp, Value *args) {
+   int x;
+   if (length(args) != 1 || !schemeToInteger(car(args), &x)) {
+      evaluationError(interp, "square expects one integer");
+   }
+   return schemeInteger(interp, x * x);
+}
+
+int main(void) {
+   Interpreter *interp = schemeCreate();
+   schemeDefine(interp, "square", square);
+   schemeDefineValue(interp, "limit", schemeInteger(interp, 10));
+
+   int i;
+   Value *result = schemeEval(interp,
+      "(define f (lambda (x) (+ (square x) limit))) (f 4)");
+   if (result && schemeToInteger(result, &i)) {
+      printf("(f 4) = %i\n", i);
+   }
+
+   result = schemeEval(interp, "(car 5)");
+   printf("(car 5) failed: %s", result ? "no\n" : schemeError(interp));
+   result = schemeEval(interp, "(square 1 2)");
+   printf("(square 1 2) failed: %s", result ? "no\n" : schemeError(interp));
+
+   // the instance is still usable after an error
+   Value *f = schemeEval(interp, "f");
+   Value *args = schemeCons(interp, schemeInteger(interp, 5),
+                            schemeNull(interp));
+   result = schemeApply(interp, f, args);
+   if (result && schemeToInteger(result, &i)) {
+      printf("(f 5) = %i\n", i);
+   }
+
+   if (!schemeLoad(interp, "missing.scm")) {
+      printf("%s", schemeError(interp));
+   }
+   if (schemeLoad(interp, "math.scm")) {
+      double d;
+      result = schemeEval(interp, "(modulo 17 5)");
+      if (result && schemeToDouble(result, &d)) {
+         printf("(modulo 17 5) = %g\n", d);
+      }
+   }
+
+   // redefining from C updates the binding code already refers to
+   schemeEval(interp, "(define get-limit (lambda () limit)) (get-limit)");
+   schemeDefineValue(interp, "limit", schemeInteger(interp, 20));
+   result = schemeEval(interp, "(get-limit)");
+   if (result && schemeToInteger(result, &i)) {
+      printf("(get-limit) after redefining = %i\n", i);
+   }
+
+   // two instances do not share bindings
+   Interpreter *other = schemeCreate();
+   result = schemeEval(other, "limit");
+   printf("limit in another instance failed: %s",
+          result ? "no\n" : schemeError(other));
+   schemeDestroy(other);
+
+   const char *s;
+   result = schemeEval(interp, "\"still here\"");
+   if (result && schemeToString(result, &s)) {
+      printf("%s\n", s);
+   }
+   schemeDestroy(interp);
+   return 0;
+}
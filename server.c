@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "value.h"
+#include "talloc.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "interpreter.h"
+#include "server.h"
+
+/*
+* Evaluates the program read from the connection 'conn' in the global frame,
+* with stdout redirected to the connection, then closes it. Errors are
+* reported to the client: one in a top-level form skips just that form,
+* and a syntax error skips the whole program.
+*/
+static void handleRequest(Interpreter *interp, int conn) {
+    FILE *in = fdopen(conn, "r");
+    if (!in) {
+        close(conn);
+        return;
+    }
+    fflush(stdout);
+    int savedOut = dup(STDOUT_FILENO);
+    dup2(conn, STDOUT_FILENO);
+
+    Checkpoint saved;
+    jmp_buf onError;
+    checkpoint(interp, &saved, &onError);
+    if (!setjmp(onError)) {
+        interp->in = in;
+        Value *tree = parse(interp, tokenize(interp, false));
+        interpret(interp, tree);
+    } else {
+        printf("%s", interp->error);
+    }
+    restore(interp, &saved);
+
+    fflush(stdout);
+    dup2(savedOut, STDOUT_FILENO);
+    close(savedOut);
+    fclose(in);
+}
+
+/*
+* Creates the listening socket at 'path', replacing any stale socket file.
+* Returns -1 on failure.
+*/
+static int listenAt(char *path) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(fd, 64) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void serve(Interpreter *interp, char *path, bool forking) {
+    int fd = listenAt(path);
+    if (fd < 0) {
+        printf("Error: could not listen on %s: %s\n", path, strerror(errno));
+        return;
+    }
+    if (forking) {
+        // children are never waited for
+        signal(SIGCHLD, SIG_IGN);
+    }
+    // a client that hangs up early must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    while (true) {
+        int conn = accept(fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            printf("Error: accept failed: %s\n", strerror(errno));
+            break;
+        }
+        if (!forking) {
+            handleRequest(interp, conn);
+            continue;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fd);
+            handleRequest(interp, conn);
+            // skip the parent's exit handlers (trace and profile reports)
+            _exit(0);
+        }
+        if (pid < 0) {
+            printf("Error: fork failed: %s\n", strerror(errno));
+        }
+        close(conn);
+    }
+    close(fd);
+}
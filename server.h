@@ -0,0 +1,23 @@
+#include <stdbool.h>
+#include "context.h"
+
+#ifndef SERVER_H
+#define SERVER_H
+
+/*
+* Listens on the Unix domain socket at 'path' and evaluates one program per
+* connection in 'interp', whose global frame should already hold the
+* prelude. A client writes the source and shuts down its side of the
+* connection; the output the program prints, including any error message,
+* is written back and the connection is closed.
+*
+* If 'forking' is true each request runs in a child forked from the server,
+* which starts with the warm heap (copy-on-write) and whose definitions are
+* discarded when it exits. Otherwise requests run in the server itself, one
+* at a time, and definitions persist from one request to the next.
+*
+* Returns only if the socket cannot be set up.
+*/
+void serve(Interpreter *interp, char *path, bool forking);
+
+#endif
@@ -1,53 +1,52 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "value.h"
+#include "talloc.h"
+#include "profiler.h"
 #include <assert.h>
 
-static Value *head;
-
+#define BLOCK_SIZE 1022 // pointers per block, so a block is 8KB
 
 /*
- * Create an empty list (a new Value object of type NULL_TYPE).
-*/
-Value *makeNullT() {
-   Value *lst = malloc(sizeof(Value));
-   assert(lst);
-   lst->type = NULL_TYPE;
-   return lst;
-}
+ * A chunk of the active list: up to BLOCK_SIZE pointers handed out by talloc.
+ */
+typedef struct Block {
+   struct Block *next;
+   long count;
+   void *pointers[BLOCK_SIZE];
+} Block;
 
 /*
- * Create a nonempty list (a new Value object of type CONS_TYPE).
+ * The active list of one heap, newest block first.
  */
-Value *consT(Value *car, Value *cdr) {
-   Value *lst = malloc(sizeof(Value));
-   assert(lst);
-   lst->type = CONS_TYPE;
-   (lst->c).car = car;
-   (lst->c).cdr = cdr;
-   return lst;
-}
+struct Heap {
+   Block *blocks;
+};
+
+// The heap talloc allocates into on this thread. Threads that never install
+// a heap get a default one the first time they call talloc.
+static __thread Heap *current;
 
 /*
- * Get the car value of a given list.
- * (Uses assertions to ensure that this is a legitimate operation.)
-*/
-Value *carT(Value *list) {
-   assert((list->type) == CONS_TYPE);
-   return (list->c).car;
+ * Create a new, empty heap.
+ */
+Heap *makeHeap() {
+   Heap *heap = malloc(sizeof(Heap));
+   assert(heap);
+   heap->blocks = NULL;
+   return heap;
 }
 
 /*
- * Get the cdr value of a given list.
- * (Uses assertions to ensure that this is a legitimate operation.)
+ * Make 'heap' the one that talloc, tfree and texit use on the calling
+ * thread, and return the heap that was in use before.
  */
-Value *cdrT(Value *list) {
-   assert((list->type) == CONS_TYPE);
-   return (list->c).cdr;
+Heap *tswitch(Heap *heap) {
+   Heap *previous = current;
+   current = heap;
+   return previous;
 }
 
-
-
 /*
  * A malloc-like function that allocates memory, tracking all allocated
  * pointers in the "active list."  (You can choose your implementation of the
@@ -56,38 +55,81 @@ Value *cdrT(Value *list) {
  * Otherwise you'll end up with circular dependencies, since you're going to
  * modify the linked list to use talloc instead of malloc.)
  */
-void *talloc(size_t size) {
+void *tallocAt(size_t size, const char *kind, const char *site) {
    void *pointer = malloc(size);
    assert(pointer);
-   Value *toAdd = makeNullT();
-   toAdd -> type = PTR_TYPE;
-   toAdd -> p = pointer;
-   if(!head) {
-      head = makeNullT();
+   if (profiling) {
+      profileAllocation(size, kind, site);
+   }
+   if (!current) {
+      current = makeHeap();
+   }
+   Block *block = current->blocks;
+   if (!block || block->count == BLOCK_SIZE) {
+      block = malloc(sizeof(Block));
+      assert(block);
+      block->count = 0;
+      block->next = current->blocks;
+      current->blocks = block;
    }
-   head = consT(toAdd,head);
+   block->pointers[block->count++] = pointer;
    return pointer;
 }
 
+/*
+ * Free every pointer on the given heap's active list, and the list itself.
+ * The heap is left empty and can be used again.
+ */
+void tfreeHeap(Heap *heap) {
+   Block *block = heap->blocks;
+   while (block) {
+      for (long i = 0; i < block->count; i++) {
+         free(block->pointers[i]);
+      }
+      Block *next = block->next;
+      free(block);
+      block = next;
+   }
+   heap->blocks = NULL;
+}
+
+/*
+ * Free a heap and everything allocated on it.
+ */
+void tdestroy(Heap *heap) {
+   if (current == heap) {
+      current = NULL;
+   }
+   tfreeHeap(heap);
+   free(heap);
+}
+
+/*
+ * Move the active list of 'from' onto 'into' and free 'from'.
+ */
+void tmerge(Heap *into, Heap *from) {
+   if (current == from) {
+      current = into;
+   }
+   Block *last = from->blocks;
+   if (last) {
+      while (last->next) {
+         last = last->next;
+      }
+      last->next = into->blocks;
+      into->blocks = from->blocks;
+   }
+   free(from);
+}
+
 /*
  * Free all pointers allocated by talloc, as well as whatever memory you
  * malloc'ed to create/update the active list.
  */
 void tfree() {
-   assert(head);
-   Value *next = head;
-   while (next && next->type != NULL_TYPE) {
-     Value *val = carT(next);
-     assert(val->type == PTR_TYPE);
-     free(val->p);
-     free(val);
-     Value *temp = cdrT(next);
-     free(next);
-     next = temp;
+   if (current) {
+      tfreeHeap(current);
    }
-   free(next);
-   // Makes head null so a new list will be created next time talloc is called
-   head = NULL;
 }
 
 /*
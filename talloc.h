@@ -4,6 +4,25 @@
 #ifndef TALLOC_H
 #define TALLOC_H
 
+/*
+ * A heap is one active list. Each interpreter owns a heap, and talloc
+ * allocates into whichever heap is current on the calling thread, so
+ * interpreters running on different threads never share one.
+ */
+typedef struct Heap Heap;
+
+/*
+ * Create a new, empty heap.
+ */
+Heap *makeHeap();
+
+/*
+ * Make 'heap' the one that talloc, tfree and texit use on the calling
+ * thread, and return the heap that was in use before (possibly NULL, in which
+ * case talloc creates a default heap for the thread when first called).
+ */
+Heap *tswitch(Heap *heap);
+
 /*
  * A malloc-like function that allocates memory, tracking all allocated
  * pointers in the "active list."  (You can choose your implementation of the
@@ -11,8 +30,13 @@
  * in linkedlist.h; instead, implement any list-like behavior directly here.
  * Otherwise you'll end up with circular dependencies, since you're going to
  * modify the linked list to use talloc instead of malloc.)
+ *
+ * 'kind' and 'site' name the allocating function and its C caller for the
+ * allocation profiler; code normally calls this through the talloc macro.
  */
-void *talloc(size_t size);
+void *tallocAt(size_t size, const char *kind, const char *site);
+
+#define talloc(size) tallocAt((size), "talloc", __func__)
 
 /*
  * Free all pointers allocated by talloc, as well as whatever memory you
@@ -20,6 +44,24 @@ void *talloc(size_t size);
  */
 void tfree();
 
+/*
+ * Free every pointer on the given heap's active list. The heap is left empty
+ * and can be used again.
+ */
+void tfreeHeap(Heap *heap);
+
+/*
+ * Free a heap and everything allocated on it.
+ */
+void tdestroy(Heap *heap);
+
+/*
+ * Move everything allocated on 'from' onto 'into', then free 'from' itself.
+ * Used to keep values built on another thread's heap once that thread is done
+ * with it. Neither heap may be in use by another thread meanwhile.
+ */
+void tmerge(Heap *into, Heap *from);
+
 /*
  * A simple two-line function to stand in the C function "exit", which calls
  * tfree() and then exit().  (You'll use this later to allow a clean exit from
@@ -0,0 +1,19 @@
+;; Entry points for the place tests in test.interpreter.input.08
+
+(define sum
+  (lambda (lst)
+    (if (null? lst) 0 (+ (car lst) (sum (cdr lst))))))
+
+;; Replies to each list of numbers with its sum until sent 'stop
+(define adder
+  (lambda (ch)
+    (let ((msg (place-channel-get ch)))
+      (if (pair? msg)
+          (begin
+            (place-channel-put ch (sum msg))
+            (adder ch))
+          (place-channel-put ch msg)))))
+
+(define broken
+  (lambda (ch)
+    (car ch)))
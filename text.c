@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "value.h"
+#include "talloc.h"
+#include "linkedlist.h"
+#include "interpreter.h"
+#include "text.h"
+
+#define INITIAL_CAPACITY 64
+
+struct StringBuilder {
+    char *chars;  // NUL-terminated
+    int length;
+    int capacity; // characters that fit, not counting the NUL
+};
+
+int stringLength(Value *string) {
+    // strings are shared between threads; both may count, with one result
+    int length = __atomic_load_n(&string->length, __ATOMIC_RELAXED);
+    if (!length && string->s[0]) {
+        length = strlen(string->s);
+        __atomic_store_n(&string->length, length, __ATOMIC_RELAXED);
+    }
+    return length;
+}
+
+/*
+* FNV-1a.
+*/
+unsigned int stringHash(Value *string) {
+    unsigned int hash = __atomic_load_n(&string->hash, __ATOMIC_RELAXED);
+    if (!hash) {
+        hash = 2166136261U;
+        int length = stringLength(string);
+        for (int i = 0; i < length; i++) {
+            hash = (hash ^ (unsigned char)string->s[i]) * 16777619U;
+        }
+        hash = hash ? hash : 1;
+        __atomic_store_n(&string->hash, hash, __ATOMIC_RELAXED);
+    }
+    return hash;
+}
+
+/*
+* Returns a new string of 'length' characters, not yet filled in.
+*/
+static Value *allocateString(int length) {
+    Value *string = makeNull();
+    string->type = STR_TYPE;
+    string->s = talloc(length + 1);
+    string->s[length] = '\0';
+    string->length = length;
+    string->hash = 0;
+    return string;
+}
+
+Value *makeString(char *chars, int length) {
+    Value *string = allocateString(length);
+    memcpy(string->s, chars, length);
+    return string;
+}
+
+static Value *makeInt(int i) {
+    Value *value = makeNull();
+    value->type = INT_TYPE;
+    value->i = i;
+    return value;
+}
+
+static Value *makeFalse() {
+    Value *value = makeNull();
+    value->type = BOOL_TYPE;
+    value->b = false;
+    return value;
+}
+
+static Value *makeVoid() {
+    Value *value = makeNull();
+    value->type = VOID_TYPE;
+    return value;
+}
+
+/*
+* Returns the number of elements of 'args' if it has between 'least' and
+* 'most' of them, raising 'message' otherwise.
+*/
+static int countArguments(Interpreter *interp, Value *args, int least,
+                          int most, char *message) {
+    int count = 0;
+    for (; args->type == CONS_TYPE; args = cdr(args)) {
+        count++;
+    }
+    if (count < least || count > most) {
+        evaluationError(interp, message);
+    }
+    return count;
+}
+
+/*
+* Returns the string argument 'arg', raising 'message' if it is not one.
+*/
+static Value *stringArgument(Interpreter *interp, Value *arg, char *message) {
+    if (arg->type != STR_TYPE) {
+        evaluationError(interp, message);
+    }
+    return arg;
+}
+
+/*
+* Returns the index argument 'arg', raising 'message' unless it is an
+* integer from 0 to 'limit'.
+*/
+static int indexArgument(Interpreter *interp, Value *arg, int limit,
+                         char *message) {
+    if (arg->type != INT_TYPE) {
+        evaluationError(interp, message);
+    }
+    if (arg->i < 0 || arg->i > limit) {
+        evaluationError(interp, "Index out of range");
+    }
+    return arg->i;
+}
+
+Value *primitiveStringLength(Interpreter *interp, Value *args) {
+    countArguments(interp, args, 1, 1,
+                   "Wrong number of arguments provided for string-length");
+    Value *string = stringArgument(interp, car(args),
+                                   "Wrong argument type provided for string-length");
+    return makeInt(stringLength(string));
+}
+
+Value *primitiveSubstring(Interpreter *interp, Value *args) {
+    int count = countArguments(interp, args, 2, 3,
+                               "Wrong number of arguments provided for substring");
+    char *typeError = "Wrong argument type provided for substring";
+    Value *string = stringArgument(interp, car(args), typeError);
+    int length = stringLength(string);
+    int start = indexArgument(interp, car(cdr(args)), length, typeError);
+    int end = length;
+    if (count == 3) {
+        end = indexArgument(interp, car(cdr(cdr(args))), length, typeError);
+    }
+    if (end < start) {
+        evaluationError(interp, "Index out of range");
+    }
+    if (end < length) {
+        return makeString(string->s + start, end - start);
+    }
+    // the rest of the string is still NUL-terminated, so share it
+    Value *suffix = makeNull();
+    suffix->type = STR_TYPE;
+    suffix->s = string->s + start;
+    suffix->length = length - start;
+    suffix->hash = 0;
+    return suffix;
+}
+
+Value *primitiveStringAppend(Interpreter *interp, Value *args) {
+    int total = 0;
+    for (Value *arg = args; arg->type == CONS_TYPE; arg = cdr(arg)) {
+        stringArgument(interp, car(arg),
+                       "Wrong argument type provided for string-append");
+        total += stringLength(car(arg));
+    }
+    Value *result = allocateString(total);
+    char *next = result->s;
+    for (; args->type == CONS_TYPE; args = cdr(args)) {
+        int length = stringLength(car(args));
+        memcpy(next, car(args)->s, length);
+        next += length;
+    }
+    return result;
+}
+
+/*
+* Returns the index from which string-search or string-index starts
+* looking: the optional third argument, or 0.
+*/
+static int startArgument(Interpreter *interp, Value *args, int count,
+                         int length, char *typeError) {
+    if (count < 3) {
+        return 0;
+    }
+    return indexArgument(interp, car(cdr(cdr(args))), length, typeError);
+}
+
+Value *primitiveStringSearch(Interpreter *interp, Value *args) {
+    int count = countArguments(interp, args, 2, 3,
+                               "Wrong number of arguments provided for string-search");
+    char *typeError = "Wrong argument type provided for string-search";
+    Value *pattern = stringArgument(interp, car(args), typeError);
+    Value *string = stringArgument(interp, car(cdr(args)), typeError);
+    int length = stringLength(string);
+    int start = startArgument(interp, args, count, length, typeError);
+    char *found = memmem(string->s + start, length - start, pattern->s,
+                         stringLength(pattern));
+    return found ? makeInt(found - string->s) : makeFalse();
+}
+
+Value *primitiveStringIndex(Interpreter *interp, Value *args) {
+    int count = countArguments(interp, args, 2, 3,
+                               "Wrong number of arguments provided for string-index");
+    char *typeError = "Wrong argument type provided for string-index";
+    Value *string = stringArgument(interp, car(args), typeError);
+    Value *c = stringArgument(interp, car(cdr(args)), typeError);
+    if (stringLength(c) != 1) {
+        evaluationError(interp, typeError);
+    }
+    int length = stringLength(string);
+    int start = startArgument(interp, args, count, length, typeError);
+    char *found = memchr(string->s + start, c->s[0], length - start);
+    return found ? makeInt(found - string->s) : makeFalse();
+}
+
+Value *primitiveStringBuilder(Interpreter *interp, Value *args) {
+    int count = countArguments(interp, args, 0, 1,
+                               "Wrong number of arguments provided for string-builder");
+    int capacity = INITIAL_CAPACITY;
+    if (count == 1) {
+        if (car(args)->type != INT_TYPE || car(args)->i < 0) {
+            evaluationError(interp, "Wrong argument type provided for string-builder");
+        }
+        capacity = car(args)->i;
+    }
+    StringBuilder *builder = talloc(sizeof(StringBuilder));
+    builder->chars = talloc(capacity + 1);
+    builder->chars[0] = '\0';
+    builder->length = 0;
+    builder->capacity = capacity;
+    Value *value = makeNull();
+    value->type = BUILDER_TYPE;
+    value->builder = builder;
+    return value;
+}
+
+/*
+* Returns the builder argument 'arg', raising 'message' if it is not one.
+*/
+static StringBuilder *builderArgument(Interpreter *interp, Value *arg,
+                                      char *message) {
+    if (arg->type != BUILDER_TYPE) {
+        evaluationError(interp, message);
+    }
+    return arg->builder;
+}
+
+/*
+* Makes room for at least 'needed' characters, doubling the buffer.
+*/
+static void reserve(StringBuilder *builder, int needed) {
+    if (needed <= builder->capacity) {
+        return;
+    }
+    int capacity = builder->capacity ? builder->capacity : INITIAL_CAPACITY;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    char *chars = talloc(capacity + 1);
+    memcpy(chars, builder->chars, builder->length + 1);
+    builder->chars = chars;
+    builder->capacity = capacity;
+}
+
+Value *primitiveStringBuilderAppend(Interpreter *interp, Value *args) {
+    countArguments(interp, args, 1, 1 << 30,
+                   "Wrong number of arguments provided for string-builder-append!");
+    char *typeError = "Wrong argument type provided for string-builder-append!";
+    StringBuilder *builder = builderArgument(interp, car(args), typeError);
+    for (args = cdr(args); args->type == CONS_TYPE; args = cdr(args)) {
+        Value *string = stringArgument(interp, car(args), typeError);
+        int length = stringLength(string);
+        reserve(builder, builder->length + length);
+        memcpy(builder->chars + builder->length, string->s, length + 1);
+        builder->length += length;
+    }
+    return makeVoid();
+}
+
+Value *primitiveStringBuilderToString(Interpreter *interp, Value *args) {
+    countArguments(interp, args, 1, 1,
+                   "Wrong number of arguments provided for string-builder->string");
+    StringBuilder *builder = builderArgument(interp, car(args),
+                                             "Wrong argument type provided for string-builder->string");
+    return makeString(builder->chars, builder->length);
+}
+
+size_t builderSize(Value *builder) {
+    return sizeof(StringBuilder) + builder->builder->capacity + 1;
+}
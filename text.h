@@ -0,0 +1,97 @@
+#include "value.h"
+#include "context.h"
+#include "heapdump.h"
+
+#ifndef TEXT_H
+#define TEXT_H
+
+/*
+* Strings and string builders. A string's characters stay NUL-terminated
+* in 's', so every C function taking a char * still works on them, and its
+* length and hash are counted the first time they are needed and kept in
+* the Value, so later calls take constant time. Strings made here record
+* their length from the start.
+*
+* A substring that runs to the end of its string shares its characters;
+* any other substring is a copy. A string builder holds a buffer that
+* doubles when full, so appending n characters one string at a time takes
+* O(n) in total.
+*
+* Strings cannot contain NUL characters.
+*/
+
+/*
+* A mutable buffer made by (string-builder).
+*/
+typedef struct StringBuilder StringBuilder;
+
+/*
+* Returns the number of characters in the string 'string'.
+*/
+int stringLength(Value *string);
+
+/*
+* Returns a hash of the characters of the string 'string', never 0.
+*/
+unsigned int stringHash(Value *string);
+
+/*
+* Returns a new string holding a copy of the 'length' characters at
+* 'chars'.
+*/
+Value *makeString(char *chars, int length);
+
+/*
+* (string-length s) returns the number of characters in s.
+*/
+Value *primitiveStringLength(Interpreter *interp, Value *args);
+
+/*
+* (substring s start) or (substring s start end) returns the characters of
+* s from index start up to, but not including, end (the length of s if not
+* given).
+*/
+Value *primitiveSubstring(Interpreter *interp, Value *args);
+
+/*
+* (string-append s ...) returns the strings joined in order.
+*/
+Value *primitiveStringAppend(Interpreter *interp, Value *args);
+
+/*
+* (string-search pattern s) or (string-search pattern s start) returns the
+* index of the first occurrence of pattern in s at or after start, or #f.
+*/
+Value *primitiveStringSearch(Interpreter *interp, Value *args);
+
+/*
+* (string-index s c) or (string-index s c start) returns the index of the
+* first occurrence of the one-character string c in s at or after start,
+* or #f.
+*/
+Value *primitiveStringIndex(Interpreter *interp, Value *args);
+
+/*
+* (string-builder) or (string-builder capacity) returns a new, empty
+* string builder.
+*/
+Value *primitiveStringBuilder(Interpreter *interp, Value *args);
+
+/*
+* (string-builder-append! b s ...) adds the strings to the end of b.
+*/
+Value *primitiveStringBuilderAppend(Interpreter *interp, Value *args);
+
+/*
+* (string-builder->string b) returns a string of what b holds so far. b
+* can go on being appended to.
+*/
+Value *primitiveStringBuilderToString(Interpreter *interp, Value *args);
+
+/*
+* Returns the size of the string builder 'builder' and its characters,
+* for heap-dump.
+*/
+size_t builderSize(Value *builder);
+
+#endif
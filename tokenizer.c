@@ -106,38 +106,49 @@ Value *strListToVal(Value *list, int length, int type) {
 }
 
 /*
-* Called to exit the tokenizer and print an error message.
+* Called to exit the tokenizer with an error message, which shows the last
+* few tokens read.
 */
-void exitWithError(Value *list, int lineNum) {
+void exitWithError(Interpreter *interp, Value *list, int lineNum) {
+    char *text;
+    size_t size;
+    FILE *message = open_memstream(&text, &size);
+    assert(message);
     if (list->type == NULL_TYPE) {
-        printf("Error: invalid syntax on line %i.\n", lineNum);
-        texit(1);
-    }
-    printf("Error: invalid syntax on line %i, after tokens: \n", lineNum);
-    Value *lastfew = makeNull();
-    for (int i = 0; i < 10; i++) {
-        if (list->type != NULL_TYPE) {
-            lastfew = cons(car(list), lastfew);
-            list = cdr(list);
+        fprintf(message, "Error: invalid syntax on line %i.\n", lineNum);
+    } else {
+        fprintf(message, "Error: invalid syntax on line %i, after tokens: \n",
+                lineNum);
+        Value *lastfew = makeNull();
+        for (int i = 0; i < 10; i++) {
+            if (list->type != NULL_TYPE) {
+                lastfew = cons(car(list), lastfew);
+                list = cdr(list);
+            }
         }
+        writeTokens(message, lastfew);
     }
-    displayTokens(lastfew);
-    texit(1);
+    fclose(message);
+    char *copy = talloc(size + 1);
+    strcpy(copy, text);
+    free(text);
+    raiseError(interp, copy);
 }
 
 /*
 * Adds a string to the list
 */
-Value *addString(Value *list, char charRead, int lineNum) {
+Value *addString(Interpreter *interp, Value *list, char charRead,
+                 int lineNum) {
     Value *strList = makeNull();
     int length = 1;
-    charRead = fgetc(stdin);
+    charRead = fgetc(interp->in);
     while (charRead!='\"') {
         if (charRead == EOF) {
-            exitWithError(list, lineNum);
+            exitWithError(interp, list, lineNum);
         } else if (charRead == '\\') {
             // Escaped character.
-            charRead = fgetc(stdin);
+            charRead = fgetc(interp->in);
             switch (charRead) {
               case 'n':
                 charRead = '\n';
@@ -155,11 +166,11 @@ Value *addString(Value *list, char charRead, int lineNum) {
                 charRead = '\\';
                 break;
               default:
-                exitWithError(list, lineNum);
+                exitWithError(interp, list, lineNum);
             }
         }
         strList = addStrToken(strList, charRead);
-        charRead = fgetc(stdin);
+        charRead = fgetc(interp->in);
         length++;
     }
     return cons(strListToVal(strList, length, STR_TYPE), list);
@@ -168,7 +179,7 @@ Value *addString(Value *list, char charRead, int lineNum) {
 /*
 * Adds a DOUBLE_TYPE token to the list
 */
-Value *addDouble(Value *list, double d, char charRead,
+Value *addDouble(Interpreter *interp, Value *list, double d, char charRead,
                  char oldChar, int lineNum) {
     int numDec = -1; // counter
     while (isDigit(charRead)) {
@@ -176,11 +187,11 @@ Value *addDouble(Value *list, double d, char charRead,
         // 10^(-n) and then add it to the result d.
         d = d + (charRead - '0') * pow(10, numDec);
         numDec--;
-        charRead = fgetc(stdin);
+        charRead = fgetc(interp->in);
     }
     if (!(charRead == '\n' || charRead == '(' || charRead == ')' ||
           charRead == ' ' || charRead == EOF)) {
-        exitWithError(list,lineNum);
+        exitWithError(interp, list,lineNum);
     }
     Value *num = makeNull();
     num->type = DOUBLE_TYPE;
@@ -189,7 +200,7 @@ Value *addDouble(Value *list, double d, char charRead,
     } else {
         num->d = d;
     }
-    ungetc(charRead,stdin);
+    ungetc(charRead, interp->in);
     return cons(num, list);
 }
 
@@ -210,49 +221,57 @@ Value *addInt(Value *list, int i, char oldChar, int lineNum) {
 /*
 * Adds a number (or possibly + or -) to the list
 */
-Value *addNumber(Value *list, char charRead, int lineNum) {
+Value *addNumber(Interpreter *interp, Value *list, char charRead,
+                 int lineNum) {
     bool isNum = true;
     char oldChar = charRead;
     if (charRead == '+' || charRead == '-'){
-        charRead = fgetc(stdin);
+        charRead = fgetc(interp->in);
         if (!(isDigit(charRead) || charRead == '.')) {
             char str[2];
             str[0] = oldChar;
             str[1] = '\0';
             list = addSymbolToken(list, str, 1);
             isNum = false;
-            ungetc(charRead,stdin);
+            ungetc(charRead, interp->in);
         }
     }
     if (charRead == '.') {
-        charRead = fgetc(stdin);
+        charRead = fgetc(interp->in);
         if (!(isDigit(charRead))) {
             isNum = false;
             if (charRead == ' ') {
                 while (charRead == ' ' || charRead == '\n') {
-                    charRead = fgetc(stdin);
+                    charRead = fgetc(interp->in);
                 }
                 if (charRead == EOF || charRead == ')') {
-                    exitWithError(list,lineNum);
+                    exitWithError(interp, list,lineNum);
                 }
-                ungetc(charRead,stdin);
+                ungetc(charRead, interp->in);
                 Value *val = makeNull();
                 val->type = DOT_TYPE;
                 return cons(val, list);
+            } else if (charRead == '.') {
+                // the ellipsis of syntax-rules, the one symbol starting
+                // with a dot
+                if (fgetc(interp->in) != '.') {
+                    exitWithError(interp, list, lineNum);
+                }
+                return addSymbolToken(list, "...", 3);
             } else {
-                exitWithError(list,lineNum);
+                exitWithError(interp, list,lineNum);
             }
         }
-        ungetc(charRead,stdin);
+        ungetc(charRead, interp->in);
         charRead = '.';
     }
     if (isNum) {
         if (charRead == '.') {
-            charRead = fgetc(stdin);
+            charRead = fgetc(interp->in);
             if (!(isDigit(charRead))) {
-                exitWithError(list,lineNum);
+                exitWithError(interp, list,lineNum);
             }
-            ungetc(charRead,stdin);
+            ungetc(charRead, interp->in);
             charRead = '.'; // reassign so we enter double case
         }
         int i = 0;
@@ -260,23 +279,24 @@ Value *addNumber(Value *list, char charRead, int lineNum) {
         // and add the next digit every loop.
         while (isDigit(charRead)) {
             i = i*10 + (charRead-'0'); // subtracting '0' converts char into int
-            charRead = fgetc(stdin);
+            charRead = fgetc(interp->in);
         }
         if (!(charRead == '\n' || charRead == '(' || charRead == '.' ||
               charRead == ')' || charRead == ' ' || charRead == EOF)) {
-            exitWithError(list,lineNum);
+            exitWithError(interp, list,lineNum);
         }
         if (charRead == EOF) {
             list = addInt(list, i, oldChar, lineNum);
-            ungetc(charRead,stdin);
+            ungetc(charRead, interp->in);
             return list;
         }
         if (charRead == '.') {
-            charRead = fgetc(stdin);
-            list = addDouble(list, (double) i, charRead, oldChar, lineNum);
+            charRead = fgetc(interp->in);
+            list = addDouble(interp, list, (double) i, charRead, oldChar,
+                             lineNum);
         } else {
             list = addInt(list, i, oldChar, lineNum);
-            ungetc(charRead,stdin);
+            ungetc(charRead, interp->in);
         }
     }
     return list;
@@ -285,7 +305,8 @@ Value *addNumber(Value *list, char charRead, int lineNum) {
 /*
 * Adds a symbol to the list
 */
-Value *addSymbol(Value *list, char charRead, int lineNum) {
+Value *addSymbol(Interpreter *interp, Value *list, char charRead,
+                 int lineNum) {
     if (charRead == '\'') {
         Value *val = makeNull();
         val->type = SYMBOL_TYPE;
@@ -295,19 +316,19 @@ Value *addSymbol(Value *list, char charRead, int lineNum) {
     int length = 1;
     Value *strList = makeNull();
     strList = addStrToken(strList, charRead);
-    charRead = fgetc(stdin);
+    charRead = fgetc(interp->in);
     while (isSubsequent(charRead) && charRead != EOF) {
         if (charRead == '\\') {
             strList = addStrToken(strList, charRead);
-            charRead = fgetc(stdin);
+            charRead = fgetc(interp->in);
             length++;
             assert(charRead != EOF);
         }
         strList = addStrToken(strList, charRead);
-        charRead = fgetc(stdin);
+        charRead = fgetc(interp->in);
         length++;
    }
-   ungetc(charRead, stdin);
+   ungetc(charRead, interp->in);
    return cons(strListToVal(strList, length, SYMBOL_TYPE), list);
 }
 
@@ -315,10 +336,10 @@ Value *addSymbol(Value *list, char charRead, int lineNum) {
 * Reads the input stream and returns a linked list containing all tokens
 * Uses bool activeInput to determine how to treat \n
 */
-Value *tokenize(bool activeInput) {
+Value *tokenize(Interpreter *interp, bool activeInput) {
     char charRead;
     Value *list = makeNull();
-    charRead = fgetc(stdin);
+    charRead = fgetc(interp->in);
     int lineNum = 1; // current line, for error messages
     while (charRead != EOF) {
         if (charRead == '(') {
@@ -326,41 +347,41 @@ Value *tokenize(bool activeInput) {
         } else if (charRead == ')') {
             list = addBoolToken(list, CLOSE_TYPE, true);
         } else if (charRead == '#'){
-            char result = fgetc(stdin);
+            char result = fgetc(interp->in);
             if (!(result == 't' || result == 'f')) {
-                exitWithError(list, lineNum);
+                exitWithError(interp, list, lineNum);
             }
-            charRead = fgetc(stdin);
+            charRead = fgetc(interp->in);
             // catch stuff like #tofu
             if (!((charRead == ' ')||(charRead == '\n') || (charRead == '(') ||
                (charRead == ')'))) {
-                exitWithError(list,lineNum);
+                exitWithError(interp, list,lineNum);
             }
-            ungetc(charRead,stdin);
+            ungetc(charRead, interp->in);
             list = addBoolToken(list, BOOL_TYPE, (result == 't'));
         } else if (charRead == '\"') {
-            list = addString(list, charRead, lineNum);
+            list = addString(interp, list, charRead, lineNum);
         } else if (charRead == ';') {
             while (charRead != '\n' && charRead != EOF) {
-                charRead = fgetc(stdin);
+                charRead = fgetc(interp->in);
             }
-            ungetc(charRead, stdin); // move back one place in input stream
+            ungetc(charRead, interp->in); // move back one place in input
         } else if (isDigit(charRead) || charRead == '+' ||
                    charRead == '-' || charRead == '.') {
-            list = addNumber(list, charRead, lineNum);
+            list = addNumber(interp, list, charRead, lineNum);
         } else if (isInitial(charRead) || charRead == '\'') {
-            list = addSymbol(list, charRead, lineNum);
+            list = addSymbol(interp, list, charRead, lineNum);
         } else if (charRead == ' '){
         } else if (charRead == '\n') {
             lineNum++;
         } else {
-            exitWithError(list, lineNum);
+            exitWithError(interp, list, lineNum);
         }
         // treat \n as EOF for REPL loop to trigger next user input
         if (activeInput && charRead == '\n') {
             charRead = EOF;
         } else {
-            charRead = fgetc(stdin);
+            charRead = fgetc(interp->in);
         }
     }
     return reverse(list);
@@ -371,6 +392,13 @@ Value *tokenize(bool activeInput) {
 * On each line (one token/line), prints token:token_type
 */
 void displayTokens(Value *list) {
+    writeTokens(stdout, list);
+}
+
+/*
+* Like displayTokens, but writes to the given stream.
+*/
+void writeTokens(FILE *out, Value *list) {
     Value *next = list;
     assert(next);
     assert(next -> type);
@@ -379,32 +407,32 @@ void displayTokens(Value *list) {
         assert(val);
         switch (val->type) {
             case INT_TYPE:
-                printf("%i:integer\n", val->i);
+                fprintf(out, "%i:integer\n", val->i);
                 break;
             case DOUBLE_TYPE:
-                printf("%f:double\n", val->d);
+                fprintf(out, "%f:double\n", val->d);
                 break;
             case STR_TYPE:
-                printf("%s:string\n", val->s);
+                fprintf(out, "%s:string\n", val->s);
                 break;
             case BOOL_TYPE:
-                printf("%s:boolean\n", (val->s ? "#t" : "#f"));
+                fprintf(out, "%s:boolean\n", (val->s ? "#t" : "#f"));
                 break;
             case OPEN_TYPE:
-                printf("(:open\n");
+                fprintf(out, "(:open\n");
                 break;
             case CLOSE_TYPE:
-                printf("):close\n");
+                fprintf(out, "):close\n");
                 break;
             case SYMBOL_TYPE:
                 assert(val->s);
-                printf("%s:symbol\n", val->s);
+                fprintf(out, "%s:symbol\n", val->s);
                 break;
             case DOT_TYPE:
-                printf(".:dot\n");
+                fprintf(out, ".:dot\n");
                 break;
             default:
-                printf("I don't know how to display this token type\n");
+                fprintf(out, "I don't know how to display this token type\n");
         }
         next = cdr(next);
         assert(next);
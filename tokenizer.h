@@ -1,17 +1,19 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include "value.h"
 #include "talloc.h"
 #include "linkedlist.h"
+#include "context.h"
 
 #ifndef TOKENIZER_H
 #define TOKENIZER_H
 
 /*
-* Reads the input stream and returns a linked list containing all tokens found.
-* Also includes a boolean activeInput, which is true if the REPL is active and
-* false otherwise.
+* Reads the interpreter's input stream and returns a linked list containing
+* all tokens found. Also includes a boolean activeInput, which is true if the
+* REPL is active and false otherwise.
 */
-Value *tokenize(bool activeInput);
+Value *tokenize(Interpreter *interp, bool activeInput);
 
 /*
 * Given a list of tokens, prints out all tokens.
@@ -19,4 +21,9 @@ Value *tokenize(bool activeInput);
 */
 void displayTokens(Value *list);
 
+/*
+* Like displayTokens, but writes to the given stream.
+*/
+void writeTokens(FILE *out, Value *list);
+
 #endif
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+
+#define TRACE_CAPACITY (1 << 19) // events kept; must be a power of two
+#define TRACE_NAME_LENGTH 47
+
+/*
+* One enter or exit event. The name is copied in so that events stay valid
+* after the talloc heap holding the original string has been freed.
+*/
+typedef struct {
+    int64_t timestamp; // nanoseconds, CLOCK_MONOTONIC
+    int thread;
+    char phase; // 'B' for enter, 'E' for exit
+    char category;
+    char name[TRACE_NAME_LENGTH + 1];
+} TraceEvent;
+
+bool tracing = false;
+
+static TraceEvent *ring;
+static uint64_t next; // total number of events ever claimed
+static FILE *traceFile;
+static int threadCount;
+static __thread int threadId; // 0 until the thread records its first event
+static __thread int openSpans; // spans entered and not yet exited
+
+static char *categoryNames[] = {"closure", "primitive", "load", "toplevel"};
+
+/*
+* Returns the current time in nanoseconds.
+*/
+static int64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+* Claims the next slot of the ring and fills it in. Slots are claimed with a
+* single atomic increment, so any number of threads can record at once
+* without locking. Once the ring is full the oldest events are overwritten.
+*/
+static void record(char *name, traceCategory category, char phase) {
+    if (!threadId) {
+        threadId = __atomic_add_fetch(&threadCount, 1, __ATOMIC_RELAXED);
+    }
+    uint64_t slot = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED);
+    TraceEvent *event = &ring[slot & (TRACE_CAPACITY - 1)];
+    event->timestamp = now();
+    event->thread = threadId;
+    event->phase = phase;
+    event->category = category;
+    strncpy(event->name, name ? name : "?", TRACE_NAME_LENGTH);
+    event->name[TRACE_NAME_LENGTH] = '\0';
+}
+
+/*
+* Starts recording events, to be written to 'path' by traceFlush().
+*/
+bool traceStart(char *path) {
+    traceFile = fopen(path, "w");
+    if (!traceFile) {
+        return false;
+    }
+    ring = malloc(TRACE_CAPACITY * sizeof(TraceEvent));
+    if (!ring) {
+        fclose(traceFile);
+        return false;
+    }
+    next = 0;
+    tracing = true;
+    atexit(traceFlush);
+    return true;
+}
+
+void traceEnter(char *name, traceCategory category) {
+    openSpans++;
+    record(name, category, 'B');
+}
+
+void traceExit(char *name, traceCategory category) {
+    openSpans--;
+    record(name, category, 'E');
+}
+
+int traceDepth() {
+    return openSpans;
+}
+
+/*
+* An exit event closes the innermost open span on its thread whatever its
+* name, so the unwound spans are closed with a placeholder name.
+*/
+void traceUnwind(int depth) {
+    while (openSpans > depth) {
+        openSpans--;
+        if (tracing) {
+            record("unwound", TRACE_TOPLEVEL, 'E');
+        }
+    }
+}
+
+TraceState traceSwitch(TraceState state) {
+    TraceState previous = {threadId, openSpans};
+    threadId = state.thread;
+    openSpans = state.openSpans;
+    return previous;
+}
+
+/*
+* Prints a string as a JSON string literal.
+*/
+static void writeJsonString(FILE *file, char *s) {
+    fputc('"', file);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', file);
+            fputc(*s, file);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(file, "\\u%04x", *s);
+        } else {
+            fputc(*s, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/*
+* Writes the events still held in the ring, oldest first, as a Chrome
+* trace-event JSON object and closes the trace file. Timestamps are given in
+* microseconds relative to the first surviving event.
+*/
+void traceFlush() {
+    if (!tracing) {
+        return;
+    }
+    tracing = false;
+    uint64_t end = next;
+    uint64_t start = end > TRACE_CAPACITY ? end - TRACE_CAPACITY : 0;
+    int64_t origin = start < end ? ring[start & (TRACE_CAPACITY - 1)].timestamp
+                                 : 0;
+    int pid = getpid();
+    fprintf(traceFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (uint64_t i = start; i < end; i++) {
+        TraceEvent *event = &ring[i & (TRACE_CAPACITY - 1)];
+        fprintf(traceFile, "{\"name\":");
+        writeJsonString(traceFile, event->name);
+        fprintf(traceFile, ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                "\"pid\":%i,\"tid\":%i}%s\n",
+                categoryNames[(int)event->category], event->phase,
+                (event->timestamp - origin) / 1000.0, pid, event->thread,
+                i + 1 < end ? "," : "");
+    }
+    fprintf(traceFile, "]}\n");
+    fclose(traceFile);
+    free(ring);
+    ring = NULL;
+}
@@ -0,0 +1,72 @@
+#include <stdbool.h>
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+* Event categories, shown as "cat" in the trace viewer.
+*/
+typedef enum {
+    TRACE_CLOSURE,
+    TRACE_PRIMITIVE,
+    TRACE_LOAD,
+    TRACE_TOPLEVEL
+} traceCategory;
+
+/*
+* True while events are being recorded. Callers check this before building
+* event names so that tracing costs a single branch when it is off.
+*/
+extern bool tracing;
+
+/*
+* Starts recording events. They are written to the file at 'path' as Chrome
+* trace-event JSON when traceFlush() is called (or when the process exits).
+* Returns false if the file could not be opened.
+*/
+bool traceStart(char *path);
+
+/*
+* Records the start of a span called 'name'.
+*/
+void traceEnter(char *name, traceCategory category);
+
+/*
+* Records the end of the innermost span called 'name'.
+*/
+void traceExit(char *name, traceCategory category);
+
+/*
+* Returns the number of spans the calling thread has entered and not yet
+* exited.
+*/
+int traceDepth();
+
+/*
+* Records exits for the calling thread's innermost open spans until only
+* 'depth' remain. Used when an error abandons the evaluations they cover.
+*/
+void traceUnwind(int depth);
+
+/*
+* The calling thread's trace state: its thread id in the trace (0 until it
+* records an event) and its open spans. Code that runs several logical
+* threads on one OS thread swaps it with traceSwitch, so that each logical
+* thread shows up as a thread of its own with properly nested spans.
+*/
+typedef struct {
+    int thread;
+    int openSpans;
+} TraceState;
+
+/*
+* Installs 'state' on the calling thread and returns the state it had.
+*/
+TraceState traceSwitch(TraceState state);
+
+/*
+* Writes all recorded events to the trace file and stops tracing.
+*/
+void traceFlush();
+
+#endif
@@ -3,6 +3,18 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+struct Interpreter;
+struct Future;
+struct PlaceChannel;
+struct Task;
+struct Channel;
+struct Memo;
+struct StringBuilder;
+struct Port;
+struct Macro;
+struct Promise;
+struct Escape;
+
 typedef enum {
     PTR_TYPE,
     INT_TYPE,
@@ -17,7 +29,18 @@ typedef enum {
     VOID_TYPE,
     CLOSURE_TYPE,
     PRIMITIVE_TYPE,
-    DOT_TYPE
+    DOT_TYPE,
+    FUTURE_TYPE,
+    PLACE_TYPE,
+    TASK_TYPE,
+    CHANNEL_TYPE,
+    GUARD_TYPE,
+    BUILDER_TYPE,
+    PORT_TYPE,
+    EOF_TYPE,
+    MACRO_TYPE,
+    PROMISE_TYPE,
+    ESCAPE_TYPE
 } valueType;
 
 struct Value {
@@ -26,7 +49,20 @@ struct Value {
         void *p;
         int i;
         double d;
-        char *s;
+        struct {
+            char *s;
+            union {
+                // For a symbol in code: the cell of the global binding it
+                // refers to, once looked up there (see lookUpSymbol).
+                struct Value *cell;
+                // For a string: its length and hash once counted, or 0
+                // until then (see text.h).
+                struct {
+                    int length;
+                    unsigned int hash;
+                };
+            };
+        };
         bool b;
         struct ConsCell {
             struct Value *car;
@@ -36,8 +72,33 @@ struct Value {
             struct Value *parameters;
             struct Value *function;
             struct Frame *frame;
+            char *name; // name it was first defined under, or NULL
+            struct Memo *memo; // result cache, if made by memoize
+            // the body can never make a closure that captures its frame,
+            // so calls may reuse frames (see evalLambda)
+            bool reusesFrames;
         } k;
-        struct Value *(*pf)(struct Value *);
+        struct Primitive {
+            struct Value *(*pf)(struct Interpreter *, struct Value *);
+            char *name;
+            // Entry points taking the arguments directly, used instead of
+            // pf when a call has one argument (pf1), two (pf2), or any
+            // number (pfn); NULL if the primitive has none.
+            struct Value *(*pf1)(struct Interpreter *, struct Value *);
+            struct Value *(*pf2)(struct Interpreter *, struct Value *,
+                                 struct Value *);
+            struct Value *(*pfn)(struct Interpreter *, int, struct Value **);
+        } pr;
+        struct Future *fu;
+        struct PlaceChannel *pc;
+        struct Task *task;
+        struct Channel *channel;
+        struct Value *checks; // (cell . value) pairs a guard requires
+        struct StringBuilder *builder;
+        struct Port *port;
+        struct Macro *macro;
+        struct Promise *promise;
+        struct Escape *escape;
     };
 };
 